@@ -4,13 +4,15 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui network
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 TARGET = QtPlayer
 TEMPLATE = app
 
+CONFIG += c++11
+
 # The following define makes your compiler emit warnings if you use
 # any feature of Qt which as been marked as deprecated (the exact warnings
 # depend on your compiler). Please consult the documentation of the
@@ -26,28 +28,18 @@ DEFINES += QT_DEPRECATED_WARNINGS
 SOURCES += \
         main.cpp \
         mainwindow.cpp \
-    avpacketqueue.cpp \
-    decoder.cpp \
-    audiodecoder.cpp 
-
-INCLUDEPATH += $$PWD/ffmpeg/include \
-                $$PWD/sdl/include
-
-LIBS    += $$PWD/ffmpeg/lib/avcodec.lib \
-            $$PWD/ffmpeg/lib/avdevice.lib \
-            $$PWD/ffmpeg/lib/avfilter.lib \
-            $$PWD/ffmpeg/lib/avformat.lib \
-            $$PWD/ffmpeg/lib/avutil.lib \
-            $$PWD/ffmpeg/lib/postproc.lib \
-            $$PWD/ffmpeg/lib/swresample.lib \
-            $$PWD/ffmpeg/lib/swscale.lib \
-            $$PWD/sdl/lib/libSDL2.a
+    thumbnailer.cpp \
+    glvideowidget.cpp \
+    bench.cpp
 
 HEADERS += \
         mainwindow.h \
-    avpacketqueue.h \
-    decoder.h \
-    audiodecoder.h 
+    thumbnailer.h \
+    glvideowidget.h \
+    bench.h
+
+# playback core: decoders, audio output & media input
+include(playercore.pri)
 
 FORMS += \
         mainwindow.ui
@@ -1,11 +1,14 @@
 #include <QDebug>
 
 #include "audiodecoder.h"
+#include "threadpolicy.h"
 
 /* Minimum SDL audio buffer size, in samples. */
 #define SDL_AUDIO_MIN_BUFFER_SIZE 512
 /* Calculate actual buffer size keeping in mind not cause too frequent audio callbacks */
 #define SDL_AUDIO_MAX_CALLBACKS_PER_SEC 30
+/* Live stream catching up plays this much faster by resampling, in percent. */
+#define AUDIO_SPEEDUP_PERCENT 5
 
 AudioDecoder::AudioDecoder(QObject *parent) :
     QObject(parent),
@@ -14,16 +17,40 @@ AudioDecoder::AudioDecoder(QObject *parent) :
     isreadFinished(false),
     totalTime(0),
     clock(0),
+    seekTarget(0),
+    seekSerial(0),
+    flushSerial(0),
+    skipUntil(0),
+    isSeeking(false),
+    isSpeedUp(false),
+    isCompensating(false),
+    isHold(false),
+    isUnderrun(false),
     volume(SDL_MIX_MAXVOLUME),
     audioDeviceFormat(AUDIO_F32SYS),
     aCovertCtx(NULL),
+    codecCtx(NULL),
+    isDeviceOpen(false),
+    isReused(false),
+    deviceFreq(0),
+    deviceChannels(0),
+    sink(&sdlSink),
+    nextCodecCtx(NULL),
+    nextSkipSamples(0),
+    isDraining(false),
+    skipSamples(0),
+    checkSkipSideData(false),
     sendReturn(0)
 {
 
 }
 
+/* Open decoder & device for stream, decoder & device kept by releaseAudio()
+ * are flushed & reused while stream format matches them.
+ */
 int AudioDecoder::openAudio(AVFormatContext *pFormatCtx, int index)
 {
+    AVCodecParameters *par = pFormatCtx->streams[index]->codecpar;
     AVCodec *codec;
     SDL_AudioSpec wantedSpec;
     int wantedNbChannels;
@@ -38,33 +65,64 @@ int AudioDecoder::openAudio(AVFormatContext *pFormatCtx, int index)
     isPause = false;
     isreadFinished = false;
 
-    audioSrcFmt = AV_SAMPLE_FMT_NONE;
-    audioSrcChannelLayout = 0;
-    audioSrcFreq = 0;
+    /* report first frame like a seek */
+    flushSerial = 0;
+    isSeeking = true;
 
     pFormatCtx->streams[index]->discard = AVDISCARD_DEFAULT;
 
-    stream = pFormatCtx->streams[index];
+    timeBase = pFormatCtx->streams[index]->time_base;
 
-    codecCtx = avcodec_alloc_context3(NULL);
-    avcodec_parameters_to_context(codecCtx, pFormatCtx->streams[index]->codecpar);
+    /* encoder delay, trimmed unless demuxer signals skip samples itself */
+    skipSamples = par->initial_padding;
+    checkSkipSideData = true;
 
-    /* find audio decoder */
-    if ((codec = avcodec_find_decoder(codecCtx->codec_id)) == NULL) {
-        avcodec_free_context(&codecCtx);
-        qDebug() << "Audio decoder not found.";
-        return -1;
-    }
+    isReused = false;
 
-    /* open audio decoder */
-    if (avcodec_open2(codecCtx, codec, NULL) < 0) {
+    if (codecCtx && isCodecReusable(par)) {
+        /* same format as last file, resampler is kept as well */
+        avcodec_flush_buffers(codecCtx);
+        qDebug() << "Reuse audio decoder.";
+    } else {
         avcodec_free_context(&codecCtx);
-        qDebug() << "Could not open audio decoder.";
-        return -1;
+
+        audioSrcFmt = AV_SAMPLE_FMT_NONE;
+        audioSrcChannelLayout = 0;
+        audioSrcFreq = 0;
+
+        codecCtx = avcodec_alloc_context3(NULL);
+        avcodec_parameters_to_context(codecCtx, par);
+
+        /* find audio decoder */
+        if ((codec = avcodec_find_decoder(codecCtx->codec_id)) == NULL) {
+            avcodec_free_context(&codecCtx);
+            qDebug() << "Audio decoder not found.";
+            return -1;
+        }
+
+        /* open audio decoder */
+        if (avcodec_open2(codecCtx, codec, NULL) < 0) {
+            avcodec_free_context(&codecCtx);
+            qDebug() << "Could not open audio decoder.";
+            return -1;
+        }
     }
 
     totalTime = pFormatCtx->duration;
 
+    if (isDeviceOpen) {
+        if (codecCtx->sample_rate == deviceFreq && codecCtx->channels == deviceChannels) {
+            qDebug() << "Reuse audio device.";
+            isReused = true;
+            sink->pause(false);
+            return 0;
+        }
+
+        /* device format differs, negotiate again */
+        sink->close();
+        isDeviceOpen = false;
+    }
+
     env = SDL_getenv("SDL_AUDIO_CHANNELS");
     if (env) {
         qDebug() << "SDL audio channels";
@@ -101,9 +159,9 @@ int AudioDecoder::openAudio(AVFormatContext *pFormatCtx, int index)
      * the actual hardware parameters in the structure pointed to spec.
      */
     while (1) {
-        while (SDL_OpenAudio(&wantedSpec, &spec) < 0) {
-            qDebug() << QString("SDL_OpenAudio (%1 channels, %2 Hz): %3")
-                    .arg(wantedSpec.channels).arg(wantedSpec.freq).arg(SDL_GetError());
+        while (sink->open(&wantedSpec, &spec) < 0) {
+            qDebug() << QString("Audio open (%1 channels, %2 Hz) failed.")
+                    .arg(wantedSpec.channels).arg(wantedSpec.freq);
             wantedSpec.channels = nextNbChannels[FFMIN(7, wantedSpec.channels)];
             if (!wantedSpec.channels) {
                 wantedSpec.freq = nextSampleRates[nextSampleRateIdx--];
@@ -122,7 +180,7 @@ int AudioDecoder::openAudio(AVFormatContext *pFormatCtx, int index)
                      << ", set to advised audio format: " <<  spec.format;
             wantedSpec.format = spec.format;
             audioDeviceFormat = spec.format;
-            SDL_CloseAudio();
+            sink->close();
         } else {
             break;
         }
@@ -165,8 +223,12 @@ int AudioDecoder::openAudio(AVFormatContext *pFormatCtx, int index)
         break;
     }
 
+    isDeviceOpen   = true;
+    deviceFreq     = codecCtx->sample_rate;
+    deviceChannels = codecCtx->channels;
+
     /* open sound */
-    SDL_PauseAudio(0);
+    sink->pause(false);
 
     return 0;
 }
@@ -175,22 +237,136 @@ void AudioDecoder::closeAudio()
 {
     emptyAudioData();
 
-    SDL_LockAudio();
-    SDL_CloseAudio();
-    SDL_UnlockAudio();
+    if (isDeviceOpen) {
+        sink->close();
+        isDeviceOpen = false;
+    }
+
+    avcodec_free_context(&codecCtx);
+
+    if (nextCodecCtx) {
+        avcodec_free_context(&nextCodecCtx);
+    }
+}
+
+/* file closed, keep device paused & decoder open for next file, closeAudio() releases them */
+void AudioDecoder::releaseAudio()
+{
+    if (isDeviceOpen) {
+        sink->pause(true);
+    }
+
+    emptyAudioData();
+
+    if (nextCodecCtx) {
+        avcodec_free_context(&nextCodecCtx);
+    }
+}
+
+/* takes effect at next open, device kept open is closed, NULL for SDL audio device */
+void AudioDecoder::setAudioSink(AudioSink *sink)
+{
+    closeAudio();
+
+    this->sink = sink ? sink : &sdlSink;
+}
+
+bool AudioDecoder::isDeviceReused()
+{
+    return isReused;
+}
+
+/* opened decoder decodes stream of this format without reopening */
+bool AudioDecoder::isCodecReusable(AVCodecParameters *par)
+{
+    return avcodec_is_open(codecCtx)
+            && codecCtx->codec_id       == par->codec_id
+            && codecCtx->sample_rate    == par->sample_rate
+            && codecCtx->channels       == par->channels
+            && codecCtx->channel_layout == par->channel_layout
+            && codecCtx->extradata_size == par->extradata_size
+            && (par->extradata_size == 0 || !memcmp(codecCtx->extradata, par->extradata, par->extradata_size));
+}
+
+/* Open decoder of next track, switched in while current track drained,
+ * so device keeps open & no gap between tracks.
+ * Return -1 while track needs another device format.
+ */
+int AudioDecoder::prepareNextTrack(AVFormatContext *pFormatCtx, int index)
+{
+    AVCodec *codec;
+    AVCodecContext *ctx;
+    AVCodecParameters *par = pFormatCtx->streams[index]->codecpar;
+
+    /* current track has finished already */
+    if (isStop) {
+        return -1;
+    }
+
+    if (par->sample_rate != spec.freq || par->channels != spec.channels) {
+        qDebug() << "Next track format not compatible with audio device, freq:" << par->sample_rate
+                 << "channels:" << par->channels;
+        return -1;
+    }
+
+    ctx = avcodec_alloc_context3(NULL);
+    avcodec_parameters_to_context(ctx, par);
+
+    if ((codec = avcodec_find_decoder(ctx->codec_id)) == NULL || avcodec_open2(ctx, codec, NULL) < 0) {
+        avcodec_free_context(&ctx);
+        qDebug() << "Could not open next track audio decoder.";
+        return -1;
+    }
+
+    if (nextCodecCtx) {
+        avcodec_free_context(&nextCodecCtx);
+    }
+
+    pFormatCtx->streams[index]->discard = AVDISCARD_DEFAULT;
+
+    nextCodecCtx    = ctx;
+    nextTimeBase    = pFormatCtx->streams[index]->time_base;
+    nextSkipSamples = par->initial_padding;
+    totalTime       = pFormatCtx->duration;
+
+    isreadFinished = false;
 
-    avcodec_close(codecCtx);
+    return 0;
+}
+
+void AudioDecoder::switchTrack()
+{
     avcodec_free_context(&codecCtx);
+
+    codecCtx = nextCodecCtx;
+    nextCodecCtx = NULL;
+
+    timeBase = nextTimeBase;
+    skipSamples = nextSkipSamples;
+    checkSkipSideData = true;
+
+    clock = 0;
+    sendReturn = 0;
+    isDraining = false;
+
+    qDebug() << "Audio track changed.";
+
+    emit trackChanged();
 }
 
+/* called by reading thread, no more packets of current track */
 void AudioDecoder::readFileFinished()
 {
     isreadFinished = true;
 }
 
+/* pause device, so no callback runs while paused */
 void AudioDecoder::pauseAudio(bool pause)
 {
     isPause = pause;
+    if (isDeviceOpen) {
+        sink->pause(pause);
+    }
 }
 
 void AudioDecoder::stopAudio()
@@ -203,6 +379,30 @@ void AudioDecoder::packetEnqueue(AVPacket *packet)
     packetQueue.enqueue(packet);
 }
 
+void AudioDecoder::setSeekTarget(double target, int serial)
+{
+    seekTarget = target;
+    seekSerial = serial;
+}
+
+/* live stream is behind target latency, play faster to catch up */
+void AudioDecoder::setSpeedUp(bool speedUp)
+{
+    isSpeedUp = speedUp;
+}
+
+/* live stream prebuffering, device plays silence & clock stands still */
+void AudioDecoder::setHold(bool hold)
+{
+    isHold = hold;
+}
+
+/* queue ran empty while reading goes on since last call */
+bool AudioDecoder::takeUnderrun()
+{
+    return isUnderrun.exchange(false);
+}
+
 void AudioDecoder::emptyAudioData()
 {
     audioBuf = nullptr;
@@ -212,6 +412,14 @@ void AudioDecoder::emptyAudioData()
     audioBufSize1 = 0;
 
     clock = 0;
+    seekTarget = 0;
+    skipUntil = 0;
+    isSeeking = false;
+    isSpeedUp = false;
+    isUnderrun = false;
+    isDraining = false;
+    skipSamples = 0;
+    checkSkipSideData = false;
 
     sendReturn = 0;
 
@@ -228,23 +436,33 @@ void AudioDecoder::setVolume(int volume)
     this->volume = volume;
 }
 
+/* clock of audio played, decoded data still in buffer not counted, clock itself left as it is */
 double AudioDecoder::getAudioClock()
 {
+    double playedClock = clock;
+
     if (codecCtx) {
-        /* control audio pts according to audio buffer data size */
+        /* control audio pts according to audio buffer data size, buffer is in device format */
         int hwBufSize   = audioBufSize - audioBufIndex;
-        int bytesPerSec = codecCtx->sample_rate * codecCtx->channels * audioDepth;
+        int bytesPerSec = spec.freq * spec.channels * audioDepth;
 
-        clock -= static_cast<double>(hwBufSize) / bytesPerSec;
+        playedClock -= static_cast<double>(hwBufSize) / bytesPerSec;
     }
 
-    return clock;
+    return playedClock;
 }
 
 void AudioDecoder::audioCallback(void *userdata, quint8 *stream, int SDL_AudioBufSize)
 {
     AudioDecoder *decoder = (AudioDecoder *)userdata;
 
+    /* device thread is made by SDL, set up on its first callback */
+    static thread_local bool isPolicyApplied = false;
+    if (!isPolicyApplied) {
+        ThreadPolicy::apply(ThreadPolicy::ROLE_AUDIO);
+        isPolicyApplied = true;
+    }
+
     int decodedSize;
     /* SDL_BufSize means audio play buffer left size
      * while it greater than 0, means counld fill data to it
@@ -254,9 +472,10 @@ void AudioDecoder::audioCallback(void *userdata, quint8 *stream, int SDL_AudioBu
             return ;
         }
 
-        if (decoder->isPause) {
-            SDL_Delay(10);
-            continue;
+        /* device is paused as well, output silence if called anyway */
+        if (decoder->isPause || decoder->isHold) {
+            memset(stream, 0, SDL_AudioBufSize);
+            return;
         }
 
         /* no data in buffer */
@@ -282,7 +501,7 @@ void AudioDecoder::audioCallback(void *userdata, quint8 *stream, int SDL_AudioBu
 
         if (decoder->audioBuf) {
             memset(stream, 0, left);
-            SDL_MixAudio(stream, decoder->audioBuf + decoder->audioBufIndex, left, decoder->volume);
+            SDL_MixAudioFormat(stream, decoder->audioBuf + decoder->audioBufIndex, decoder->spec.format, left, decoder->volume);
         }
 
         SDL_AudioBufSize -= left;
@@ -303,15 +522,18 @@ int AudioDecoder::decodeAudio()
     }
 
     if (isStop) {
+        av_frame_free(&frame);
         return -1;
     }
 
     if (packetQueue.queueSize() <= 0) {
         if (isreadFinished) {
             isStop = true;
-            SDL_Delay(100);
             emit playFinished();
+        } else {
+            isUnderrun = true;
         }
+        av_frame_free(&frame);
         return -1;
     }
 
@@ -325,34 +547,82 @@ int AudioDecoder::decodeAudio()
         av_packet_unref(&packet);
         av_frame_free(&frame);
         sendReturn = 0;
+        skipUntil = seekTarget;
+        flushSerial = seekSerial;
+        isSeeking = true;
         qDebug() << "seek audio";
         return -1;
     }
 
-    /* while return -11 means packet have data not resolved,
-     * this packet cannot be unref
-     */
-    sendReturn = avcodec_send_packet(codecCtx, &packet);
-    if ((sendReturn < 0) && (sendReturn != AVERROR(EAGAIN)) && (sendReturn != AVERROR_EOF)) {
-        av_packet_unref(&packet);
-        av_frame_free(&frame);
-        qDebug() << "Audio send to decoder failed, error code: " << sendReturn;
-        return sendReturn;
-    }
+    if (!strcmp((char*)packet.data, "NEXT")) {
+        /* next gapless track, play delayed samples of current decoder first */
+        if (!isDraining) {
+            avcodec_send_packet(codecCtx, NULL);
+            isDraining = true;
+        }
 
-    ret = avcodec_receive_frame(codecCtx, frame);
-    if ((ret < 0) && (ret != AVERROR(EAGAIN))) {
-        av_packet_unref(&packet);
-        av_frame_free(&frame);
-        qDebug() << "Audio frame decode failed, error code: " << ret;
-        return ret;
+        ret = avcodec_receive_frame(codecCtx, frame);
+        if (ret < 0) {
+            av_packet_unref(&packet);
+            av_frame_free(&frame);
+            switchTrack();
+            return 0;
+        }
+
+        /* keep this packet until decoder drained */
+        sendReturn = AVERROR(EAGAIN);
+    } else {
+        /* demuxer trims encoder delay by side data, do not trim twice */
+        if (checkSkipSideData) {
+            checkSkipSideData = false;
+            if (av_packet_get_side_data(&packet, AV_PKT_DATA_SKIP_SAMPLES, NULL)) {
+                skipSamples = 0;
+            }
+        }
+
+        /* while return -11 means packet have data not resolved,
+         * this packet cannot be unref
+         */
+        sendReturn = avcodec_send_packet(codecCtx, &packet);
+        if ((sendReturn < 0) && (sendReturn != AVERROR(EAGAIN)) && (sendReturn != AVERROR_EOF)) {
+            av_packet_unref(&packet);
+            av_frame_free(&frame);
+            qDebug() << "Audio send to decoder failed, error code: " << sendReturn;
+            return sendReturn;
+        }
+
+        ret = avcodec_receive_frame(codecCtx, frame);
+        if ((ret < 0) && (ret != AVERROR(EAGAIN))) {
+            av_packet_unref(&packet);
+            av_frame_free(&frame);
+            qDebug() << "Audio frame decode failed, error code: " << ret;
+            return ret;
+        }
     }
 
     if (frame->pts != AV_NOPTS_VALUE) {
-        clock = av_q2d(stream->time_base) * frame->pts;
+        clock = av_q2d(timeBase) * frame->pts;
 //        qDebug() << "no pts";
     }
 
+    /* accurate seek, drop frames which end before seek target */
+    if (ret >= 0 && skipUntil > 0) {
+        if (clock + static_cast<double>(frame->nb_samples) / frame->sample_rate < skipUntil) {
+            if (sendReturn != AVERROR(EAGAIN)) {
+                av_packet_unref(&packet);
+            }
+            av_frame_free(&frame);
+            audioBuf = nullptr;
+            return 0;
+        }
+        skipUntil = 0;
+    }
+
+    if (ret >= 0 && isSeeking) {
+        isSeeking = false;
+        emit seekFinished(flushSerial);
+    }
+
     /* get audio channels */
     qint64 inChannelLayout = (frame->channel_layout && frame->channels == av_get_channel_layout_nb_channels(frame->channel_layout)) ?
                 frame->channel_layout : av_get_default_channel_layout(frame->channels);
@@ -378,6 +648,17 @@ int AudioDecoder::decodeAudio()
         audioSrcChannelLayout   = inChannelLayout;
         audioSrcFreq            = frame->sample_rate;
         audioSrcChannels        = frame->channels;
+        isCompensating          = false;
+    }
+
+    /* live stream catching up, resample each frame a few percent shorter, pitch barely moves */
+    if (isSpeedUp) {
+        int outSamples = av_rescale_rnd(frame->nb_samples, spec.freq, frame->sample_rate, AV_ROUND_UP);
+        swr_set_compensation(aCovertCtx, -outSamples * AUDIO_SPEEDUP_PERCENT / 100, outSamples);
+        isCompensating = true;
+    } else if (isCompensating) {
+        swr_set_compensation(aCovertCtx, 0, 0);
+        isCompensating = false;
     }
 
     if (aCovertCtx) {
@@ -401,6 +682,16 @@ int AudioDecoder::decodeAudio()
             }
         }
 
+        /* trim encoder delay at track start */
+        if (skipSamples > 0 && sampleSize > 0) {
+            int drop = FFMIN(skipSamples, sampleSize);
+            int bytesPerSample = spec.channels * av_get_bytes_per_sample(audioDstFmt);
+
+            memmove(audioBuf1, audioBuf1 + drop * bytesPerSample, (sampleSize - drop) * bytesPerSample);
+            sampleSize  -= drop;
+            skipSamples -= drop;
+        }
+
         audioBuf = audioBuf1;
         resampledDataSize = sampleSize * spec.channels * av_get_bytes_per_sample(audioDstFmt);
     } else {
@@ -408,7 +699,8 @@ int AudioDecoder::decodeAudio()
         resampledDataSize = av_samples_get_buffer_size(NULL, frame->channels, frame->nb_samples, static_cast<AVSampleFormat>(frame->format), 1);
     }
 
-    clock += static_cast<double>(resampledDataSize) / (audioDepth * codecCtx->channels * codecCtx->sample_rate);
+    /* by source duration, resampled size is shorter while catching up */
+    clock += static_cast<double>(frame->nb_samples) / frame->sample_rate;
 
     if (sendReturn != AVERROR(EAGAIN)) {
         av_packet_unref(&packet);
@@ -2,6 +2,7 @@
 #define AUDIODECODER_H
 
 #include <QObject>
+#include <atomic>
 
 extern "C"
 {
@@ -9,6 +10,7 @@ extern "C"
 }
 
 #include "avpacketqueue.h"
+#include "audiosink.h"
 
 class AudioDecoder : public QObject
 {
@@ -18,6 +20,9 @@ public:
 
     int openAudio(AVFormatContext *pFormatCtx, int index);
     void closeAudio();
+    void releaseAudio();
+    void setAudioSink(AudioSink *sink);
+    bool isDeviceReused();
     void pauseAudio(bool pause);
     void stopAudio();
     int getVolume();
@@ -26,20 +31,38 @@ public:
     void packetEnqueue(AVPacket *packet);
     void emptyAudioData();
     void setTotalTime(qint64 time);
+    void setSeekTarget(double target, int serial);
+    int prepareNextTrack(AVFormatContext *pFormatCtx, int index);
+    void readFileFinished();
+    void setSpeedUp(bool speedUp);
+    void setHold(bool hold);
+    bool takeUnderrun();
 
 private:
+    bool isCodecReusable(AVCodecParameters *par);
+
     int decodeAudio();
+    void switchTrack();
     static void audioCallback(void *userdata, quint8 *stream, int SDL_AudioBufSize);
 
-    bool isStop;
-    bool isPause;
-    bool isreadFinished;
+    std::atomic<bool> isStop;       // set by gui & decoder threads, read by audio callback
+    std::atomic<bool> isPause;
+    std::atomic<bool> isreadFinished;
 
     qint64 totalTime;
     double clock;
+    double seekTarget;  // target of the pending flush, applied while flushing
+    int seekSerial;     // seek request serial of the pending flush
+    int flushSerial;    // seek request serial of the last flush
+    double skipUntil;   // drop decoded frames ending before this time
+    bool isSeeking;     // waiting for the first frame after a flush
+    std::atomic<bool> isSpeedUp;    // live stream catching up, frames resampled shorter
+    bool isCompensating;    // swr compensation set on aCovertCtx
+    std::atomic<bool> isHold;       // live prebuffering, set by reading thread
+    std::atomic<bool> isUnderrun;   // queue ran empty before read finished
     int volume;
 
-    AVStream *stream;
+    AVRational timeBase;    // time base of current stream
 
     quint8 *audioBuf;
     quint32 audioBufSize;
@@ -62,6 +85,24 @@ private:
 
     AVCodecContext *codecCtx;          // audio codec context
 
+    /* device & decoder kept open between files, reused while format matches */
+    bool isDeviceOpen;
+    bool isReused;              // last openAudio() reused the device
+    int deviceFreq;             // stream sample rate device was opened for
+    int deviceChannels;         // stream channels device was opened for
+
+    AudioSink *sink;            // output device, sdlSink unless set
+    SdlAudioSink sdlSink;
+
+    /* gapless playback, next track decoder switched in after current one drained */
+    AVCodecContext *nextCodecCtx;
+    AVRational nextTimeBase;
+    int nextSkipSamples;
+    bool isDraining;
+
+    int skipSamples;            // encoder delay samples left to trim at track start
+    bool checkSkipSideData;     // first packet of track not checked for skip samples yet
+
     AvPacketQueue packetQueue;
 
     AVPacket packet;
@@ -70,9 +111,8 @@ private:
 
 signals:
     void playFinished();
-
-public slots:
-    void readFileFinished();
+    void seekFinished(int serial);
+    void trackChanged();
 
 };
 
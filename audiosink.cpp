@@ -0,0 +1,27 @@
+#include <QDebug>
+
+#include "audiosink.h"
+
+int SdlAudioSink::open(const SDL_AudioSpec *wanted, SDL_AudioSpec *obtained)
+{
+    SDL_AudioSpec spec = *wanted;
+
+    if (SDL_OpenAudio(&spec, obtained) < 0) {
+        qDebug() << "SDL_OpenAudio failed:" << SDL_GetError();
+        return -1;
+    }
+
+    return 0;
+}
+
+void SdlAudioSink::close()
+{
+    SDL_LockAudio();
+    SDL_CloseAudio();
+    SDL_UnlockAudio();
+}
+
+void SdlAudioSink::pause(bool pause)
+{
+    SDL_PauseAudio(pause ? 1 : 0);
+}
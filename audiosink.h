@@ -0,0 +1,30 @@
+#ifndef AUDIOSINK_H
+#define AUDIOSINK_H
+
+#include "SDL2/SDL.h"
+
+/* Output of decoded audio. Sink pulls data through wanted->callback the way
+ * an SDL audio device does, so it may play, mix or record it.
+ */
+class AudioSink
+{
+public:
+    virtual ~AudioSink() {}
+
+    /* fill obtained with format accepted, -1 while wanted format cannot be served */
+    virtual int open(const SDL_AudioSpec *wanted, SDL_AudioSpec *obtained) = 0;
+    /* no callback runs after it returns */
+    virtual void close() = 0;
+    virtual void pause(bool pause) = 0;
+};
+
+/* Default sink, SDL audio device. */
+class SdlAudioSink : public AudioSink
+{
+public:
+    int open(const SDL_AudioSpec *wanted, SDL_AudioSpec *obtained);
+    void close();
+    void pause(bool pause);
+};
+
+#endif // AUDIOSINK_H
@@ -1,9 +1,12 @@
 #include "avpacketqueue.h"
 
-AvPacketQueue::AvPacketQueue()
+AvPacketQueue::AvPacketQueue() :
+    isWakeUp(false),
+    isSpaceWakeUp(false)
 {
-    mutex   = SDL_CreateMutex();
-    cond    = SDL_CreateCond();
+    mutex       = SDL_CreateMutex();
+    cond        = SDL_CreateCond();
+    spaceCond   = SDL_CreateCond();
 }
 
 void AvPacketQueue::enqueue(AVPacket *packet)
@@ -22,6 +25,7 @@ void AvPacketQueue::dequeue(AVPacket *packet, bool isBlock)
     while (1) {
         if (!queue.isEmpty()) {
             *packet = queue.dequeue();
+            SDL_CondSignal(spaceCond);
             break;
         } else if (!isBlock) {
             break;
@@ -40,6 +44,7 @@ void AvPacketQueue::empty()
         av_packet_unref(&packet);
     }
 
+    SDL_CondSignal(spaceCond);
     SDL_UnlockMutex(mutex);
 }
 
@@ -52,3 +57,40 @@ int AvPacketQueue::queueSize()
 {
     return queue.size();
 }
+
+/* block until packet queued or wakeUp() called, true while queue has packets */
+bool AvPacketQueue::wait()
+{
+    SDL_LockMutex(mutex);
+    while (queue.isEmpty() && !isWakeUp) {
+        SDL_CondWait(cond, mutex);
+    }
+    isWakeUp = false;
+
+    bool hasPacket = !queue.isEmpty();
+    SDL_UnlockMutex(mutex);
+
+    return hasPacket;
+}
+
+/* block while queue holds more than maxSize packets, until wakeUp() called */
+void AvPacketQueue::waitSpace(int maxSize)
+{
+    SDL_LockMutex(mutex);
+    while (queue.size() > maxSize && !isSpaceWakeUp) {
+        SDL_CondWait(spaceCond, mutex);
+    }
+    isSpaceWakeUp = false;
+    SDL_UnlockMutex(mutex);
+}
+
+/* let waiting threads check stop, pause & seek, kept pending while nobody waits */
+void AvPacketQueue::wakeUp()
+{
+    SDL_LockMutex(mutex);
+    isWakeUp = true;
+    isSpaceWakeUp = true;
+    SDL_CondBroadcast(cond);
+    SDL_CondBroadcast(spaceCond);
+    SDL_UnlockMutex(mutex);
+}
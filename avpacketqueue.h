@@ -26,9 +26,19 @@ public:
 
     int queueSize();
 
+    bool wait();
+
+    void waitSpace(int maxSize);
+
+    void wakeUp();
+
 private:
     SDL_mutex *mutex;
     SDL_cond *cond;
+    SDL_cond *spaceCond;    // signalled while packets taken out
+
+    bool isWakeUp;          // pending wakeUp() for wait()
+    bool isSpaceWakeUp;     // pending wakeUp() for waitSpace()
 
     QQueue<AVPacket> queue;
 };
@@ -0,0 +1,1079 @@
+#include <QTextStream>
+#include <QSize>
+#include <QImage>
+#include <QThread>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUdpSocket>
+#include <QTimer>
+#include <QFile>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QRegularExpression>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOffscreenSurface>
+#include <QMutex>
+#include <QVector>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#include <atomic>
+#include <memory>
+
+extern "C"
+{
+#include "libavformat/avformat.h"
+#include "libavutil/time.h"
+#include "libavutil/pixdesc.h"
+#include "libavutil/imgutils.h"
+#include "libswscale/swscale.h"
+}
+
+#include "bench.h"
+#include "mediaio.h"
+#include "yuvconvert.h"
+#include "frameconverter.h"
+#include "taskpool.h"
+#include "decoder.h"
+#include "glvideowidget.h"
+
+/* Random seeks done by io benchmark. */
+#define BENCH_SEEK_COUNT 100
+/* Frames converted per converter by convert benchmark. */
+#define BENCH_CONVERT_FRAMES 50
+/* Opening may overrun its deadline by this much, one interrupt poll & cleanup, in microseconds. */
+#define BENCH_OPEN_SLACK (1000000)
+/* Stop of a blocked open returns within this, in microseconds. */
+#define BENCH_STOP_LIMIT (500000)
+/* Time given to a second open to block in I/O before it is stopped, in ms. */
+#define BENCH_STOP_DELAY 1000
+/* Times each switch between two files is done by switch benchmark. */
+#define BENCH_SWITCH_ROUNDS 5
+/* Time a file plays before switching away, in ms. */
+#define BENCH_SWITCH_PLAY 1000
+/* First frame of switched file given up after this, in ms. */
+#define BENCH_SWITCH_TIMEOUT 10000
+/* Playing time of memory benchmark without one given, in seconds. */
+#define BENCH_MEMORY_SECONDS 60
+/* Paint interval of memory benchmark, in ms. */
+#define BENCH_PAINT_INTERVAL 16
+/* Size of file served by range benchmark, beyond read-ahead & not a multiple of fetch chunk. */
+#define BENCH_RANGE_SIZE (40 * 1024 * 1024 + 12345)
+/* Delay of range replies starting in an even MB, so odd ones land first, in ms. */
+#define BENCH_RANGE_DELAY 40
+/* Live latency sampling interval of live benchmark, in ms. */
+#define BENCH_LIVE_SAMPLE 100
+/* Live latency averaged over last this long of live benchmark must be below limit, in ms. */
+#define BENCH_LIVE_SETTLED 2000
+#define BENCH_LIVE_MAX_LATENCY 1000
+/* Per channel difference of OpenGL output to FrameConverter allowed, mean & largest,
+ * chroma is interpolated by texture sampling & rounded differently
+ */
+#define BENCH_GL_MEAN_DIFF 3.0
+#define BENCH_GL_MAX_DIFF 24
+
+static QTextStream out(stdout);
+
+/* keeps newest frame as main window does, painted by memory benchmark */
+class BenchSink : public FrameSink
+{
+public:
+    BenchSink() :
+        frame(av_frame_alloc()),
+        frames(0),
+        isFrameChanged(false)
+    {
+
+    }
+
+    ~BenchSink()
+    {
+        av_frame_free(&frame);
+    }
+
+    void frameReady(const AVFrame *frame, double pts)
+    {
+        Q_UNUSED(pts);
+
+        mutex.lock();
+        av_frame_unref(this->frame);
+        av_frame_ref(this->frame, frame);
+        frames++;
+        isFrameChanged = true;
+        mutex.unlock();
+    }
+
+    /* newest frame referenced into paintFrame, false while it was taken already */
+    bool takeFrame(AVFrame *paintFrame)
+    {
+        QMutexLocker locker(&mutex);
+
+        if (!isFrameChanged) {
+            return false;
+        }
+
+        av_frame_unref(paintFrame);
+        av_frame_ref(paintFrame, frame);
+        isFrameChanged = false;
+
+        return true;
+    }
+
+    int getFrames()
+    {
+        QMutexLocker locker(&mutex);
+        return frames;
+    }
+
+private:
+    QMutex mutex;
+    AVFrame *frame;
+    int frames;
+    bool isFrameChanged;
+};
+
+/* args: arguments after --bench */
+int Bench::run(QStringList args)
+{
+    av_register_all();
+    avformat_network_init();
+
+    if (args.size() >= 2 && args[0] == "io") {
+        return ioBench(args[1], args.mid(2));
+    }
+
+    if (args.size() >= 1 && args[0] == "convert") {
+        return convertBench(args.mid(1));
+    }
+
+    if (args.size() >= 1 && args[0] == "timeout") {
+        return timeoutBench();
+    }
+
+    if (args.size() >= 3 && args[0] == "switch") {
+        return switchBench(args[1], args[2]);
+    }
+
+    if (args.size() >= 1 && args[0] == "gl") {
+        return glBench();
+    }
+
+    if (args.size() >= 2 && args[0] == "live") {
+        return liveBench(args[1]);
+    }
+
+    if (args.size() >= 1 && args[0] == "range") {
+        return rangeBench();
+    }
+
+    if (args.size() >= 2 && args[0] == "memory") {
+        return memoryBench(args[1], (args.size() >= 3) ? args[2].toInt() : BENCH_MEMORY_SECONDS);
+    }
+
+    out << "usage: QtPlayer --bench io <file> [" << MediaIO::backendNames().join("|") << "]...\n"
+        << "       QtPlayer --bench convert [1080p|4k|<width>x<height>]...\n"
+        << "       QtPlayer --bench timeout\n"
+        << "       QtPlayer --bench switch <video> <video of other format>\n"
+        << "       QtPlayer --bench memory <video> [seconds]\n"
+        << "       QtPlayer --bench range\n"
+        << "       QtPlayer --bench live <video with audio, 20 s or longer>\n"
+        << "       QtPlayer --bench gl [-platform offscreen]\n";
+
+    return -1;
+}
+
+/* open, demux whole file & seek randomly through every backend */
+int Bench::ioBench(QString file, QStringList backends)
+{
+    if (backends.isEmpty()) {
+        backends = MediaIO::backendNames();
+    }
+
+    out << "file: " << file << "\n"
+        << "note: first run warms page cache, drop caches between runs for cold numbers\n";
+
+    foreach (QString backendName, backends) {
+        AVPacket packet;
+        qint64 bytes = 0;
+        int packets = 0;
+        int seeks = 0;
+
+        MediaIO::Backend backend = MediaIO::backendFromName(backendName);
+        AVFormatContext *pFormatCtx = avformat_alloc_context();
+
+        qint64 start = av_gettime_relative();
+
+        MediaIO *io = MediaIO::create(backend, file, NULL);
+        if (io) {
+            pFormatCtx->pb = io->context();
+        }
+
+        if (avformat_open_input(&pFormatCtx, file.toLocal8Bit().data(), NULL, NULL) != 0
+                || avformat_find_stream_info(pFormatCtx, NULL) < 0) {
+            out << backendName << ": open failed\n";
+            avformat_close_input(&pFormatCtx);
+            delete io;
+            continue;
+        }
+
+        qint64 openTime = av_gettime_relative() - start;
+
+        /* sequential demuxing */
+        start = av_gettime_relative();
+        while (av_read_frame(pFormatCtx, &packet) >= 0) {
+            bytes += packet.size;
+            packets++;
+            av_packet_unref(&packet);
+        }
+        qint64 readTime = av_gettime_relative() - start;
+
+        /* same seek positions for every backend */
+        qsrand(1);
+        start = av_gettime_relative();
+        for (int i = 0; i < BENCH_SEEK_COUNT && pFormatCtx->duration > 0; i++) {
+            qint64 pos = static_cast<qint64>(qrand() / static_cast<double>(RAND_MAX) * pFormatCtx->duration);
+            if (pFormatCtx->start_time != AV_NOPTS_VALUE) {
+                pos += pFormatCtx->start_time;
+            }
+
+            if (av_seek_frame(pFormatCtx, -1, pos, AVSEEK_FLAG_BACKWARD) >= 0
+                    && av_read_frame(pFormatCtx, &packet) >= 0) {
+                av_packet_unref(&packet);
+                seeks++;
+            }
+        }
+        qint64 seekTime = av_gettime_relative() - start;
+
+        out << backendName << ": open " << openTime / 1000.0 << " ms, "
+            << packets << " packets " << bytes / 1048576.0 << " MB in " << readTime / 1000.0 << " ms ("
+            << (readTime > 0 ? bytes / 1048576.0 / (readTime / 1000000.0) : 0) << " MB/s), "
+            << seeks << " seeks avg " << (seeks > 0 ? seekTime / 1000.0 / seeks : 0) << " ms\n";
+        out.flush();
+
+        avformat_close_input(&pFormatCtx);
+
+        if (io) {
+            io->printStats();
+            delete io;
+        }
+    }
+
+    return 0;
+}
+
+/* yuv to rgb32 at unchanged size, swscale against own kernels of every isa the cpu runs,
+ * then FrameConverter unscaled & scaled to half by 1, 2, 4... threads
+ */
+int Bench::convertBench(QStringList sizes)
+{
+    AVPixelFormat formats[] = {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12};
+
+    if (sizes.isEmpty()) {
+        sizes << "1080p" << "4k";
+    }
+
+    out << "frames: " << BENCH_CONVERT_FRAMES << " per converter, BT.709 limited range\n";
+
+    foreach (QString sizeName, sizes) {
+        QSize size;
+        if (sizeName == "1080p") {
+            size = QSize(1920, 1080);
+        } else if (sizeName == "4k") {
+            size = QSize(3840, 2160);
+        } else if (sizeName.split('x').size() == 2) {
+            size = QSize(sizeName.split('x')[0].toInt(), sizeName.split('x')[1].toInt());
+        }
+
+        if (size.isEmpty()) {
+            out << sizeName << ": unknown size\n";
+            continue;
+        }
+
+        for (AVPixelFormat format : formats) {
+            QString name = QString("%1 %2").arg(sizeName).arg(av_get_pix_fmt_name(format));
+            AVFrame *frame = av_frame_alloc();
+            frame->width       = size.width();
+            frame->height      = size.height();
+            frame->format      = format;
+            frame->colorspace  = AVCOL_SPC_BT709;
+            frame->color_range = AVCOL_RANGE_MPEG;
+
+            if (av_frame_get_buffer(frame, 32) < 0) {
+                out << name << ": frame alloc failed\n";
+                av_frame_free(&frame);
+                continue;
+            }
+
+            /* noise, so no kernel gets an easy case */
+            qsrand(1);
+            for (int p = 0; p < 2 + (format == AV_PIX_FMT_YUV420P); p++) {
+                int rows = (p == 0) ? frame->height : (frame->height + 1) / 2;
+                for (int i = 0; i < frame->linesize[p] * rows; i++) {
+                    frame->data[p][i] = qrand();
+                }
+            }
+
+            int dstStride = size.width() * 4;
+            QByteArray reference(dstStride * size.height(), 0);
+            QByteArray result(dstStride * size.height(), 0);
+            uint8_t *dst[4] = {reinterpret_cast<uint8_t *>(result.data()), NULL, NULL, NULL};
+            int dstStrides[4] = {dstStride, 0, 0, 0};
+
+            YuvConvert::findKernel(frame, YuvConvert::OUTPUT_RGB32, YuvConvert::ISA_C)
+                    (frame, reinterpret_cast<uchar *>(reference.data()), dstStride, 0, frame->height);
+
+            SwsContext *swsCtx = sws_getContext(size.width(), size.height(), format,
+                                                size.width(), size.height(), AV_PIX_FMT_RGB32,
+                                                SWS_BILINEAR, NULL, NULL, NULL);
+            sws_setColorspaceDetails(swsCtx, sws_getCoefficients(SWS_CS_ITU709), 0,
+                                     sws_getCoefficients(SWS_CS_DEFAULT), 1, 0, 1 << 16, 1 << 16);
+
+            qint64 start = av_gettime_relative();
+            for (int i = 0; i < BENCH_CONVERT_FRAMES; i++) {
+                sws_scale(swsCtx, frame->data, frame->linesize, 0, frame->height, dst, dstStrides);
+            }
+            double swsTime = (av_gettime_relative() - start) / 1000.0 / BENCH_CONVERT_FRAMES;
+            sws_freeContext(swsCtx);
+
+            out << name << " swscale: " << swsTime << " ms/frame\n";
+
+            foreach (YuvConvert::Isa isa, YuvConvert::availableIsas()) {
+                YuvConvert::Kernel kernel = YuvConvert::findKernel(frame, YuvConvert::OUTPUT_RGB32, isa);
+
+                start = av_gettime_relative();
+                for (int i = 0; i < BENCH_CONVERT_FRAMES; i++) {
+                    kernel(frame, dst[0], dstStride, 0, frame->height);
+                }
+                double time = (av_gettime_relative() - start) / 1000.0 / BENCH_CONVERT_FRAMES;
+
+                out << name << " " << YuvConvert::isaName(isa) << ": " << time << " ms/frame, "
+                    << (time > 0 ? swsTime / time : 0) << "x swscale, "
+                    << (result == reference ? "same as c" : "DIFFERS from c") << "\n";
+                out.flush();
+            }
+
+            threadsBench(frame, name);
+
+            av_frame_free(&frame);
+        }
+    }
+
+    /* slices run on shared pool, how long they queued & ran */
+    TaskPool::Stats poolStats = TaskPool::instance()->getStats();
+    out << "pool: " << poolStats.threadCount << " threads, " << poolStats.stolen << " tasks stolen\n";
+    foreach (TaskPool::TaskStats taskStats, poolStats.tasks) {
+        int count = qMax(taskStats.finished, 1);
+        out << taskStats.name << ": " << taskStats.finished << " finished, " << taskStats.canceled << " canceled, "
+            << taskStats.waitTime / 1000.0 / count << " ms wait, "
+            << taskStats.runTime / 1000.0 / count << " ms run, "
+            << taskStats.maxRunTime / 1000.0 << " ms max run\n";
+    }
+
+    return 0;
+}
+
+/* time per frame of FrameConverter by thread count, speedup against one thread */
+void Bench::threadsBench(const AVFrame *frame, QString name)
+{
+    QList<int> threadCounts;
+    for (int count = 1; count < QThread::idealThreadCount(); count *= 2) {
+        threadCounts << count;
+    }
+    threadCounts << QThread::idealThreadCount();
+
+    QSize sizes[] = {QSize(frame->width, frame->height), QSize(frame->width / 2, frame->height / 2)};
+
+    for (QSize size : sizes) {
+        QString sizeName = QString("%1 to %2x%3").arg(name).arg(size.width()).arg(size.height());
+        QImage reference;
+        double singleTime = 0;
+
+        foreach (int count, threadCounts) {
+            FrameConverter converter;
+            QImage image;
+            converter.setThreadCount(count);
+
+            /* first frame makes scalers, not timed */
+            converter.convert(frame, size, &image);
+
+            qint64 start = av_gettime_relative();
+            for (int i = 0; i < BENCH_CONVERT_FRAMES; i++) {
+                converter.convert(frame, size, &image);
+            }
+            double time = (av_gettime_relative() - start) / 1000.0 / BENCH_CONVERT_FRAMES;
+
+            if (count == 1) {
+                singleTime = time;
+                reference = image;
+            }
+
+            out << sizeName << " " << count << " threads: " << time << " ms/frame, "
+                << (time > 0 ? singleTime / time : 0) << "x one thread";
+            /* scaled slices filter band edges apart, output differs a little there */
+            if (size == QSize(frame->width, frame->height)) {
+                out << ", " << (image == reference ? "same as one thread" : "DIFFERS from one thread");
+            }
+            out << "\n";
+            out.flush();
+        }
+    }
+}
+
+/* local server that accepts but never replies, opening must give up at
+ * IO_OPEN_TIMEOUT & stopping a blocked open must return at once, 0 if both hold
+ */
+int Bench::timeoutBench()
+{
+    QTcpServer server;
+    if (!server.listen(QHostAddress::LocalHost)) {
+        out << "listen failed: " << server.errorString() << "\n";
+        return -1;
+    }
+
+    /* connection completes from listen backlog, nothing is ever sent */
+    QString url = QString("tcp://127.0.0.1:%1").arg(server.serverPort());
+    Decoder decoder;
+    int failures = 0;
+
+    out << "url: " << url << ", open timeout " << IO_OPEN_TIMEOUT / 1000 << " ms\n";
+    out.flush();
+
+    qint64 start = av_gettime_relative();
+    bool isOpened = decoder.requestOpen(url, "video").get();
+    qint64 openTime = av_gettime_relative() - start;
+
+    bool isOpenOk = !isOpened && openTime >= IO_OPEN_TIMEOUT && openTime < IO_OPEN_TIMEOUT + BENCH_OPEN_SLACK;
+    out << "open: " << (isOpened ? "opened" : "failed") << " after " << openTime / 1000.0 << " ms, "
+        << (isOpenOk ? "ok" : "FAIL") << "\n";
+    out.flush();
+    failures += isOpenOk ? 0 : 1;
+
+    decoder.requestStop().wait();
+
+    /* second open left blocked in I/O, then stopped */
+    std::future<bool> opened = decoder.requestOpen(url, "video");
+    QThread::msleep(BENCH_STOP_DELAY);
+
+    start = av_gettime_relative();
+    decoder.requestStop().wait();
+    qint64 stopTime = av_gettime_relative() - start;
+
+    bool isStopOk = (opened.wait_for(std::chrono::seconds(0)) == std::future_status::ready) && !opened.get()
+            && stopTime < BENCH_STOP_LIMIT;
+    out << "stop: returned after " << stopTime / 1000.0 << " ms, " << (isStopOk ? "ok" : "FAIL") << "\n";
+    out.flush();
+    failures += isStopOk ? 0 : 1;
+
+    return failures == 0 ? 0 : 1;
+}
+
+/* open request to first frame, switching between files of same format (decoders
+ * & audio device reused) and of different format (opened again), video files only
+ */
+int Bench::switchBench(QString first, QString second)
+{
+    /* a again is a same format switch, a to b & back other format ones */
+    QString files[] = {first, first, second, second, first};
+    int count = sizeof(files) / sizeof(files[0]);
+    qint64 sameTime = 0;
+    qint64 otherTime = 0;
+    int sameCount = 0;
+    int otherCount = 0;
+    qint64 latency = 0;
+
+    Decoder decoder;
+
+    out << "a: " << first << "\n"
+        << "b: " << second << "\n";
+
+    for (int round = 0; round < BENCH_SWITCH_ROUNDS; round++) {
+        for (int i = 0; i < count; i++) {
+            if (!decoder.requestOpen(files[i], "video").get()) {
+                out << files[i] << ": open failed\n";
+                decoder.requestStop().wait();
+                return -1;
+            }
+
+            /* latency is set by video thread at first frame */
+            qint64 start = av_gettime_relative();
+            while (decoder.getSwitchLatency() == latency
+                   && av_gettime_relative() - start < BENCH_SWITCH_TIMEOUT * 1000LL) {
+                QThread::msleep(1);
+            }
+
+            if (decoder.getSwitchLatency() == latency) {
+                out << files[i] << ": no frame shown\n";
+                decoder.requestStop().wait();
+                return -1;
+            }
+            latency = decoder.getSwitchLatency();
+
+            /* first open of a round follows last file of previous round */
+            if (round > 0 || i > 0) {
+                QString from = (i > 0) ? files[i - 1] : files[count - 1];
+                bool isSame = (from == files[i]);
+
+                out << (from == first ? "a" : "b") << " -> " << (files[i] == first ? "a" : "b") << ": "
+                    << latency / 1000.0 << " ms\n";
+                out.flush();
+
+                if (isSame) {
+                    sameTime += latency;
+                    sameCount++;
+                } else {
+                    otherTime += latency;
+                    otherCount++;
+                }
+            }
+
+            QThread::msleep(BENCH_SWITCH_PLAY);
+        }
+    }
+
+    decoder.requestStop().wait();
+
+    out << "same format: " << (sameCount > 0 ? sameTime / 1000.0 / sameCount : 0) << " ms avg of " << sameCount << "\n"
+        << "other format: " << (otherCount > 0 ? otherTime / 1000.0 / otherCount : 0) << " ms avg of " << otherCount << "\n";
+
+    return 0;
+}
+
+/* play file while painting newest frame at window size, as main window does,
+ * then peak resident memory, memory bandwidth needs an outside counter
+ */
+int Bench::memoryBench(QString file, int seconds)
+{
+    Decoder decoder;
+    BenchSink sink;
+    FrameConverter converter;
+    AVFrame *paintFrame = av_frame_alloc();
+    QImage image;
+    QSize windowSize(1280, 720);
+    int painted = 0;
+
+    decoder.setFrameSink(&sink);
+
+    if (!decoder.requestOpen(file, "video").get()) {
+        out << file << ": open failed\n";
+        av_frame_free(&paintFrame);
+        return -1;
+    }
+
+    qint64 start = av_gettime_relative();
+    while (av_gettime_relative() - start < seconds * 1000000LL) {
+        if (sink.takeFrame(paintFrame)) {
+            converter.convert(paintFrame, windowSize, &image);
+            painted++;
+        }
+        QThread::msleep(BENCH_PAINT_INTERVAL);
+    }
+
+    decoder.requestStop().wait();
+
+    out << "file: " << file << "\n"
+        << "frames: " << sink.getFrames() << " decoded, " << painted << " painted at "
+        << windowSize.width() << "x" << windowSize.height() << " in " << seconds << " s\n";
+
+    /* what one frame in flight takes now against full size rgb32 */
+    if (painted > 0) {
+        out << "frame: " << paintFrame->width << "x" << paintFrame->height << " "
+            << av_get_pix_fmt_name(static_cast<AVPixelFormat>(paintFrame->format)) << "\n";
+
+        int frameSize = av_image_get_buffer_size(static_cast<AVPixelFormat>(paintFrame->format),
+                                                 paintFrame->width, paintFrame->height, 1);
+        int rgbSize = av_image_get_buffer_size(AV_PIX_FMT_RGB32, paintFrame->width, paintFrame->height, 1);
+        out << "frame in flight: " << frameSize / 1048576.0 << " MB, full size rgb32 "
+            << rgbSize / 1048576.0 << " MB\n";
+    }
+
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        /* kilobytes on Linux */
+        out << "peak rss: " << usage.ru_maxrss / 1024.0 << " MB\n";
+    }
+#else
+    out << "peak rss: not supported on this system\n";
+#endif
+
+    out << "note: memory bandwidth by perf stat -e LLC-load-misses,LLC-store-misses around this run\n";
+
+    av_frame_free(&paintFrame);
+
+    return 0;
+}
+
+/* content of range benchmark file, differs in every MB */
+static char rangeByte(qint64 pos)
+{
+    return static_cast<char>((static_cast<quint32>(pos) * 2654435761u) >> 24);
+}
+
+/* read len bytes at pos through io, true if they are the served content */
+static bool readRange(AVIOContext *ctx, qint64 pos, int len)
+{
+    QByteArray data(len, 0);
+    int done = 0;
+
+    if (avio_seek(ctx, pos, SEEK_SET) != pos) {
+        return false;
+    }
+
+    while (done < len) {
+        int ret = avio_read(ctx, reinterpret_cast<unsigned char *>(data.data()) + done, len - done);
+        if (ret <= 0) {
+            return false;
+        }
+        done += ret;
+    }
+
+    for (int i = 0; i < len; i++) {
+        if (data[i] != rangeByte(pos + i)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* local http server answering range requests, replies starting in an even MB
+ * delayed so chunks arrive out of order, then sequential read, seek into range
+ * not fetched yet, seek back into cached range & read to end checked byte by byte
+ */
+int Bench::rangeBench()
+{
+    QThread serverThread;
+    QTcpServer *server = NULL;
+    std::promise<quint16> listening;
+    std::atomic<int> requests(0);
+    std::atomic<int> outOfOrder(0);
+    std::atomic<qint64> lastSent(-1);
+    int failures = 0;
+
+    /* started is emitted on server thread, server & sockets live there */
+    QObject::connect(&serverThread, &QThread::started, [&]() {
+        server = new QTcpServer;
+        QObject::connect(server, &QTcpServer::newConnection, [&]() {
+            QTcpSocket *socket = server->nextPendingConnection();
+            std::shared_ptr<QByteArray> request = std::make_shared<QByteArray>();
+
+            QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            QObject::connect(socket, &QTcpSocket::readyRead, socket, [&, socket, request]() {
+                request->append(socket->readAll());
+                if (!request->contains("\r\n\r\n")) {
+                    return;
+                }
+
+                QRegularExpressionMatch match = QRegularExpression("Range: bytes=(\\d+)-(\\d*)",
+                        QRegularExpression::CaseInsensitiveOption).match(QString::fromLatin1(*request));
+                request->clear();
+                requests++;
+
+                if (!match.hasMatch()) {
+                    socket->write("HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+                    socket->disconnectFromHost();
+                    return;
+                }
+
+                qint64 start = match.captured(1).toLongLong();
+                qint64 end = match.captured(2).isEmpty() ? BENCH_RANGE_SIZE - 1 : match.captured(2).toLongLong();
+                end = qMin(end, static_cast<qint64>(BENCH_RANGE_SIZE - 1));
+
+                int delay = ((start / 1048576) % 2 == 0) ? BENCH_RANGE_DELAY : 0;
+                QTimer::singleShot(delay, socket, [&, socket, start, end]() {
+                    QByteArray body(static_cast<int>(end - start + 1), 0);
+                    for (int i = 0; i < body.size(); i++) {
+                        body[i] = rangeByte(start + i);
+                    }
+
+                    socket->write(QString("HTTP/1.1 206 Partial Content\r\n"
+                                          "Content-Range: bytes %1-%2/%3\r\n"
+                                          "Content-Length: %4\r\n"
+                                          "ETag: \"bench\"\r\n"
+                                          "Connection: close\r\n\r\n")
+                                  .arg(start).arg(end).arg(BENCH_RANGE_SIZE).arg(body.size()).toLatin1());
+                    socket->write(body);
+                    socket->disconnectFromHost();
+
+                    if (start < lastSent) {
+                        outOfOrder++;
+                    }
+                    lastSent = start;
+                });
+            });
+        });
+
+        listening.set_value(server->listen(QHostAddress::LocalHost) ? server->serverPort() : 0);
+    });
+    QObject::connect(&serverThread, &QThread::finished, [&]() {
+        delete server;
+    });
+
+    serverThread.start();
+    quint16 port = listening.get_future().get();
+    if (port == 0) {
+        out << "listen failed\n";
+        serverThread.quit();
+        serverThread.wait();
+        return -1;
+    }
+
+    QString url = QString("http://127.0.0.1:%1/bench.bin").arg(port);
+    out << "url: " << url << ", " << BENCH_RANGE_SIZE << " bytes\n";
+
+    MediaIO *io = MediaIO::create(MediaIO::BACKEND_HTTP, url, NULL);
+    if (!io) {
+        out << "open: FAIL\n";
+        failures++;
+    } else {
+        AVIOContext *ctx = io->context();
+
+        struct Check
+        {
+            const char *name;
+            qint64 pos;
+            int len;
+        };
+
+        /* across chunk ends, last one up to end of file */
+        Check checks[] = {
+            {"sequential read", 0, 3 * 1048576 + 100},
+            {"seek into range not fetched", 32 * 1048576 - 50, 1048576},
+            {"seek back into cached range", 1048576 / 2, 1048576},
+            {"read to end", 39 * 1048576, BENCH_RANGE_SIZE - 39 * 1048576}
+        };
+
+        bool isSizeOk = (avio_size(ctx) == BENCH_RANGE_SIZE);
+        out << "size: " << avio_size(ctx) << ", " << (isSizeOk ? "ok" : "FAIL") << "\n";
+        failures += isSizeOk ? 0 : 1;
+
+        for (const Check &check : checks) {
+            bool isOk = readRange(ctx, check.pos, check.len);
+            out << check.name << " at " << check.pos << ": " << (isOk ? "ok" : "FAIL") << "\n";
+            out.flush();
+            failures += isOk ? 0 : 1;
+        }
+
+        MediaIO::Stats stats = io->getStats();
+        bool isCacheOk = (stats.seeksInBuffer > 0);
+        out << "seeks: " << stats.seeks << ", " << stats.seeksInBuffer << " into cached range, "
+            << (isCacheOk ? "ok" : "FAIL") << "\n";
+        failures += isCacheOk ? 0 : 1;
+
+        delete io;
+    }
+
+    bool isOrderOk = (outOfOrder > 0);
+    out << "requests: " << requests << ", " << outOfOrder << " answered out of order, "
+        << (isOrderOk ? "ok" : "FAIL") << "\n";
+    failures += isOrderOk ? 0 : 1;
+
+    serverThread.quit();
+    serverThread.wait();
+
+    /* port changes every run, cached copy is no use later */
+    QString cachePath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/http/"
+            + QCryptographicHash::hash(url.toUtf8(), QCryptographicHash::Sha1).toHex() + ".part";
+    QFile::remove(cachePath);
+    QFile::remove(cachePath + ".map");
+
+    return failures == 0 ? 0 : 1;
+}
+
+/* media time sent at speed times realtime by live feed, in order */
+struct LivePhase
+{
+    const char *name;
+    double seconds;
+    double speed;
+};
+
+static const LivePhase livePhases[] = {
+    {"realtime", 4, 1},     // open & prebuffer
+    {"burst", 3, 10},       // far behind at once, buffered data dropped
+    {"realtime", 12, 1}     // latency back near target
+};
+
+struct LiveFeed
+{
+    QString file;
+    QString url;
+    std::atomic<int> phase;     // index into livePhases, past end once finished
+    std::atomic<bool> isQuit;
+};
+
+/* remux file to mpegts over udp, paced by livePhases */
+int Bench::liveFeedThread(void *arg)
+{
+    LiveFeed *feed = (LiveFeed *)arg;
+    AVFormatContext *inCtx = NULL;
+    AVFormatContext *outCtx = NULL;
+    AVPacket packet;
+    int phaseCount = sizeof(livePhases) / sizeof(livePhases[0]);
+
+    if (avformat_open_input(&inCtx, feed->file.toLocal8Bit().data(), NULL, NULL) != 0
+            || avformat_find_stream_info(inCtx, NULL) < 0) {
+        out << "feed: open " << feed->file << " failed\n";
+        avformat_close_input(&inCtx);
+        feed->phase = phaseCount;
+        return -1;
+    }
+
+    avformat_alloc_output_context2(&outCtx, NULL, "mpegts", feed->url.toLocal8Bit().data());
+    for (unsigned int i = 0; outCtx && i < inCtx->nb_streams; i++) {
+        AVStream *stream = avformat_new_stream(outCtx, NULL);
+        avcodec_parameters_copy(stream->codecpar, inCtx->streams[i]->codecpar);
+        stream->codecpar->codec_tag = 0;
+    }
+
+    if (!outCtx || avio_open2(&outCtx->pb, feed->url.toLocal8Bit().data(), AVIO_FLAG_WRITE, NULL, NULL) < 0
+            || avformat_write_header(outCtx, NULL) < 0) {
+        out << "feed: output " << feed->url << " failed\n";
+        if (outCtx) {
+            avio_closep(&outCtx->pb);
+            avformat_free_context(outCtx);
+        }
+        avformat_close_input(&inCtx);
+        feed->phase = phaseCount;
+        return -1;
+    }
+
+    double startPts = -1;
+    double phaseMedia = 0;                      // media time phase starts at
+    qint64 phaseWall = av_gettime_relative();   // wall time phase starts at
+
+    feed->phase = 0;
+
+    while (!feed->isQuit && feed->phase < phaseCount && av_read_frame(inCtx, &packet) >= 0) {
+        AVStream *inStream = inCtx->streams[packet.stream_index];
+        int64_t ts = (packet.dts != AV_NOPTS_VALUE) ? packet.dts : packet.pts;
+
+        if (ts != AV_NOPTS_VALUE) {
+            double pts = ts * av_q2d(inStream->time_base);
+            if (startPts < 0) {
+                startPts = pts;
+            }
+            double media = pts - startPts;
+
+            /* on to next phase, its pace starts where last one ended */
+            while (feed->phase < phaseCount && media >= phaseMedia + livePhases[feed->phase].seconds) {
+                phaseWall += static_cast<qint64>(livePhases[feed->phase].seconds / livePhases[feed->phase].speed * 1000000);
+                phaseMedia += livePhases[feed->phase].seconds;
+                feed->phase++;
+            }
+
+            if (feed->phase < phaseCount) {
+                qint64 due = phaseWall + static_cast<qint64>((media - phaseMedia) / livePhases[feed->phase].speed * 1000000);
+                qint64 now = av_gettime_relative();
+                if (due > now) {
+                    av_usleep(static_cast<unsigned int>(due - now));
+                }
+            }
+        }
+
+        av_packet_rescale_ts(&packet, inStream->time_base, outCtx->streams[packet.stream_index]->time_base);
+        av_interleaved_write_frame(outCtx, &packet);
+        av_packet_unref(&packet);
+    }
+
+    /* file shorter than phases */
+    feed->phase = phaseCount;
+
+    av_write_trailer(outCtx);
+    avio_closep(&outCtx->pb);
+    avformat_free_context(outCtx);
+    avformat_close_input(&inCtx);
+
+    return 0;
+}
+
+/* local udp stream sent faster than realtime, buffered data must be dropped
+ * & latency settle near target again, 0 if both hold, needs audio device
+ */
+int Bench::liveBench(QString file)
+{
+    int phaseCount = sizeof(livePhases) / sizeof(livePhases[0]);
+    int failures = 0;
+
+    /* free port, taken by decoder right after */
+    QUdpSocket probe;
+    if (!probe.bind(QHostAddress::LocalHost, 0)) {
+        out << "udp bind failed\n";
+        return -1;
+    }
+    quint16 port = probe.localPort();
+    probe.close();
+
+    LiveFeed feed;
+    feed.file = file;
+    feed.url = QString("udp://127.0.0.1:%1?pkt_size=1316").arg(port);
+    feed.phase = -1;
+    feed.isQuit = false;
+
+    Decoder decoder;
+    SDL_Thread *feedTid = SDL_CreateThread(&Bench::liveFeedThread, "live_feed_thread", &feed);
+
+    if (!decoder.requestOpen(QString("udp://127.0.0.1:%1").arg(port), "video").get()) {
+        out << "open live stream failed\n";
+        feed.isQuit = true;
+        SDL_WaitThread(feedTid, NULL);
+        return -1;
+    }
+
+    QVector<int> maxLatency(phaseCount, 0);
+    QList<int> settled;
+    int dropsBefore = decoder.getLiveDrops();
+    int lastPhase = -1;
+
+    while (feed.phase < phaseCount) {
+        int phase = feed.phase;
+        int latency = decoder.getLiveLatency();
+
+        if (phase >= 0) {
+            maxLatency[phase] = qMax(maxLatency[phase], latency);
+
+            if (phase != lastPhase) {
+                out << "phase " << livePhases[phase].name << " at " << livePhases[phase].speed << "x, latency "
+                    << latency << " ms, drops " << decoder.getLiveDrops() << "\n";
+                out.flush();
+                lastPhase = phase;
+            }
+
+            /* last phase, newest samples */
+            if (phase == phaseCount - 1) {
+                settled.append(latency);
+                if (settled.size() > BENCH_LIVE_SETTLED / BENCH_LIVE_SAMPLE) {
+                    settled.removeFirst();
+                }
+            }
+        }
+
+        QThread::msleep(BENCH_LIVE_SAMPLE);
+    }
+
+    int drops = decoder.getLiveDrops() - dropsBefore;
+    decoder.requestStop().wait();
+    SDL_WaitThread(feedTid, NULL);
+
+    for (int i = 0; i < phaseCount; i++) {
+        out << livePhases[i].name << " " << livePhases[i].speed << "x: max latency " << maxLatency[i] << " ms\n";
+    }
+
+    bool isDropOk = (drops > 0);
+    out << "drops: " << drops << ", " << (isDropOk ? "ok" : "FAIL") << "\n";
+    failures += isDropOk ? 0 : 1;
+
+    int sum = 0;
+    foreach (int latency, settled) {
+        sum += latency;
+    }
+    int average = settled.isEmpty() ? 0 : sum / settled.size();
+    bool isSettledOk = !settled.isEmpty() && average > 0 && average < BENCH_LIVE_MAX_LATENCY;
+    out << "settled latency: " << average << " ms over last " << settled.size() * BENCH_LIVE_SAMPLE << " ms, "
+        << (isSettledOk ? "ok" : "FAIL") << "\n";
+    failures += isSettledOk ? 0 : 1;
+
+    return failures == 0 ? 0 : 1;
+}
+
+/* known YUV420P frame drawn by OpenGL into offscreen framebuffer, compared
+ * with FrameConverter at frame size & half of it, 0 if both are close
+ */
+int Bench::glBench()
+{
+    QOpenGLContext context;
+    if (!context.create()) {
+        out << "OpenGL context create failed\n";
+        return -1;
+    }
+
+    QOffscreenSurface surface;
+    surface.setFormat(context.format());
+    surface.create();
+    if (!context.makeCurrent(&surface)) {
+        out << "OpenGL make current failed\n";
+        return -1;
+    }
+
+    /* width not a multiple of alignment, so textures carry padding to crop */
+    AVFrame *frame = av_frame_alloc();
+    frame->width       = 200;
+    frame->height      = 120;
+    frame->format      = AV_PIX_FMT_YUV420P;
+    frame->colorspace  = AVCOL_SPC_BT709;
+    frame->color_range = AVCOL_RANGE_MPEG;
+    av_frame_get_buffer(frame, 64);
+
+    /* smooth ramps, sampling differences stay small */
+    for (int y = 0; y < frame->height; y++) {
+        for (int x = 0; x < frame->width; x++) {
+            frame->data[0][y * frame->linesize[0] + x] = 16 + (x + y) * 219 / (frame->width + frame->height);
+        }
+    }
+    for (int y = 0; y < (frame->height + 1) / 2; y++) {
+        for (int x = 0; x < (frame->width + 1) / 2; x++) {
+            frame->data[1][y * frame->linesize[1] + x] = 16 + x * 224 / ((frame->width + 1) / 2);
+            frame->data[2][y * frame->linesize[2] + x] = 240 - y * 224 / ((frame->height + 1) / 2);
+        }
+    }
+
+    out << "OpenGL: " << reinterpret_cast<const char *>(context.functions()->glGetString(GL_RENDERER))
+        << ", frame " << frame->width << "x" << frame->height << " linesize " << frame->linesize[0] << "\n";
+
+    GLVideoRenderer renderer;
+    int failures = 0;
+
+    if (!renderer.init()) {
+        out << "shader: FAIL\n";
+        failures++;
+    } else {
+        QSize sizes[] = {QSize(frame->width, frame->height), QSize(frame->width / 2, frame->height / 2)};
+
+        renderer.setFrame(frame);
+
+        for (QSize size : sizes) {
+            QOpenGLFramebufferObject fbo(size);
+            fbo.bind();
+            renderer.render(size, false);
+            context.functions()->glFinish();
+            fbo.release();
+
+            /* toImage() turns bottom up framebuffer right way round */
+            QImage drawn = fbo.toImage();
+            QImage converted;
+            FrameConverter converter;
+            converter.convert(frame, size, &converted);
+
+            double sum = 0;
+            int maxDiff = 0;
+            for (int y = 0; y < size.height(); y++) {
+                for (int x = 0; x < size.width(); x++) {
+                    QRgb a = drawn.pixel(x, y);
+                    QRgb b = converted.pixel(x, y);
+                    int diffs[] = {qAbs(qRed(a) - qRed(b)), qAbs(qGreen(a) - qGreen(b)), qAbs(qBlue(a) - qBlue(b))};
+                    for (int diff : diffs) {
+                        sum += diff;
+                        maxDiff = qMax(maxDiff, diff);
+                    }
+                }
+            }
+            double mean = sum / (size.width() * size.height() * 3);
+
+            bool isOk = (drawn.size() == converted.size()) && mean <= BENCH_GL_MEAN_DIFF && maxDiff <= BENCH_GL_MAX_DIFF;
+            out << size.width() << "x" << size.height() << ": mean diff " << mean << ", max diff " << maxDiff << ", "
+                << (isOk ? "ok" : "FAIL") << "\n";
+            out.flush();
+            failures += isOk ? 0 : 1;
+        }
+
+        renderer.release();
+    }
+
+    context.doneCurrent();
+    av_frame_free(&frame);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,30 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <QStringList>
+
+extern "C"
+{
+#include "libavutil/frame.h"
+}
+
+/* Command line benchmarks, run by "QtPlayer --bench <name> ..." without gui. */
+class Bench
+{
+public:
+    static int run(QStringList args);
+
+private:
+    static int ioBench(QString file, QStringList backends);
+    static int convertBench(QStringList sizes);
+    static void threadsBench(const AVFrame *frame, QString name);
+    static int timeoutBench();
+    static int switchBench(QString first, QString second);
+    static int memoryBench(QString file, int seconds);
+    static int rangeBench();
+    static int liveBench(QString file);
+    static int glBench();
+    static int liveFeedThread(void *arg);
+};
+
+#endif // BENCH_H
@@ -1,32 +1,179 @@
 #include <QDebug>
+#include <QFileInfo>
+#include <QStringList>
+
+#include <algorithm>
+
+extern "C"
+{
+#include "libavutil/time.h"
+}
 
 #include "decoder.h"
+#include "memoryio.h"
+#include "threadpolicy.h"
+
+/* Default read-ahead window, in bytes. */
+#define READAHEAD_DEFAULT_SIZE (64 * 1024 * 1024)
+/* Default size limit of files played from memory, in bytes. */
+#define MEMORY_DEFAULT_THRESHOLD (32 * 1024 * 1024)
+/* Default caps of timeshift buffer, in bytes. */
+#define TIMESHIFT_DEFAULT_MEMORY (64 * 1024 * 1024)
+#define TIMESHIFT_DEFAULT_DISK (256 * 1024 * 1024)
+/* Recorded packets sent to decoders ahead of playing clock, in seconds. */
+#define TIMESHIFT_FEED_AHEAD 1.0
+/* Interval to feed recorded packets after live source ended, in ms. */
+#define TIMESHIFT_FEED_INTERVAL 100
 
 Decoder::Decoder() :
     timeTotal(0),
-    playState(STOP),
+    threadState(STATE_IDLE),
     isStop(false),
     isPause(false),
     isSeek(false),
     isReadFinished(false),
+    isDecodeFinished(false),
+    isNextRequest(false),
+    pauseWanted(false),
+    seekMode(SEEK_ACCURATE),
+    seekSerial(0),
+    videoSeekTarget(0),
+    videoSeekSerial(0),
+    seekStartTime(0),
+    seekLatency(0),
+    scrubStartTime(0),
+    seekRequests(0),
+    seeksExecuted(0),
+    containerIndexLoaded(false),
+    isInfoValid(false),
+    isInfoCached(false),
+    openStartTime(0),
+    inputInterrupt(NULL),
+    preloader(new MediaPreloader),
+    pCodecCtx(NULL),
+    isSwitching(false),
+    switchStartTime(0),
+    switchLatency(0),
+    isVideoReused(false),
+    preparedFrame(NULL),
+    videoTid(NULL),
+    isGapless(true),
+    isTrackChanging(false),
+    nextTrackDuration(0),
+    isLive(false),
+    waitKeyframe(false),
+    liveDrops(0),
+    timeshiftMemory(TIMESHIFT_DEFAULT_MEMORY),
+    timeshiftDisk(TIMESHIFT_DEFAULT_DISK),
+    isTimeshift(false),
+    isShifted(false),
+    playCursor(0),
+    feedStartTime(0),
+    mediaIO(NULL),
+    ioBackend(MediaIO::BACKEND_READAHEAD),
+    readAheadSize(READAHEAD_DEFAULT_SIZE),
+    memoryThreshold(MEMORY_DEFAULT_THRESHOLD),
+    inputMemory(0),
+    ioDeadline(0),
+    isIoTimeout(false),
+    frameSink(NULL),
     audioDecoder(new AudioDecoder),
     filterGraph(NULL)
 {
     av_init_packet(&seekPacket);
     seekPacket.data = (uint8_t *)"FLUSH";
 
+    av_init_packet(&nextTrackPacket);
+    nextTrackPacket.data = (uint8_t *)"NEXT";
+
+    seekMutex  = SDL_CreateMutex();
+    stateMutex = SDL_CreateMutex();
+    stateCond  = SDL_CreateCond();
+
     connect(audioDecoder, SIGNAL(playFinished()), this, SLOT(audioFinished()));
-    connect(this, SIGNAL(readFinished()), audioDecoder, SLOT(readFileFinished()));
+    /* direct connection, latency is measured on the audio thread */
+    connect(audioDecoder, SIGNAL(seekFinished(int)), this, SLOT(audioSeekFinished(int)), Qt::DirectConnection);
+    connect(audioDecoder, SIGNAL(trackChanged()), this, SLOT(audioTrackChanged()));
 }
 
+/* stops threads itself, owner may drop it right after requestStop() */
 Decoder::~Decoder()
 {
+    requestStop().wait();
+    wait();
+    releasePipeline();
+
+    delete audioDecoder;
+    delete preloader;
+    SDL_DestroyMutex(seekMutex);
+    SDL_DestroyCond(stateCond);
+    SDL_DestroyMutex(stateMutex);
+}
+
+/* wake threads blocked on pause, data or request, they check state again */
+void Decoder::wakeUp()
+{
+    SDL_LockMutex(stateMutex);
+    SDL_CondBroadcast(stateCond);
+    SDL_UnlockMutex(stateMutex);
 
+    videoQueue.wakeUp();
 }
 
-void Decoder::displayVideo(QImage image)
+/* video thread paused, sleep until resumed or stopped */
+void Decoder::waitWhilePaused()
 {
-    emit gotVideo(image);
+    SDL_LockMutex(stateMutex);
+    while (isPause && !isStop) {
+        SDL_CondWait(stateCond, stateMutex);
+    }
+    SDL_UnlockMutex(stateMutex);
+}
+
+/* reading thread paused, sleep until a command or stop comes */
+void Decoder::waitCommand()
+{
+    SDL_LockMutex(stateMutex);
+    while (!isStop && commands.isEmpty()) {
+        SDL_CondWait(stateCond, stateMutex);
+    }
+    SDL_UnlockMutex(stateMutex);
+}
+
+/* reading finished, sleep until command, seek, stop or next track request */
+void Decoder::waitForRequest()
+{
+    SDL_LockMutex(stateMutex);
+    while (!isStop && !isSeek && !isNextRequest && commands.isEmpty()) {
+        /* recorded live data left, fed by playing clock */
+        if (isTimeshift && playCursor < timeshift.endSeq()) {
+            SDL_CondWaitTimeout(stateCond, stateMutex, TIMESHIFT_FEED_INTERVAL);
+            break;
+        }
+        SDL_CondWait(stateCond, stateMutex);
+    }
+    isNextRequest = false;
+    SDL_UnlockMutex(stateMutex);
+}
+
+/* frame handed over as it is, sink converts it at the size it shows it */
+void Decoder::displayVideo(AVFrame *frame)
+{
+    if (frameSink) {
+        frameSink->frameReady(frame, videoClk);
+    }
+}
+
+/* set while stopped, frames dropped while NULL */
+void Decoder::setFrameSink(FrameSink *sink)
+{
+    frameSink = sink;
+}
+
+/* set while stopped, NULL for SDL audio device */
+void Decoder::setAudioSink(AudioSink *sink)
+{
+    audioDecoder->setAudioSink(sink);
 }
 
 void Decoder::clearData()
@@ -42,19 +189,40 @@ void Decoder::clearData()
     isSeek  = false;
     isReadFinished      = false;
     isDecodeFinished    = false;
+    isNextRequest       = false;
 
     videoQueue.empty();
 
     audioDecoder->emptyAudioData();
 
     videoClk = 0;
+
+    videoSeekTarget = 0;
+    seekStartTime = 0;
+    scrubStartTime = 0;
+    keyframeIndex.clear();
+    containerIndexLoaded = false;
+
+    isInfoValid = false;
+    isInfoCached = false;
+
+    isTrackChanging = false;
+
+    waitKeyframe = false;
+    liveDrops = 0;
+
+    isShifted = false;
+    playCursor = 0;
+    feedStartTime = 0;
+
+    ioDeadline = 0;
+    isIoTimeout = false;
 }
 
 void Decoder::setPlayState(Decoder::PlayState state)
 {
 //    qDebug() << "Set state: " << state;
     emit playStateChanged(state);
-    playState = state;
 }
 
 bool Decoder::isRealtime(AVFormatContext *pFormatCtx)
@@ -74,23 +242,395 @@ bool Decoder::isRealtime(AVFormatContext *pFormatCtx)
     return false;
 }
 
-int Decoder::initFilter()
+/* abort blocking I/O of demuxer on stop or switch request, or while deadline passed */
+int Decoder::interruptCallback(void *arg)
+{
+    Decoder *decoder = (Decoder *)arg;
+
+    if (decoder->isStop) {
+        return 1;
+    }
+
+    if (decoder->ioDeadline > 0 && av_gettime_relative() > decoder->ioDeadline) {
+        decoder->isIoTimeout = true;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* set deadline of next blocking I/O, 0 to clear & keep timeout state for checking */
+void Decoder::setIoDeadline(qint64 timeout)
+{
+    if (timeout > 0) {
+        isIoTimeout = false;
+        ioDeadline = av_gettime_relative() + timeout;
+    } else {
+        ioDeadline = 0;
+    }
+}
+
+/* demuxer reads through selected backend, small local file from memory,
+ * libavformat own I/O used if it fails
+ */
+void Decoder::openMediaIO()
+{
+    QFileInfo info(currentFile);
+
+    /* only one file kept in memory, file rewritten in place may keep its size */
+    if (currentFile != memoryFile || memoryData.size() != info.size() || memoryModified != info.lastModified()) {
+        memoryFile.clear();
+        memoryData.clear();
+    }
+
+    if (memoryThreshold > 0 && info.isFile() && info.size() <= memoryThreshold) {
+        /* taken before loading, a change while loading is seen next time */
+        memoryModified = info.lastModified();
+        mediaIO = new MemoryIO(memoryData);
+        if (mediaIO->open(currentFile, &pFormatCtx->interrupt_callback) < 0 || !mediaIO->context()) {
+            delete mediaIO;
+            mediaIO = NULL;
+        }
+    }
+
+    /* progressive http file, fetched by range requests */
+    if (!mediaIO && (currentFile.startsWith("http://") || currentFile.startsWith("https://"))) {
+        mediaIO = MediaIO::create(MediaIO::BACKEND_HTTP, currentFile, &pFormatCtx->interrupt_callback, readAheadSize);
+    }
+
+    if (!mediaIO) {
+        mediaIO = MediaIO::create(ioBackend, currentFile, &pFormatCtx->interrupt_callback, readAheadSize);
+    }
+
+    if (mediaIO) {
+        pFormatCtx->pb = mediaIO->context();
+        inputMemory = mediaIO->getStats().memory;
+        qDebug() << mediaIO->name() << "input, memory used:" << inputMemory / 1048576.0 << "MB";
+    }
+}
+
+/* close opened input, forwarding interrupt of preloaded one & custom I/O with it */
+void Decoder::closeInput()
+{
+    avformat_close_input(&pFormatCtx);
+
+    delete inputInterrupt;
+    inputInterrupt = NULL;
+
+    closeMediaIO();
+}
+
+/* custom input is not closed by avformat_close_input() */
+void Decoder::closeMediaIO()
+{
+    if (!mediaIO) {
+        return;
+    }
+
+    mediaIO->printStats();
+
+    /* keep loaded file, replaying it needs no I/O */
+    MemoryIO *memoryIO = dynamic_cast<MemoryIO *>(mediaIO);
+    if (memoryIO) {
+        memoryData = memoryIO->loadedData();
+        memoryFile = memoryData.isEmpty() ? QString() : currentFile;
+    }
+
+    delete mediaIO;
+    mediaIO = NULL;
+    inputMemory = 0;
+}
+
+void Decoder::setReadAheadSize(qint64 size)
+{
+    readAheadSize = size;
+}
+
+void Decoder::setIOBackend(MediaIO::Backend backend)
+{
+    ioBackend = backend;
+}
+
+void Decoder::setMemoryThreshold(qint64 size)
+{
+    memoryThreshold = size;
+}
+
+/* memory held by input buffers of current file, in bytes */
+qint64 Decoder::getInputMemory()
+{
+    return inputMemory;
+}
+
+/* network stream played as it comes, decided before opening to set low delay options */
+bool Decoder::isLiveUrl(QString file)
+{
+    QStringList schemes;
+    schemes << "rtsp:" << "rtp:" << "udp:" << "rtmp:" << "srt:";
+
+    foreach (QString scheme, schemes) {
+        if (file.startsWith(scheme, Qt::CaseInsensitive)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* open live stream without demuxer buffering, probe as little as possible */
+int Decoder::openLiveInput()
 {
     int ret;
+    AVDictionary *options = NULL;
+
+    av_dict_set(&options, "fflags", "nobuffer", 0);
+    av_dict_set(&options, "probesize", "32768", 0);
+    av_dict_set(&options, "analyzeduration", "500000", 0);
+    /* rtp reordering delay, in microseconds */
+    av_dict_set(&options, "max_delay", "100000", 0);
+
+    ret = avformat_open_input(&pFormatCtx, currentFile.toLocal8Bit().data(), NULL, &options);
+    av_dict_free(&options);
+    if (ret != 0) {
+        qDebug() << "Open live stream failed.";
+        return ret;
+    }
 
-    AVFilterInOut *out = avfilter_inout_alloc();
-    AVFilterInOut *in = avfilter_inout_alloc();
-    /* output format */
-    enum AVPixelFormat pixFmts[] = {AV_PIX_FMT_RGB32, AV_PIX_FMT_NONE};
+    if ((ret = avformat_find_stream_info(pFormatCtx, NULL)) < 0) {
+        qDebug() << "Could't find stream infomation.";
+        avformat_close_input(&pFormatCtx);
+        return ret;
+    }
 
-    /* free last graph */
-    if (filterGraph) {
-        avfilter_graph_free(&filterGraph);
+    MediaInfoCache::fromFormat(pFormatCtx, &mediaInfo);
+    isInfoCached = false;
+
+    return 0;
+}
+
+/* feed arrival of live packets to jitter buffer, catch up while playing too far behind */
+void Decoder::updateLiveLatency(AVPacket *packet)
+{
+    int clockIndex = (audioIndex >= 0) ? audioIndex : videoIndex;
+
+    if (packet->stream_index != clockIndex || packet->pts == AV_NOPTS_VALUE) {
+        return;
     }
 
-    filterGraph = avfilter_graph_alloc();
+    double pts = packet->pts * av_q2d(pFormatCtx->streams[clockIndex]->time_base);
+    jitterBuffer.packetArrived(pts, av_gettime_relative());
+
+    /* audio ran dry, build up target latency again before going on */
+    if (audioIndex >= 0 && audioDecoder->takeUnderrun()) {
+        jitterBuffer.hold();
+    }
 
-    /* just add filter ouptut format rgb32,
+    double clock = (audioIndex >= 0) ? audioDecoder->getAudioClock() : videoClk;
+    JitterBuffer::Action action = jitterBuffer.update(clock);
+
+    /* user wants to stay behind live edge */
+    if (isShifted) {
+        action = JitterBuffer::KEEP;
+    }
+
+    /* only audio clock can be held, video only stream plays on */
+    audioDecoder->setHold(action == JitterBuffer::HOLD && audioIndex >= 0);
+
+    switch (action) {
+    case JitterBuffer::DROP:
+        dropToLive();
+        break;
+    case JitterBuffer::SPEEDUP:
+        audioDecoder->setSpeedUp(true);
+        break;
+    default:
+        audioDecoder->setSpeedUp(false);
+        break;
+    }
+}
+
+/* drop all buffered data, go on playing from newest packets */
+void Decoder::dropToLive()
+{
+    liveDrops++;
+    qDebug() << "Live latency" << jitterBuffer.getLatency() << "ms, drop buffered data, drops:" << liveDrops.load();
+
+    if (isTimeshift) {
+        moveTimeshiftCursor(timeshift.lastKeyframe());
+        return;
+    }
+
+    flushDecoders();
+    jitterBuffer.hold();
+
+    if (currentType == "video") {
+        waitKeyframe = true;
+    }
+}
+
+/* empty queues & flush decoders, playing goes on from next packets sent */
+void Decoder::flushDecoders()
+{
+    audioDecoder->emptyAudioData();
+    audioDecoder->packetEnqueue(&seekPacket);
+
+    if (currentType == "video") {
+        videoQueue.empty();
+        videoSeekTarget = 0;
+        videoQueue.enqueue(&seekPacket);
+        videoClk = 0;
+    }
+}
+
+void Decoder::recordTimeshift(AVPacket *packet)
+{
+    double time = timeshift.newestTime();
+    bool isKey;
+
+    if (packet->pts != AV_NOPTS_VALUE) {
+        time = packet->pts * av_q2d(pFormatCtx->streams[packet->stream_index]->time_base);
+    }
+
+    /* playing may start from any audio packet, video needs keyframe */
+    if (currentType == "video") {
+        isKey = packet->stream_index == videoIndex && (packet->flags & AV_PKT_FLAG_KEY);
+    } else {
+        isKey = packet->stream_index == audioIndex;
+    }
+
+    timeshift.write(packet, time, isKey);
+}
+
+/* send recorded packets from play cursor to decoders, a little ahead of playing clock */
+void Decoder::feedTimeshift()
+{
+    AVPacket pkt;
+
+    /* paused too long, data under cursor overwritten */
+    if (playCursor < timeshift.firstSeq()) {
+        moveTimeshiftCursor(timeshift.findKeyframe(0));
+        if (playCursor < timeshift.firstSeq()) {
+            return;
+        }
+    }
+
+    double clock = (audioIndex >= 0) ? audioDecoder->getAudioClock() : videoClk;
+
+    while (!isPause && playCursor < timeshift.endSeq()) {
+        if (timeshift.packetTime(playCursor) > qMax(clock, feedStartTime) + TIMESHIFT_FEED_AHEAD) {
+            break;
+        }
+
+        if (currentType == "video" && videoQueue.queueSize() > 512) {
+            break;
+        }
+
+        if (!timeshift.read(playCursor, &pkt)) {
+            break;
+        }
+        playCursor++;
+
+        if (pkt.stream_index == videoIndex && currentType == "video") {
+            videoQueue.enqueue(&pkt);
+        } else if (pkt.stream_index == audioIndex) {
+            audioDecoder->packetEnqueue(&pkt);
+        } else {
+            av_packet_unref(&pkt);
+        }
+    }
+}
+
+void Decoder::moveTimeshiftCursor(qint64 seq)
+{
+    if (seq < 0) {
+        return;
+    }
+
+    flushDecoders();
+
+    playCursor = seq;
+    feedStartTime = timeshift.packetTime(seq);
+}
+
+/* move playing position inside timeshift buffer, past newest data means live edge */
+void Decoder::shiftTimeshift(double offset, bool toLive)
+{
+    double clock = (audioIndex >= 0) ? audioDecoder->getAudioClock() : videoClk;
+    double target = ((clock > 0) ? clock : feedStartTime) + offset;
+
+    if (toLive || target >= timeshift.newestTime()) {
+        qDebug() << "Timeshift back to live.";
+        isShifted = false;
+        moveTimeshiftCursor(timeshift.lastKeyframe());
+    } else {
+        qDebug() << "Timeshift to" << target << ", recorded" << timeshift.getDuration() << "s";
+        isShifted = true;
+        moveTimeshiftCursor(timeshift.findKeyframe(target));
+    }
+}
+
+void Decoder::setTimeshift(qint64 memoryCap, qint64 diskCap)
+{
+    timeshiftMemory = memoryCap;
+    timeshiftDisk   = diskCap;
+}
+
+/* seconds of live stream recorded */
+double Decoder::getTimeshiftDuration()
+{
+    return isTimeshift ? timeshift.getDuration() : 0;
+}
+
+/* rewind or forward live stream, offset from playing position in seconds */
+std::future<void> Decoder::shiftLive(double offset)
+{
+    Command command;
+    command.type = Command::SHIFT;
+    command.offset = offset;
+
+    return postCommand(command);
+}
+
+std::future<void> Decoder::seekToLive()
+{
+    Command command;
+    command.type = Command::SHIFT_LIVE;
+    command.offset = 0;
+
+    return postCommand(command);
+}
+
+bool Decoder::isLiveStream()
+{
+    return isLive;
+}
+
+/* data buffered between newest received packet & playing position, in ms */
+int Decoder::getLiveLatency()
+{
+    return isLive ? jitterBuffer.getLatency() : 0;
+}
+
+int Decoder::getLiveDrops()
+{
+    return liveDrops;
+}
+
+void Decoder::setLiveLatency(int ms)
+{
+    jitterBuffer.setTargetLatency(ms);
+}
+
+int Decoder::initFilter()
+{
+    int ret;
+
+    AVFilterInOut *out = avfilter_inout_alloc();
+    AVFilterInOut *in = avfilter_inout_alloc();
+    /* output format, kept planar yuv until display, 1.5 bytes per pixel */
+    enum AVPixelFormat pixFmts[] = {AV_PIX_FMT_YUV420P, AV_PIX_FMT_NONE};
+
+    /* just add filter ouptut format yuv420p,
      * use for function avfilter_graph_parse_ptr()
      */
     QString filter("pp=hb/vb/dr/al");
@@ -100,6 +640,22 @@ int Decoder::initFilter()
             .arg(videoStream->time_base.num).arg(videoStream->time_base.den)
             .arg(pCodecCtx->sample_aspect_ratio.num).arg(pCodecCtx->sample_aspect_ratio.den);
 
+    /* graph of last file has the same input, scaler in it is kept too */
+    if (filterGraph && args == filterArgs) {
+        avfilter_inout_free(&out);
+        avfilter_inout_free(&in);
+        qDebug() << "Reuse video filter.";
+        return 0;
+    }
+
+    /* free last graph */
+    if (filterGraph) {
+        avfilter_graph_free(&filterGraph);
+    }
+    filterArgs.clear();
+
+    filterGraph = avfilter_graph_alloc();
+
     /* create source filter */
     ret = avfilter_graph_create_filter(&filterSrcCxt, avfilter_get_by_name("buffer"), "in", args.toLocal8Bit().data(), NULL, filterGraph);
     if (ret < 0) {
@@ -152,88 +708,336 @@ int Decoder::initFilter()
         }
     }
 
-    /* check validity and configure all the links and formats in the graph */
-    if ((ret = avfilter_graph_config(filterGraph, NULL)) < 0) {
-        qDebug() << "avfilter graph config failed, ret:" << ret;
-        avfilter_graph_free(&filterGraph);
+    /* check validity and configure all the links and formats in the graph */
+    if ((ret = avfilter_graph_config(filterGraph, NULL)) < 0) {
+        qDebug() << "avfilter graph config failed, ret:" << ret;
+        avfilter_graph_free(&filterGraph);
+    } else {
+        filterArgs = args;
+    }
+
+out:
+    avfilter_inout_free(&out);
+    avfilter_inout_free(&in);
+
+    return ret;
+}
+
+void Decoder::decoderFile(QString file, QString type)
+{
+    qDebug() << "File name:" << file << ", type:" << type;
+
+    requestOpen(file, type);
+}
+
+/* stop current file & start threads on new one, future gets whether it started playing */
+std::future<bool> Decoder::requestOpen(QString file, QString type)
+{
+    std::shared_ptr<std::promise<bool> > done = std::make_shared<std::promise<bool> >();
+
+    switchStartTime = av_gettime_relative();
+
+    /* threads keep decoders & audio device open for this file */
+    isSwitching = true;
+    requestStop().wait();
+    isSwitching = false;
+
+    /* thread has acknowledged, only returning from run() is left */
+    wait();
+
+    clearData();
+
+    currentFile = file;
+    currentType = type;
+    pauseWanted = false;
+
+    SDL_LockMutex(stateMutex);
+    playingFile = file;
+    openDone = done;
+    threadState = STATE_OPENING;
+    SDL_UnlockMutex(stateMutex);
+
+    start();
+
+    return done->get_future();
+}
+
+/* stop threads, opening is aborted by interrupt callback,
+ * future is ready once all threads exited & file closed
+ */
+std::future<void> Decoder::requestStop()
+{
+    std::shared_ptr<std::promise<void> > done = std::make_shared<std::promise<void> >();
+    bool isIdle;
+
+    SDL_LockMutex(stateMutex);
+    isIdle = (threadState == STATE_IDLE);
+    if (isIdle) {
+        done->set_value();
+    } else {
+        threadState = STATE_STOPPING;
+        isStop = true;
+        stopWaiters.append(done);
+    }
+    SDL_UnlockMutex(stateMutex);
+
+    if (!isIdle) {
+        audioDecoder->stopAudio();
+        wakeUp();
+    }
+
+    return done->get_future();
+}
+
+/* future is ready once reading thread has paused or resumed, or nothing is playing */
+std::future<void> Decoder::requestPause(bool pause)
+{
+    Command command;
+    command.type = pause ? Command::PAUSE : Command::RESUME;
+    command.offset = 0;
+
+    pauseWanted = pause;
+
+    return postCommand(command);
+}
+
+std::future<void> Decoder::postCommand(Decoder::Command command)
+{
+    command.done = std::make_shared<std::promise<void> >();
+    std::future<void> future = command.done->get_future();
+
+    SDL_LockMutex(stateMutex);
+    if (threadState == STATE_IDLE || threadState == STATE_STOPPING) {
+        command.done->set_value();
+    } else {
+        commands.enqueue(command);
+        SDL_CondBroadcast(stateCond);
+    }
+    SDL_UnlockMutex(stateMutex);
+
+    /* reading thread may wait for queue space */
+    videoQueue.wakeUp();
+
+    return future;
+}
+
+/* run on reading thread, commands queued while opening apply once playing */
+void Decoder::processCommands()
+{
+    SDL_LockMutex(stateMutex);
+    while (!commands.isEmpty()) {
+        Command command = commands.dequeue();
+        SDL_UnlockMutex(stateMutex);
+
+        switch (command.type) {
+        case Command::PAUSE:
+        case Command::RESUME:
+            setPause(command.type == Command::PAUSE);
+            break;
+
+        case Command::SHIFT:
+        case Command::SHIFT_LIVE:
+            if (isTimeshift) {
+                shiftTimeshift(command.offset, command.type == Command::SHIFT_LIVE);
+            }
+            break;
+        }
+
+        command.done->set_value();
+
+        SDL_LockMutex(stateMutex);
+    }
+    SDL_UnlockMutex(stateMutex);
+}
+
+void Decoder::openFinished(bool isOpened)
+{
+    SDL_LockMutex(stateMutex);
+    if (openDone) {
+        openDone->set_value(isOpened);
+        openDone.reset();
+    }
+
+    /* stop may have come while opening */
+    if (isOpened && threadState == STATE_OPENING) {
+        threadState = STATE_RUNNING;
+    }
+    SDL_UnlockMutex(stateMutex);
+}
+
+void Decoder::takeSeekWaiters(QList<std::shared_ptr<std::promise<void> > > *waiters)
+{
+    SDL_LockMutex(seekMutex);
+    *waiters = seekWaiters;
+    seekWaiters.clear();
+    SDL_UnlockMutex(seekMutex);
+}
+
+/* open next file in background, switching to it only hands over the pipeline */
+void Decoder::prepareNext(QString file, QString type)
+{
+    /* gui asks again every tick until trackChanged arrives, file is playing already */
+    SDL_LockMutex(stateMutex);
+    bool isPlaying = (file == playingFile);
+    SDL_UnlockMutex(stateMutex);
+
+    if (isPlaying) {
+        return;
+    }
+
+    preloader->prepare(file, type);
+
+    /* reading may have finished, chain the track */
+    SDL_LockMutex(stateMutex);
+    isNextRequest = true;
+    SDL_CondBroadcast(stateCond);
+    SDL_UnlockMutex(stateMutex);
+}
+
+void Decoder::setGapless(bool gapless)
+{
+    isGapless = gapless;
+}
+
+/* Continue reading preloaded next music file after current one,
+ * audio decoder switches to it while current track drained.
+ */
+bool Decoder::chainNextTrack()
+{
+    int index = -1;
+
+    /* one chained track at a time, audio decoder switches to it first */
+    if (isTrackChanging || !isGapless || currentType != "music" || preloader->preparedType() != "music") {
+        return false;
+    }
+
+    QString file = preloader->preparedFile();
+    if (file == currentFile) {
+        preloader->cancel();
+        return false;
     }
 
-out:
-    avfilter_inout_free(&out);
-    avfilter_inout_free(&in);
+    PreparedMedia *next = preloader->take(file);
+    if (!next) {
+        return false;
+    }
 
-    return ret;
-}
+    /* its I/O reads on this thread from now on, stopped by our callback */
+    AVIOInterruptCB callback = {&Decoder::interruptCallback, this};
+    MediaPreloader::handOver(next, callback);
 
-void Decoder::decoderFile(QString file, QString type)
-{
-//    qDebug() << "Current state:" << playState;
-    qDebug() << "File name:" << file << ", type:" << type;
-    if (playState != STOP) {
-        isStop = true;
-        while (playState != STOP) {
-            SDL_Delay(10);
+    for (unsigned int i = 0; i < next->pFormatCtx->nb_streams; i++) {
+        if (next->pFormatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+            index = i;
         }
-        SDL_Delay(100);
     }
 
-    clearData();
+    if (index < 0 || audioDecoder->prepareNextTrack(next->pFormatCtx, index) < 0) {
+        MediaPreloader::freePrepared(next);
+        return false;
+    }
 
-    SDL_Delay(100);
+    if (isInfoValid && !isInfoCached) {
+        mediaInfoCache.save(currentFile, mediaInfo);
+    }
+
+    closeInput();
 
+    pFormatCtx = next->pFormatCtx;
+    next->pFormatCtx = NULL;
+    inputInterrupt = next->interrupt;
+    next->interrupt = NULL;
+    mediaInfo    = next->mediaInfo;
+    isInfoCached = next->isInfoCached;
+    MediaPreloader::freePrepared(next);
+
+    audioIndex  = index;
+    timeTotal   = pFormatCtx->duration;
     currentFile = file;
-    currentType = type;
 
-    this->start();
+    SDL_LockMutex(stateMutex);
+    playingFile = file;
+    SDL_UnlockMutex(stateMutex);
+
+    nextTrackFile     = file;
+    nextTrackDuration = pFormatCtx->duration;
+    isTrackChanging   = true;
+    isReadFinished    = false;
+
+    audioDecoder->packetEnqueue(&nextTrackPacket);
+
+    qDebug() << "Gapless next track:" << file;
+
+    return true;
 }
 
+void Decoder::audioTrackChanged()
+{
+    isTrackChanging = false;
+
+    emit gotVideoTime(nextTrackDuration);
+    emit fileChanged(nextTrackFile);
+}
+
+/* music reports FINISH once reading thread has exited */
 void Decoder::audioFinished()
 {
+    int running = STATE_RUNNING;
+
+    SDL_LockMutex(stateMutex);
+    threadState.compare_exchange_strong(running, STATE_FINISHED);
     isStop = true;
-    if (currentType == "music") {
-        SDL_Delay(100);
-        emit playStateChanged(Decoder::FINISH);
-    }
+    SDL_CondBroadcast(stateCond);
+    SDL_UnlockMutex(stateMutex);
+
+    videoQueue.wakeUp();
 }
 
 void Decoder::stopVideo()
 {
-    if (playState == STOP) {
-        setPlayState(Decoder::STOP);
-        return;
-    }
+    bool isIdle = (threadState == STATE_IDLE);
 
-    gotStop = true;
-    isStop  = true;
-    audioDecoder->stopAudio();
+    requestStop().wait();
+    wait();
 
-    if (currentType == "video") {
-        /* wait for decoding & reading stop */
-        while (!isReadFinished || !isDecodeFinished) {
-            SDL_Delay(10);
-        }
-    } else {
-        while (!isReadFinished) {
-            SDL_Delay(10);
-        }
+    /* pipeline kept after playing finished */
+    releasePipeline();
+
+    /* threads report STOP themselves */
+    if (isIdle) {
+        setPlayState(Decoder::STOP);
     }
 }
 
 void Decoder::pauseVideo()
 {
-    if (playState == STOP) {
+    requestPause(!pauseWanted);
+}
+
+void Decoder::setPause(bool pause)
+{
+    if (pause == isPause) {
         return;
     }
 
-    isPause = !isPause;
+    isPause = pause;
     audioDecoder->pauseAudio(isPause);
     if (isPause) {
-        av_read_pause(pFormatCtx);
+        /* timeshift keeps recording live stream while paused */
+        if (isTimeshift) {
+            isShifted = true;
+        } else {
+            av_read_pause(pFormatCtx);
+        }
         setPlayState(PAUSE);
     } else {
-        av_read_play(pFormatCtx);
+        if (!isTimeshift) {
+            av_read_play(pFormatCtx);
+        }
         setPlayState(PLAYING);
     }
+
+    wakeUp();
 }
 
 int Decoder::getVolume()
@@ -255,12 +1059,194 @@ double Decoder::getCurrentTime()
     return 0;
 }
 
-void Decoder::seekProgress(qint64 pos)
+/* in microseconds, 0 for live stream */
+qint64 Decoder::getDuration()
+{
+    return timeTotal;
+}
+
+/* newest request replaces pending one, so the last position of a scrub is never lost */
+std::future<void> Decoder::seekProgress(qint64 pos, Decoder::SeekMode mode)
+{
+    std::shared_ptr<std::promise<void> > done = std::make_shared<std::promise<void> >();
+    qint64 now = av_gettime_relative();
+
+    /* nothing to seek */
+    if (threadState == STATE_IDLE) {
+        done->set_value();
+        return done->get_future();
+    }
+
+    SDL_LockMutex(seekMutex);
+
+    seekPos = pos;
+    seekMode = mode;
+    seekStartTime = now;
+    seekSerial++;
+
+    if (scrubStartTime == 0) {
+        scrubStartTime = now;
+        seekRequests = 0;
+        seeksExecuted = 0;
+    }
+    seekRequests++;
+
+    isSeek = true;
+    seekWaiters.append(done);
+
+    SDL_UnlockMutex(seekMutex);
+
+    wakeUp();
+
+    /* ready once reading thread executed it, or a newer request replacing it */
+    return done->get_future();
+}
+
+qint64 Decoder::getSeekLatency()
 {
-    if (!isSeek) {
-        seekPos = pos;
-        isSeek = true;
+    return seekLatency;
+}
+
+/* called with first frame after a flush, only newest request counts */
+void Decoder::seekFinished(int serial)
+{
+    SDL_LockMutex(seekMutex);
+
+    if (serial != seekSerial || isSeek || scrubStartTime == 0) {
+        SDL_UnlockMutex(seekMutex);
+        return;
+    }
+
+    qint64 now = av_gettime_relative();
+    seekLatency = now - seekStartTime;
+
+    qDebug() << (seekMode == SEEK_FAST ? "Fast" : "Accurate") << "seek, first frame latency:"
+             << seekLatency / 1000.0 << "ms";
+
+    if (seekRequests > 1) {
+        double duration = (now - scrubStartTime) / 1000000.0;
+        qDebug() << "Seek settled," << seekRequests << "requests," << seeksExecuted << "executed,"
+                 << seeksExecuted / duration << "seeks/s, settle time:" << seekLatency / 1000.0 << "ms";
+    }
+
+    scrubStartTime = 0;
+
+    SDL_UnlockMutex(seekMutex);
+}
+
+void Decoder::audioSeekFinished(int serial)
+{
+    /* video file report latency while first frame displayed */
+    if (currentType == "music") {
+        reportFirstFrame();
+        seekFinished(serial);
+    }
+}
+
+void Decoder::reportFirstFrame()
+{
+    if (openStartTime <= 0) {
+        return;
+    }
+
+    qDebug() << "Time to first frame:" << (av_gettime_relative() - openStartTime) / 1000.0 << "ms,"
+             << (isInfoCached ? "media info cached" : "media info probed");
+
+    openStartTime = 0;
+
+    /* stop of last file included */
+    if (switchStartTime > 0) {
+        switchLatency = av_gettime_relative() - switchStartTime;
+        qDebug() << "Switch latency:" << switchLatency / 1000.0 << "ms, video decoder"
+                 << (isVideoReused ? "reused" : "opened") << ", audio device"
+                 << (audioDecoder->isDeviceReused() ? "reused" : "opened");
+        switchStartTime = 0;
+    }
+}
+
+qint64 Decoder::getSwitchLatency()
+{
+    return switchLatency;
+}
+
+/* opened decoder of last file decodes this stream as well */
+bool Decoder::isVideoReusable(AVCodecParameters *par)
+{
+    return pCodecCtx && avcodec_is_open(pCodecCtx) && !isLive
+            && !(pCodecCtx->flags & AV_CODEC_FLAG_LOW_DELAY)
+            && pCodecCtx->codec_id       == par->codec_id
+            && pCodecCtx->width          == par->width
+            && pCodecCtx->height         == par->height
+            && pCodecCtx->pix_fmt        == par->format
+            && pCodecCtx->extradata_size == par->extradata_size
+            && (par->extradata_size == 0 || !memcmp(pCodecCtx->extradata, par->extradata, par->extradata_size));
+}
+
+/* free decoders, filter & audio device kept for next file, no thread may run */
+void Decoder::releasePipeline()
+{
+    avcodec_free_context(&pCodecCtx);
+    avfilter_graph_free(&filterGraph);
+    filterArgs.clear();
+
+    audioDecoder->closeAudio();
+}
+
+/* record keyframe position while reading, use for fast seek */
+void Decoder::indexKeyframe(AVPacket *packet)
+{
+    if (!(packet->flags & AV_PKT_FLAG_KEY) || packet->pts == AV_NOPTS_VALUE) {
+        return;
+    }
+
+    if (keyframeIndex.isEmpty() || packet->pts > keyframeIndex.last()) {
+        keyframeIndex.append(packet->pts);
+        return;
+    }
+
+    QVector<qint64>::iterator it = std::lower_bound(keyframeIndex.begin(), keyframeIndex.end(), packet->pts);
+    if (*it != packet->pts) {
+        keyframeIndex.insert(it, packet->pts);
+    }
+}
+
+/* merge demuxer index entries into keyframe index, only done at first fast seek */
+void Decoder::loadContainerIndex()
+{
+    containerIndexLoaded = true;
+
+    /* libavformat of this version has no public accessor for index entries */
+    for (int i = 0; i < videoStream->nb_index_entries; i++) {
+        const AVIndexEntry &entry = videoStream->index_entries[i];
+        if (!(entry.flags & AVINDEX_KEYFRAME)) {
+            continue;
+        }
+
+        QVector<qint64>::iterator it = std::lower_bound(keyframeIndex.begin(), keyframeIndex.end(), entry.timestamp);
+        if (it == keyframeIndex.end() || *it != entry.timestamp) {
+            keyframeIndex.insert(it, entry.timestamp);
+        }
+    }
+
+    qDebug() << "Keyframe index entries:" << keyframeIndex.size();
+}
+
+/* return nearest known keyframe, or timestamp itself if it is out of indexed range */
+qint64 Decoder::nearestKeyframe(qint64 timestamp)
+{
+    if (keyframeIndex.isEmpty() || timestamp > keyframeIndex.last()) {
+        return timestamp;
+    }
+
+    QVector<qint64>::iterator it = std::lower_bound(keyframeIndex.begin(), keyframeIndex.end(), timestamp);
+    if (it == keyframeIndex.begin()) {
+        return *it;
     }
+
+    qint64 after  = *it;
+    qint64 before = *(it - 1);
+
+    return (after - timestamp < timestamp - before) ? after : before;
 }
 
 double Decoder::synchronize(AVFrame *frame, double pts)
@@ -288,6 +1274,28 @@ int Decoder::videoThread(void *arg)
     AVPacket packet;
     Decoder *decoder = (Decoder *)arg;
     AVFrame *pFrame  = av_frame_alloc();
+    double seekTarget = 0;  // accurate seek target, 0 while not prerolling
+    bool isSeeking = false; // waiting for the first frame after a flush
+    int seekSerial = 0;     // request serial of the last flush
+
+    ThreadPolicy::apply(ThreadPolicy::ROLE_VIDEO);
+
+    /* preloaded first frame, show it at once */
+    if (decoder->preparedFrame) {
+        AVFrame *frame = decoder->preparedFrame;
+
+        pts = (frame->pts == AV_NOPTS_VALUE) ? 0 : frame->pts * av_q2d(decoder->videoStream->time_base);
+        decoder->synchronize(frame, pts);
+
+        if (av_buffersrc_add_frame(decoder->filterSrcCxt, frame) >= 0
+                && av_buffersink_get_frame(decoder->filterSinkCxt, pFrame) >= 0) {
+            decoder->displayVideo(pFrame);
+            decoder->reportFirstFrame();
+            av_frame_unref(pFrame);
+        }
+
+        av_frame_free(&decoder->preparedFrame);
+    }
 
     while (true) {
         if (decoder->isStop) {
@@ -295,18 +1303,18 @@ int Decoder::videoThread(void *arg)
         }
 
         if (decoder->isPause) {
-            SDL_Delay(10);
+            decoder->waitWhilePaused();
             continue;
         }
 
         if (decoder->videoQueue.queueSize() <= 0) {
             /* while video file read finished exit decode thread,
-             * otherwise just delay for data input
+             * otherwise block until data input
              */
             if (decoder->isReadFinished) {
                 break;
             }
-            SDL_Delay(1);
+            decoder->videoQueue.wait();
             continue;
         }
 
@@ -317,9 +1325,29 @@ int Decoder::videoThread(void *arg)
             qDebug() << "Seek video";
             avcodec_flush_buffers(decoder->pCodecCtx);
             av_packet_unref(&packet);
+
+            /* preroll to accurate seek target, only reference frames need decoding */
+            isSeeking = true;
+            seekSerial = decoder->videoSeekSerial;
+            seekTarget = decoder->videoSeekTarget;
+            if (seekTarget > 0) {
+                decoder->pCodecCtx->skip_frame = AVDISCARD_NONREF;
+            }
+            continue;
+        }
+
+        /* newer seek is pending, cancel preroll, packets will be dropped by flush */
+        if (seekTarget > 0 && decoder->isSeek) {
+            av_packet_unref(&packet);
             continue;
         }
 
+        /* reaching target, decode all frames again */
+        if (seekTarget > 0 && packet.pts != AV_NOPTS_VALUE
+                && packet.pts * av_q2d(decoder->videoStream->time_base) >= seekTarget) {
+            decoder->pCodecCtx->skip_frame = AVDISCARD_DEFAULT;
+        }
+
         ret = avcodec_send_packet(decoder->pCodecCtx, &packet);
         if ((ret < 0) && (ret != AVERROR(EAGAIN)) && (ret != AVERROR_EOF)) {
             qDebug() << "Video send to decoder failed, error code: " << ret;
@@ -341,12 +1369,29 @@ int Decoder::videoThread(void *arg)
         pts *= av_q2d(decoder->videoStream->time_base);
         pts =  decoder->synchronize(pFrame, pts);
 
+        /* frame before accurate seek target, decode only */
+        if (seekTarget > 0) {
+            if (pts < seekTarget) {
+                av_frame_unref(pFrame);
+                av_packet_unref(&packet);
+                continue;
+            }
+            seekTarget = 0;
+            decoder->pCodecCtx->skip_frame = AVDISCARD_DEFAULT;
+        }
+
         if (decoder->audioIndex >= 0) {
             while (1) {
                 if (decoder->isStop) {
                     break;
                 }
 
+                /* audio clock stands still while paused */
+                if (decoder->isPause) {
+                    decoder->waitWhilePaused();
+                    continue;
+                }
+
                 double audioClk = decoder->audioDecoder->getAudioClock();
                 pts = decoder->videoClk;
 
@@ -372,10 +1417,14 @@ int Decoder::videoThread(void *arg)
             av_packet_unref(&packet);
             continue;
         } else {
-            QImage tmpImage(pFrame->data[0], decoder->pCodecCtx->width, decoder->pCodecCtx->height, QImage::Format_RGB32);
-            /* deep copy, otherwise when tmpImage data change, this image cannot display */
-            QImage image = tmpImage.copy();
-            decoder->displayVideo(image);
+            /* refcounted buffer of filter output, sink keeps a reference if it needs the frame */
+            decoder->displayVideo(pFrame);
+            decoder->reportFirstFrame();
+
+            if (isSeeking) {
+                isSeeking = false;
+                decoder->seekFinished(seekSerial);
+            }
         }
 
         av_frame_unref(pFrame);
@@ -390,11 +1439,10 @@ int Decoder::videoThread(void *arg)
 
     qDebug() << "Video decoder finished.";
 
-    SDL_Delay(100);
-
     decoder->isDecodeFinished = true;
+    decoder->wakeUp();
 
-    if (decoder->gotStop) {
+    if (decoder->threadState == STATE_STOPPING) {
         decoder->setPlayState(Decoder::STOP);
     } else {
         decoder->setPlayState(Decoder::FINISH);
@@ -403,30 +1451,96 @@ int Decoder::videoThread(void *arg)
     return 0;
 }
 
-
+/* threads are joined & file is closed once decodeFile() returns, acknowledge all requests */
 void Decoder::run()
+{
+    QList<std::shared_ptr<std::promise<void> > > waiters;
+
+    /* codec threads opened here inherit it */
+    ThreadPolicy::apply(ThreadPolicy::ROLE_DEMUX);
+
+    decodeFile();
+
+    openFinished(false);
+
+    takeSeekWaiters(&waiters);
+
+    SDL_LockMutex(stateMutex);
+    threadState = STATE_IDLE;
+    while (!commands.isEmpty()) {
+        waiters.append(commands.dequeue().done);
+    }
+    waiters.append(stopWaiters);
+    stopWaiters.clear();
+    SDL_UnlockMutex(stateMutex);
+
+    for (int i = 0; i < waiters.size(); i++) {
+        waiters[i]->set_value();
+    }
+}
+
+void Decoder::decodeFile()
 {
     AVCodec *pCodec;
 
     AVPacket pkt, *packet = &pkt;        // packet use in decoding
 
-    int seekIndex;  
+    int ret;
+    int seekIndex;
     bool realTime;
+    PreparedMedia *prepared;
 
-    pFormatCtx = avformat_alloc_context();
+    openStartTime = av_gettime_relative();
 
-    if (avformat_open_input(&pFormatCtx, currentFile.toLocal8Bit().data(), NULL, NULL) != 0) {
-        qDebug() << "Open file failed.";
-        return ;
+    isLive = isLiveUrl(currentFile);
+    jitterBuffer.reset();
+    audioDecoder->setHold(false);
+
+    /* take over preloaded file, it has been opened & probed */
+    prepared = preloader->take(currentFile);
+    if (prepared && prepared->type != currentType) {
+        MediaPreloader::freePrepared(prepared);
+        prepared = NULL;
     }
 
-    if (avformat_find_stream_info(pFormatCtx, NULL) < 0) {
-        qDebug() << "Could't find stream infomation.";
-        avformat_free_context(pFormatCtx);
-        return;
+    if (prepared) {
+        AVIOInterruptCB callback = {&Decoder::interruptCallback, this};
+        MediaPreloader::handOver(prepared, callback);
+
+        pFormatCtx   = prepared->pFormatCtx;
+        prepared->pFormatCtx = NULL;
+        inputInterrupt = prepared->interrupt;
+        prepared->interrupt = NULL;
+        mediaInfo    = prepared->mediaInfo;
+        isInfoCached = prepared->isInfoCached;
+        qDebug() << "Use preloaded file.";
+    } else {
+        pFormatCtx = avformat_alloc_context();
+        pFormatCtx->interrupt_callback.callback = &Decoder::interruptCallback;
+        pFormatCtx->interrupt_callback.opaque = this;
+
+        setIoDeadline(IO_OPEN_TIMEOUT);
+        if (isLive) {
+            ret = openLiveInput();
+        } else {
+            openMediaIO();
+            ret = mediaInfoCache.openInput(currentFile, &pFormatCtx, &mediaInfo, &isInfoCached);
+        }
+        setIoDeadline(0);
+
+        if (ret < 0) {
+            if (isIoTimeout) {
+                qDebug() << "Open input timeout.";
+            }
+            closeMediaIO();
+            isReadFinished = true;
+            wakeUp();
+            return;
+        }
     }
+    isInfoValid = true;
 
-    realTime = isRealtime(pFormatCtx);
+    realTime = isRealtime(pFormatCtx) || isLive;
 
 //    av_dump_format(pFormatCtx, 0, 0, 0);  // just use in debug output
 
@@ -451,13 +1565,15 @@ void Decoder::run()
     if (currentType == "video") {
         if (videoIndex < 0) {
             qDebug() << "Not support this video file, videoIndex: " << videoIndex << ", audioIndex: " << audioIndex;
-            avformat_free_context(pFormatCtx);
+            MediaPreloader::freePrepared(prepared);
+            closeInput();
             return;
         }
     } else {
         if (audioIndex < 0) {
             qDebug() << "Not support this audio file.";
-            avformat_free_context(pFormatCtx);
+            MediaPreloader::freePrepared(prepared);
+            closeInput();
             return;
         }
     }
@@ -472,16 +1588,60 @@ void Decoder::run()
 
     if (audioIndex >= 0) {
         if (audioDecoder->openAudio(pFormatCtx, audioIndex) < 0) {
-            avformat_free_context(pFormatCtx);
+            MediaPreloader::freePrepared(prepared);
+            closeInput();
             return;
         }
     }
 
-    if (currentType == "video") {
+    /* audio read while preloading video */
+    if (prepared) {
+        while (!prepared->audioPackets.isEmpty()) {
+            AVPacket audioPacket = prepared->audioPackets.dequeue();
+            if (audioIndex >= 0) {
+                audioDecoder->packetEnqueue(&audioPacket);
+            } else {
+                av_packet_unref(&audioPacket);
+            }
+        }
+    }
+
+    isVideoReused = false;
+
+    /* video decoder kept from last video file */
+    if (currentType != "video" || prepared
+            || (pCodecCtx && !isVideoReusable(pFormatCtx->streams[videoIndex]->codecpar))) {
+        avcodec_free_context(&pCodecCtx);
+    }
+
+    if (currentType == "video" && pCodecCtx) {
+        AVCodecParameters *par = pFormatCtx->streams[videoIndex]->codecpar;
+
+        avcodec_flush_buffers(pCodecCtx);
+        pCodecCtx->sample_aspect_ratio = par->sample_aspect_ratio;
+        isVideoReused = true;
+        qDebug() << "Reuse video decoder.";
+    }
+
+    if (currentType == "video" && prepared) {
+        /* preloaded decoder has decoded first frame */
+        pCodecCtx = prepared->pCodecCtx;
+        preparedFrame = prepared->firstFrame;
+        prepared->pCodecCtx = NULL;
+        prepared->firstFrame = NULL;
+    }
+
+    if (currentType == "video" && !prepared && !isVideoReused) {
         /* find video decoder */
         pCodecCtx = avcodec_alloc_context3(NULL);
         avcodec_parameters_to_context(pCodecCtx, pFormatCtx->streams[videoIndex]->codecpar);
 
+        /* output frames as soon as decoded, no reordering delay */
+        if (isLive) {
+            pCodecCtx->flags  |= AV_CODEC_FLAG_LOW_DELAY;
+            pCodecCtx->flags2 |= AV_CODEC_FLAG2_FAST;
+        }
+
         /* find video decoder */
         if ((pCodec = avcodec_find_decoder(pCodecCtx->codec_id)) == NULL) {
             qDebug() << "Video decoder not found.";
@@ -492,26 +1652,43 @@ void Decoder::run()
             qDebug() << "Could not open video decoder.";
             goto fail;
         }
+    }
+
+    /* format context & decoder are owned by this thread from now on */
+    MediaPreloader::freePrepared(prepared);
+    prepared = NULL;
 
+    if (currentType == "video") {
         videoStream = pFormatCtx->streams[videoIndex];
 
+        if (isInfoCached && mediaInfo.keyframeStream == videoIndex) {
+            keyframeIndex = mediaInfo.keyframeIndex;
+        }
+
         if (initFilter() < 0) {
             goto fail;
         }
 
-        SDL_CreateThread(&Decoder::videoThread, "video_thread", this);
+        videoTid = SDL_CreateThread(&Decoder::videoThread, "video_thread", this);
     }
 
+    /* live stream is recorded, so it can be paused & rewound */
+    isTimeshift = isLive && timeshift.open(timeshiftMemory, timeshiftDisk);
+
     setPlayState(Decoder::PLAYING);
+    openFinished(true);
 
+read:
     while (true) {
         if (isStop) {
             break;
         }
 
-        /* do not read next frame & delay to release cpu utilization */
-        if (isPause) {
-            SDL_Delay(10);
+        processCommands();
+
+        /* do not read next frame, sleep until resumed */
+        if (isPause && !isTimeshift) {
+            waitCommand();
             continue;
         }
 
@@ -519,7 +1696,34 @@ void Decoder::run()
  * & have out of loop, then jump back to seek position
  */
 seek:
+        /* position belongs to track still playing, not the one reading */
+        if (isSeek && isTrackChanging) {
+            QList<std::shared_ptr<std::promise<void> > > waiters;
+
+            SDL_LockMutex(seekMutex);
+            isSeek = false;
+            SDL_UnlockMutex(seekMutex);
+            qDebug() << "Seek ignored while changing track.";
+
+            takeSeekWaiters(&waiters);
+            for (int i = 0; i < waiters.size(); i++) {
+                waiters[i]->set_value();
+            }
+        }
+
         if (isSeek) {
+            QList<std::shared_ptr<std::promise<void> > > waiters;
+
+            SDL_LockMutex(seekMutex);
+            qint64 pos = seekPos;
+            SeekMode mode = seekMode;
+            int serial = seekSerial;
+            isSeek = false;
+            seeksExecuted++;
+            waiters = seekWaiters;
+            seekWaiters.clear();
+            SDL_UnlockMutex(seekMutex);
+
             if (currentType == "video") {
                 seekIndex = videoIndex;
             } else {
@@ -527,42 +1731,94 @@ seek:
             }
 
             AVRational aVRational = av_get_time_base_q();
-            seekPos = av_rescale_q(seekPos, aVRational, pFormatCtx->streams[seekIndex]->time_base);
+            seekTime = pos / static_cast<double>(AV_TIME_BASE);
+            pos = av_rescale_q(pos, aVRational, pFormatCtx->streams[seekIndex]->time_base);
 
-            if (av_seek_frame(pFormatCtx, seekIndex, seekPos, AVSEEK_FLAG_BACKWARD) < 0) {
-                qDebug() << "Seek failed.";
+            if (mode == SEEK_FAST && seekIndex == videoIndex) {
+                if (!containerIndexLoaded) {
+                    loadContainerIndex();
+                }
+                /* land exactly on the keyframe, no matter it is before or after target */
+                pos = nearestKeyframe(pos);
+                seekTime = pos * av_q2d(videoStream->time_base);
+            }
+
+            setIoDeadline(IO_READ_TIMEOUT);
+            ret = av_seek_frame(pFormatCtx, seekIndex, pos, AVSEEK_FLAG_BACKWARD);
+            setIoDeadline(0);
 
+            if (ret < 0) {
+                qDebug() << "Seek failed.";
             } else {
+                double target = (mode == SEEK_ACCURATE) ? seekTime : 0;
+
                 audioDecoder->emptyAudioData();
+                audioDecoder->setSeekTarget(target, serial);
                 audioDecoder->packetEnqueue(&seekPacket);
 
                 if (currentType == "video") {
                     videoQueue.empty();
+                    videoSeekTarget = target;
+                    videoSeekSerial = serial;
                     videoQueue.enqueue(&seekPacket);
                     videoClk = 0;
                 }
             }
 
-            isSeek = false;
+            for (int i = 0; i < waiters.size(); i++) {
+                waiters[i]->set_value();
+            }
         }
 
-        if (currentType == "video") {
+        /* live stream is read on, timeshift buffer holds data for decoders */
+        if (currentType == "video" && !isTimeshift) {
             if (videoQueue.queueSize() > 512) {
-                SDL_Delay(10);
+                /* block until video thread takes packets */
+                videoQueue.waitSpace(512);
                 continue;
             }
         }
 
         /* judge haven't reall all frame */
-        if (av_read_frame(pFormatCtx, packet) < 0){
-            qDebug() << "Read file completed.";
+        setIoDeadline(IO_READ_TIMEOUT);
+        ret = av_read_frame(pFormatCtx, packet);
+        setIoDeadline(0);
+
+        if (ret < 0) {
+            if (isIoTimeout) {
+                qDebug() << "Read timeout, source not responding.";
+            } else {
+                qDebug() << "Read file completed.";
+            }
             isReadFinished = true;
-            emit readFinished();
-            SDL_Delay(10);
+            /* called on reading thread, ordered before prepareNextTrack() of a chained track,
+             * a queued signal could land after it & end the chained track early
+             */
+            audioDecoder->readFileFinished();
+            wakeUp();
             break;
         }
 
+        if (isLive) {
+            updateLiveLatency(packet);
+        }
+
+        if (isTimeshift) {
+            recordTimeshift(packet);
+            av_packet_unref(packet);
+            feedTimeshift();
+            continue;
+        }
+
         if (packet->stream_index == videoIndex && currentType == "video") {
+            /* live data dropped, decoding restarts from keyframe */
+            if (waitKeyframe && !(packet->flags & AV_PKT_FLAG_KEY)) {
+                av_packet_unref(packet);
+                continue;
+            }
+            waitKeyframe = false;
+
+            indexKeyframe(packet);
             videoQueue.enqueue(packet); // video stream
         } else if (packet->stream_index == audioIndex) {
             audioDecoder->packetEnqueue(packet); // audio stream
@@ -581,27 +1837,77 @@ seek:
             goto seek;
         }
 
-        SDL_Delay(100);
+        processCommands();
+
+        /* live source ended, recorded data played on */
+        if (isTimeshift) {
+            feedTimeshift();
+        }
+
+        /* gapless music, go on reading next track */
+        if (chainNextTrack()) {
+            goto read;
+        }
+
+        waitForRequest();
     }
 
 fail:
+    /* invalid cached info may cause failure, probe again next time */
+    if (isInfoCached && !isStop) {
+        mediaInfoCache.remove(currentFile);
+    } else if (isInfoValid && !realTime) {
+        if (currentType == "video") {
+            mediaInfo.keyframeStream = videoIndex;
+            mediaInfo.keyframeIndex  = keyframeIndex;
+        }
+        mediaInfoCache.save(currentFile, mediaInfo);
+    }
+
+    if (isTimeshift) {
+        timeshift.close();
+        isTimeshift = false;
+    }
+
+    /* decoders & audio device kept open unless playing is stopped by user */
+    bool isKeep = (threadState != STATE_STOPPING) || isSwitching;
+
     /* close audio device */
     if (audioIndex >= 0) {
-        audioDecoder->closeAudio();
+        if (isKeep) {
+            audioDecoder->releaseAudio();
+        } else {
+            audioDecoder->closeAudio();
+        }
     }
 
     if (currentType == "video") {
-        avcodec_close(pCodecCtx);
-        avcodec_free_context(&pCodecCtx);
+        /* video thread may still use decoder */
+        if (videoTid) {
+            isStop = true;
+            wakeUp();
+            SDL_WaitThread(videoTid, NULL);
+            videoTid = NULL;
+        }
+
+        if (preparedFrame) {
+            av_frame_free(&preparedFrame);
+        }
+
+        if (!isKeep) {
+            avcodec_free_context(&pCodecCtx);
+            avfilter_graph_free(&filterGraph);
+            filterArgs.clear();
+        }
     }
 
-    avformat_close_input(&pFormatCtx);
-    avformat_free_context(pFormatCtx);
+    closeInput();
 
     isReadFinished = true;
+    wakeUp();
 
     if (currentType == "music") {
-        setPlayState(Decoder::STOP);
+        setPlayState((threadState == STATE_FINISHED) ? Decoder::FINISH : Decoder::STOP);
     }
 
     qDebug() << "Main decoder finished.";
@@ -2,7 +2,12 @@
 #define DECODER_H
 
 #include <QThread>
-#include <QImage>
+#include <QVector>
+#include <QQueue>
+#include <QDateTime>
+#include <atomic>
+#include <future>
+#include <memory>
 
 extern "C"
 {
@@ -18,6 +23,17 @@ extern "C"
 }
 
 #include "audiodecoder.h"
+#include "mediainfocache.h"
+#include "mediapreloader.h"
+#include "jitterbuffer.h"
+#include "mediaio.h"
+#include "timeshiftbuffer.h"
+#include "framesink.h"
+
+/* Deadline of opening & probing input, in microseconds. */
+#define IO_OPEN_TIMEOUT (10 * 1000000)
+/* Deadline of reading or seeking, in microseconds. */
+#define IO_READ_TIMEOUT (5 * 1000000)
 
 class Decoder : public QThread
 {
@@ -31,23 +47,108 @@ public:
         FINISH
     };
 
+    enum SeekMode {
+        SEEK_FAST,      // snap to the nearest keyframe
+        SEEK_ACCURATE   // decode up to the exact target
+    };
+
     explicit Decoder();
     ~Decoder();
 
+    std::future<bool> requestOpen(QString file, QString type);
+    std::future<void> requestStop();
+    std::future<void> requestPause(bool pause);
+
+    void setFrameSink(FrameSink *sink);
+    void setAudioSink(AudioSink *sink);
+
     double getCurrentTime();
-    void seekProgress(qint64 pos);
+    qint64 getDuration();
+    std::future<void> seekProgress(qint64 pos, Decoder::SeekMode mode = SEEK_ACCURATE);
+    qint64 getSeekLatency();
+    qint64 getSwitchLatency();
     int getVolume();
     void setVolume(int volume);
+    void prepareNext(QString file, QString type);
+    void setGapless(bool gapless);
+    bool isLiveStream();
+    int getLiveLatency();
+    int getLiveDrops();
+    void setLiveLatency(int ms);
+    void setTimeshift(qint64 memoryCap, qint64 diskCap);
+    double getTimeshiftDuration();
+    std::future<void> shiftLive(double offset);
+    std::future<void> seekToLive();
+    void setReadAheadSize(qint64 size);
+    void setIOBackend(MediaIO::Backend backend);
+    void setMemoryThreshold(qint64 size);
+    qint64 getInputMemory();
 
 private:
+    /* Life of decoder threads, requests are acknowledged by the thread owning the transition. */
+    enum ThreadState {
+        STATE_IDLE,         // no thread running
+        STATE_OPENING,      // reading thread opens input
+        STATE_RUNNING,
+        STATE_FINISHED,     // played to the end, threads exiting
+        STATE_STOPPING      // stop requested, threads exiting
+    };
+
+    /* Request handled by reading thread in order. */
+    struct Command
+    {
+        enum Type {
+            PAUSE,
+            RESUME,
+            SHIFT,          // timeshift by offset
+            SHIFT_LIVE      // timeshift back to live edge
+        };
+
+        Type type;
+        double offset;
+        std::shared_ptr<std::promise<void> > done;
+    };
+
     void run();
+    void decodeFile();
+    std::future<void> postCommand(Decoder::Command command);
+    void processCommands();
+    void setPause(bool pause);
+    void openFinished(bool isOpened);
+    void takeSeekWaiters(QList<std::shared_ptr<std::promise<void> > > *waiters);
     void clearData();
     void setPlayState(Decoder::PlayState state);
-    void displayVideo(QImage image);
+    void displayVideo(AVFrame *frame);
     static int videoThread(void *arg);
     double synchronize(AVFrame *frame, double pts);
     bool isRealtime(AVFormatContext *pFormatCtx);
     int initFilter();
+    void indexKeyframe(AVPacket *packet);
+    void loadContainerIndex();
+    qint64 nearestKeyframe(qint64 timestamp);
+    void seekFinished(int serial);
+    void reportFirstFrame();
+    bool isVideoReusable(AVCodecParameters *par);
+    void releasePipeline();
+    bool chainNextTrack();
+    static bool isLiveUrl(QString file);
+    int openLiveInput();
+    void updateLiveLatency(AVPacket *packet);
+    void dropToLive();
+    void flushDecoders();
+    void recordTimeshift(AVPacket *packet);
+    void feedTimeshift();
+    void moveTimeshiftCursor(qint64 seq);
+    void shiftTimeshift(double offset, bool toLive);
+    static int interruptCallback(void *arg);
+    void setIoDeadline(qint64 timeout);
+    void openMediaIO();
+    void closeInput();
+    void closeMediaIO();
+    void wakeUp();
+    void waitWhilePaused();
+    void waitCommand();
+    void waitForRequest();
 
     int fileType;
 
@@ -63,18 +164,90 @@ private:
     AVPacket seekPacket;
     qint64 seekPos;
     double seekTime;
+    SeekMode seekMode;
+    SDL_mutex *seekMutex;   // guard pending seek request, newest request wins
+    int seekSerial;         // increased by every seek request
+    double videoSeekTarget; // frames before it are decoded but not displayed
+    int videoSeekSerial;    // request serial of the flush sent to video thread
+    qint64 seekStartTime;   // av_gettime_relative() of the newest seek request
+    qint64 seekLatency;     // last seek request to first frame, in microseconds
+
+    qint64 scrubStartTime;  // first request since seeking last settled, 0 if settled
+    int seekRequests;       // requests since scrubStartTime
+    int seeksExecuted;      // seeks actually executed since scrubStartTime
+
+    QVector<qint64> keyframeIndex;  // video keyframe pts in stream time base, ascending
+    bool containerIndexLoaded;
 
-    PlayState playState;
-    bool isStop;
-    bool gotStop;
-    bool isPause;
-    bool isSeek;
-    bool isReadFinished;
-    bool isDecodeFinished;
+    MediaInfoCache mediaInfoCache;
+    MediaInfo mediaInfo;    // stream info of current file, saved back at close
+    bool isInfoValid;       // mediaInfo describes current file
+    bool isInfoCached;      // current file opened from cached info without probing
+    qint64 openStartTime;   // av_gettime_relative() at open, 0 after first frame
+
+    std::atomic<int> threadState;       // ThreadState, changed under stateMutex
+    std::atomic<bool> isStop;           // threads exit, set by stop & by playing finished
+    std::atomic<bool> isPause;          // changed by reading thread only
+    std::atomic<bool> isSeek;
+    std::atomic<bool> isReadFinished;
+    std::atomic<bool> isDecodeFinished;
+    std::atomic<bool> isNextRequest;    // next file to preload, reading finished loop checks it
+    bool pauseWanted;                   // last pause requested, gui thread only
+    SDL_mutex *stateMutex;
+    SDL_cond *stateCond;    // signalled on command, stop, seek, next track & finish
+
+    QQueue<Command> commands;                                   // guarded by stateMutex
+    QList<std::shared_ptr<std::promise<void> > > stopWaiters;   // guarded by stateMutex
+    QList<std::shared_ptr<std::promise<void> > > seekWaiters;   // guarded by seekMutex
+    std::shared_ptr<std::promise<bool> > openDone;              // guarded by stateMutex
 
     AVFormatContext *pFormatCtx;
+    PreloadInterrupt *inputInterrupt;   // forwarding interrupt of preloaded input, NULL otherwise
+
+    AVCodecContext *pCodecCtx;          // video codec context, kept open for next file
+
+    std::atomic<bool> isSwitching;      // stop is part of opening next file, pipeline kept
+    qint64 switchStartTime;             // av_gettime_relative() at open request, 0 after first frame
+    qint64 switchLatency;               // open request to first frame, in microseconds
+    bool isVideoReused;                 // video decoder of last file reused
+    QString filterArgs;                 // source args of filterGraph, same args reuse it
+
+    MediaPreloader *preloader;
+    AVFrame *preparedFrame;     // preloaded first video frame, shown at once
+
+    bool isGapless;             // music continues to next track without reopening audio
+    std::atomic<bool> isTrackChanging;  // next track is reading, audio still plays current one
+    QString playingFile;        // opened or chained file, under stateMutex, read by gui thread
+    AVPacket nextTrackPacket;
+    QString nextTrackFile;
+    qint64 nextTrackDuration;
 
-    AVCodecContext *pCodecCtx;          // video codec context
+    bool isLive;                // network live stream, played at low latency
+    JitterBuffer jitterBuffer;  // keep live latency near target
+    bool waitKeyframe;          // live data dropped, video waits for next keyframe
+    std::atomic<int> liveDrops; // times live buffered data dropped
+
+    TimeshiftBuffer timeshift;  // live packets recorded, decoders fed from it
+    qint64 timeshiftMemory;     // memory cap of timeshift buffer, in bytes
+    qint64 timeshiftDisk;       // spill file cap of timeshift buffer, in bytes
+    bool isTimeshift;           // live stream played through timeshift buffer
+    bool isShifted;             // paused or rewound by user, no catching up to live edge
+    qint64 playCursor;          // sequence of next recorded packet sent to decoders
+    double feedStartTime;       // time of packet at cursor after it moved
+
+    MediaIO *mediaIO;           // custom input of demuxer, NULL for libavformat own I/O
+    MediaIO::Backend ioBackend;
+    qint64 readAheadSize;       // read-ahead window of local & network files, in bytes
+    qint64 memoryThreshold;     // local files up to this size played from memory, 0 for never
+    qint64 inputMemory;         // memory held by current input, in bytes
+    QString memoryFile;         // file played from memory last, kept for replay & loop
+    QByteArray memoryData;
+    QDateTime memoryModified;   // modification time of memoryFile when it was loaded
+
+    qint64 ioDeadline;          // av_gettime_relative() blocking I/O gives up at, 0 for none
+    bool isIoTimeout;           // last blocking I/O interrupted by deadline
+
+    SDL_Thread *videoTid;
 
     AvPacketQueue videoQueue;
     AvPacketQueue subtitleQueue;
@@ -83,6 +256,8 @@ private:
 
     double videoClk;    // video frame timestamp
 
+    FrameSink *frameSink;   // receives frames, NULL drops them
+
     AudioDecoder *audioDecoder;
 
     AVFilterGraph   *filterGraph;
@@ -94,11 +269,12 @@ public slots:
     void stopVideo();
     void pauseVideo();
     void audioFinished();
+    void audioSeekFinished(int serial);
+    void audioTrackChanged();
 
 signals:
-    void readFinished();
-    void gotVideo(QImage image);
     void gotVideoTime(qint64 time);
+    void fileChanged(QString file);
     void playStateChanged(Decoder::PlayState state);
 
 };
@@ -0,0 +1,193 @@
+#include <QDebug>
+#include <QThread>
+#include <vector>
+
+extern "C"
+{
+#include "libavutil/pixdesc.h"
+#include "libavutil/time.h"
+}
+
+#include "frameconverter.h"
+#include "yuvconvert.h"
+#include "taskpool.h"
+
+/* Output rows of a slice at least, smaller frames are not worth handing out. */
+#define SLICE_MIN_ROWS (128)
+
+FrameConverter::FrameConverter() :
+    srcWidth(0),
+    srcHeight(0),
+    srcFormat(AV_PIX_FMT_NONE),
+    colorspace(AVCOL_SPC_UNSPECIFIED),
+    colorRange(AVCOL_RANGE_UNSPECIFIED),
+    threadCount(QThread::idealThreadCount()),
+    convertTime(0)
+{
+
+}
+
+FrameConverter::~FrameConverter()
+{
+    freeScaler();
+}
+
+/* count <= 0 for one per core */
+void FrameConverter::setThreadCount(int count)
+{
+    threadCount = (count > 0) ? count : QThread::idealThreadCount();
+
+    /* slices made again on next frame */
+    freeScaler();
+}
+
+qint64 FrameConverter::getConvertTime()
+{
+    return convertTime;
+}
+
+/* job(0) on calling thread, others on shared pool, returns when all finished */
+void FrameConverter::runSlices(int count, const std::function<void (int)> &job)
+{
+    std::vector<std::future<void>> tasks;
+
+    for (int i = 1; i < count; i++) {
+        tasks.push_back(TaskPool::instance()->submit("convert slice", TaskPool::PRIORITY_PLAYBACK,
+                                                     [&job, i]() { job(i); }));
+    }
+
+    job(0);
+
+    for (std::future<void> &task : tasks) {
+        TaskPool::instance()->wait(task);
+    }
+}
+
+int FrameConverter::sliceCount(int rows)
+{
+    return qBound(1, rows / SLICE_MIN_ROWS, threadCount);
+}
+
+void FrameConverter::freeScaler()
+{
+    for (int i = 0; i < slices.size(); i++) {
+        sws_freeContext(slices[i].swsCtx);
+    }
+    slices.clear();
+}
+
+/* Each slice scales its own band of source rows to its band of output rows.
+ * Band edges are on chroma rows, filter taps do not reach across them.
+ */
+bool FrameConverter::initScaler(const AVFrame *frame, QSize size)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+    int rowAlign = desc ? (1 << desc->log2_chroma_h) : 1;
+    int count = sliceCount(qMin(size.height(), frame->height / rowAlign));
+
+    freeScaler();
+
+    /* hd sources are mostly bt.709, sws defaults to bt.601 */
+    int matrix = (frame->colorspace == AVCOL_SPC_BT709) ? SWS_CS_ITU709 : SWS_CS_DEFAULT;
+    int srcRange = (frame->color_range == AVCOL_RANGE_JPEG) ? 1 : 0;
+
+    for (int i = 0; i < count; i++) {
+        Slice slice;
+        int dstEnd = size.height() * (i + 1) / count;
+        int srcEnd = (i == count - 1) ? frame->height
+                                      : static_cast<int>(static_cast<qint64>(dstEnd) * frame->height / size.height()) / rowAlign * rowAlign;
+
+        slice.dstY = size.height() * i / count;
+        slice.dstHeight = dstEnd - slice.dstY;
+        slice.srcY = (i == 0) ? 0
+                              : static_cast<int>(static_cast<qint64>(slice.dstY) * frame->height / size.height()) / rowAlign * rowAlign;
+        slice.srcHeight = srcEnd - slice.srcY;
+
+        slice.swsCtx = sws_getContext(frame->width, slice.srcHeight, static_cast<AVPixelFormat>(frame->format),
+                                      size.width(), slice.dstHeight, AV_PIX_FMT_RGB32,
+                                      SWS_BILINEAR, NULL, NULL, NULL);
+        if (!slice.swsCtx) {
+            qDebug() << "Frame converter init failed, format:" << frame->format;
+            freeScaler();
+            return false;
+        }
+
+        sws_setColorspaceDetails(slice.swsCtx, sws_getCoefficients(matrix), srcRange,
+                                 sws_getCoefficients(SWS_CS_DEFAULT), 1, 0, 1 << 16, 1 << 16);
+        slices.append(slice);
+    }
+
+    srcWidth   = frame->width;
+    srcHeight  = frame->height;
+    srcFormat  = frame->format;
+    colorspace = frame->colorspace;
+    colorRange = frame->color_range;
+    dstSize    = size;
+
+    return true;
+}
+
+void FrameConverter::scaleSlice(const AVFrame *frame, QImage *image, const FrameConverter::Slice &slice)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+    const uint8_t *src[4] = {NULL, NULL, NULL, NULL};
+
+    for (int p = 0; p < 4 && frame->data[p]; p++) {
+        /* chroma planes of yuv are subsampled */
+        bool isChroma = (p == 1 || p == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+        int row = isChroma ? (slice.srcY >> desc->log2_chroma_h) : slice.srcY;
+        src[p] = frame->data[p] + row * frame->linesize[p];
+    }
+
+    uint8_t *dst[4] = {image->bits() + slice.dstY * image->bytesPerLine(), NULL, NULL, NULL};
+    int dstStride[4] = {image->bytesPerLine(), 0, 0, 0};
+
+    sws_scale(slice.swsCtx, src, frame->linesize, 0, slice.srcHeight, dst, dstStride);
+}
+
+/* image reused if it already has size & format */
+bool FrameConverter::convert(const AVFrame *frame, QSize size, QImage *image)
+{
+    if (!frame || !frame->data[0] || size.isEmpty()) {
+        return false;
+    }
+
+    qint64 start = av_gettime_relative();
+
+    if (image->size() != size || image->format() != QImage::Format_RGB32) {
+        *image = QImage(size, QImage::Format_RGB32);
+    }
+
+    /* unscaled common formats by own simd kernels, slices start on even rows */
+    YuvConvert::Kernel kernel = NULL;
+    if (size == QSize(frame->width, frame->height)) {
+        kernel = YuvConvert::findKernel(frame, YuvConvert::OUTPUT_RGB32);
+    }
+
+    if (kernel) {
+        int count = sliceCount(frame->height);
+        uchar *bits = image->bits();
+        int stride = image->bytesPerLine();
+
+        runSlices(count, [=](int i) {
+            int rowStart = (frame->height * i / count) & ~1;
+            int rowEnd = (i == count - 1) ? frame->height : (frame->height * (i + 1) / count) & ~1;
+            kernel(frame, bits, stride, rowStart, rowEnd);
+        });
+    } else {
+        if (slices.isEmpty() || frame->width != srcWidth || frame->height != srcHeight || frame->format != srcFormat
+                || frame->colorspace != colorspace || frame->color_range != colorRange || size != dstSize) {
+            if (!initScaler(frame, size)) {
+                return false;
+            }
+        }
+
+        runSlices(slices.size(), [=](int i) {
+            scaleSlice(frame, image, slices[i]);
+        });
+    }
+
+    convertTime = av_gettime_relative() - start;
+
+    return true;
+}
@@ -0,0 +1,61 @@
+#ifndef FRAMECONVERTER_H
+#define FRAMECONVERTER_H
+
+#include <QImage>
+#include <QSize>
+#include <QVector>
+#include <functional>
+
+extern "C"
+{
+#include "libavutil/frame.h"
+#include "libswscale/swscale.h"
+}
+
+/* Convert decoded frames to RGB32 images, scaled to the size they are shown at,
+ * so full size RGB frames never exist. Unscaled frames go through YuvConvert
+ * kernels, others through swscale kept while geometry stays the same.
+ * Big frames are split into horizontal slices converted on TaskPool workers.
+ */
+class FrameConverter
+{
+public:
+    explicit FrameConverter();
+    ~FrameConverter();
+
+    bool convert(const AVFrame *frame, QSize size, QImage *image);
+    void setThreadCount(int count);
+    qint64 getConvertTime();
+
+private:
+    /* band of output rows with the source rows scaled into it */
+    struct Slice
+    {
+        struct SwsContext *swsCtx;
+        int srcY;
+        int srcHeight;
+        int dstY;
+        int dstHeight;
+    };
+
+    int sliceCount(int rows);
+    bool initScaler(const AVFrame *frame, QSize size);
+    void freeScaler();
+    void scaleSlice(const AVFrame *frame, QImage *image, const Slice &slice);
+    static void runSlices(int count, const std::function<void (int)> &job);
+
+    QVector<Slice> slices;  // swscale contexts, one per slice
+
+    /* geometry & color of frames slices were made for */
+    int srcWidth;
+    int srcHeight;
+    int srcFormat;
+    int colorspace;
+    int colorRange;
+    QSize dstSize;
+
+    int threadCount;        // slices at most, 1 converts on calling thread only
+    qint64 convertTime;     // last convert(), in microseconds
+};
+
+#endif // FRAMECONVERTER_H
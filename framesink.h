@@ -0,0 +1,22 @@
+#ifndef FRAMESINK_H
+#define FRAMESINK_H
+
+extern "C"
+{
+#include "libavutil/frame.h"
+}
+
+/* Receiver of decoded video frames, called on video decoding thread,
+ * so it must hand the frame over instead of painting it.
+ * Frames stay in decoder format (YUV420P), converted where they are shown.
+ */
+class FrameSink
+{
+public:
+    virtual ~FrameSink() {}
+
+    /* frame only valid during call, av_frame_ref() it to keep it; pts in seconds */
+    virtual void frameReady(const AVFrame *frame, double pts) = 0;
+};
+
+#endif // FRAMESINK_H
@@ -0,0 +1,285 @@
+#include <QDebug>
+#include <QOpenGLContext>
+
+#include "glvideowidget.h"
+
+/* vertex position & plane coordinate of a full viewport quad */
+static const GLfloat quadVertices[] = {
+    -1.0f, -1.0f,   0.0f, 1.0f,
+     1.0f, -1.0f,   1.0f, 1.0f,
+    -1.0f,  1.0f,   0.0f, 0.0f,
+     1.0f,  1.0f,   1.0f, 0.0f
+};
+
+static const char *vertexShader =
+        "attribute vec2 position;\n"
+        "attribute vec2 texCoord;\n"
+        "varying vec2 planeCoord;\n"
+        "void main()\n"
+        "{\n"
+        "    gl_Position = vec4(position, 0.0, 1.0);\n"
+        "    planeCoord = texCoord;\n"
+        "}\n";
+
+/* textures are line size wide, planeScale crops the padding */
+static const char *fragmentShader =
+        "#ifdef GL_ES\n"
+        "precision mediump float;\n"
+        "#endif\n"
+        "varying vec2 planeCoord;\n"
+        "uniform sampler2D texY;\n"
+        "uniform sampler2D texU;\n"
+        "uniform sampler2D texV;\n"
+        "uniform vec2 planeScale;\n"
+        "uniform mat3 colorMatrix;\n"
+        "uniform vec3 colorOffset;\n"
+        "void main()\n"
+        "{\n"
+        "    vec3 yuv;\n"
+        "    yuv.x = texture2D(texY, vec2(planeCoord.x * planeScale.x, planeCoord.y)).r;\n"
+        "    yuv.y = texture2D(texU, vec2(planeCoord.x * planeScale.y, planeCoord.y)).r;\n"
+        "    yuv.z = texture2D(texV, vec2(planeCoord.x * planeScale.y, planeCoord.y)).r;\n"
+        "    gl_FragColor = vec4(colorMatrix * (yuv - colorOffset), 1.0);\n"
+        "}\n";
+
+GLVideoRenderer::GLVideoRenderer() :
+    program(NULL),
+    frame(av_frame_alloc()),
+    isFrameChanged(false),
+    colorspace(-1),
+    colorRange(-1)
+{
+    for (int i = 0; i < 3; i++) {
+        textures[i] = 0;
+        textureWidth[i] = 0;
+        textureHeight[i] = 0;
+    }
+}
+
+/* GL objects freed by release() before, while context was current */
+GLVideoRenderer::~GLVideoRenderer()
+{
+    av_frame_free(&frame);
+}
+
+/* shader & textures in current context, false if shader fails */
+bool GLVideoRenderer::init()
+{
+    initializeOpenGLFunctions();
+
+    program = new QOpenGLShaderProgram;
+    if (!program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShader)
+            || !program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShader)
+            || !program->link()) {
+        qDebug() << "OpenGL video shader failed:" << program->log();
+        delete program;
+        program = NULL;
+        return false;
+    }
+
+    glGenTextures(3, textures);
+    for (int i = 0; i < 3; i++) {
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        /* scaling by linear sampling */
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    return true;
+}
+
+void GLVideoRenderer::release()
+{
+    if (!program) {
+        return;
+    }
+
+    glDeleteTextures(3, textures);
+    delete program;
+    program = NULL;
+}
+
+/* frame referenced, YUV420P only */
+void GLVideoRenderer::setFrame(const AVFrame *frame)
+{
+    av_frame_unref(this->frame);
+    av_frame_ref(this->frame, frame);
+    isFrameChanged = true;
+}
+
+bool GLVideoRenderer::hasFrame()
+{
+    return frame->data[0] != NULL;
+}
+
+/* planes uploaded with their line size, ES 2.0 has no GL_UNPACK_ROW_LENGTH */
+void GLVideoRenderer::uploadPlanes()
+{
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for (int i = 0; i < 3; i++) {
+        int width = frame->linesize[i];
+        int height = (i == 0) ? frame->height : (frame->height + 1) / 2;
+
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+
+        if (width != textureWidth[i] || height != textureHeight[i]) {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width, height, 0,
+                         GL_LUMINANCE, GL_UNSIGNED_BYTE, frame->data[i]);
+            textureWidth[i] = width;
+            textureHeight[i] = height;
+        } else {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+                            GL_LUMINANCE, GL_UNSIGNED_BYTE, frame->data[i]);
+        }
+    }
+}
+
+/* BT.601 or BT.709 matrix, limited range expanded to full */
+void GLVideoRenderer::updateColorMatrix()
+{
+    if (frame->colorspace == colorspace && frame->color_range == colorRange) {
+        return;
+    }
+    colorspace = frame->colorspace;
+    colorRange = frame->color_range;
+
+    bool isBt709 = (colorspace == AVCOL_SPC_BT709);
+    float kr = isBt709 ? 0.2126f : 0.299f;
+    float kb = isBt709 ? 0.0722f : 0.114f;
+    float kg = 1.0f - kr - kb;
+
+    bool isFullRange = (colorRange == AVCOL_RANGE_JPEG);
+    float yScale = isFullRange ? 1.0f : 255.0f / 219.0f;
+    float cScale = isFullRange ? 1.0f : 255.0f / 224.0f;
+
+    const float values[] = {
+        yScale, 0.0f,                                   cScale * 2.0f * (1.0f - kr),
+        yScale, -cScale * 2.0f * kb * (1.0f - kb) / kg, -cScale * 2.0f * kr * (1.0f - kr) / kg,
+        yScale, cScale * 2.0f * (1.0f - kb),            0.0f
+    };
+
+    colorMatrix = QMatrix3x3(values);
+    colorOffset = QVector3D(isFullRange ? 0.0f : 16.0f / 255.0f, 128.0f / 255.0f, 128.0f / 255.0f);
+}
+
+/* frame into area of current framebuffer, in device pixels */
+void GLVideoRenderer::render(QSize area, bool isKeepAspectRatio)
+{
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    if (!program || !frame->data[0]) {
+        return;
+    }
+
+    if (isFrameChanged) {
+        uploadPlanes();
+        updateColorMatrix();
+        isFrameChanged = false;
+    }
+
+    /* letterbox inside area */
+    QSize size = area;
+    if (isKeepAspectRatio) {
+        size = QSize(frame->width, frame->height).scaled(area, Qt::KeepAspectRatio);
+    }
+    glViewport((area.width() - size.width()) / 2, (area.height() - size.height()) / 2,
+               size.width(), size.height());
+
+    program->bind();
+
+    for (int i = 0; i < 3; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+    }
+    program->setUniformValue("texY", 0);
+    program->setUniformValue("texU", 1);
+    program->setUniformValue("texV", 2);
+    program->setUniformValue("planeScale",
+                             static_cast<GLfloat>(frame->width) / frame->linesize[0],
+                             static_cast<GLfloat>((frame->width + 1) / 2) / frame->linesize[1]);
+    program->setUniformValue("colorMatrix", colorMatrix);
+    program->setUniformValue("colorOffset", colorOffset);
+
+    program->enableAttributeArray("position");
+    program->enableAttributeArray("texCoord");
+    program->setAttributeArray("position", GL_FLOAT, quadVertices, 2, 4 * sizeof(GLfloat));
+    program->setAttributeArray("texCoord", GL_FLOAT, quadVertices + 2, 2, 4 * sizeof(GLfloat));
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    program->disableAttributeArray("position");
+    program->disableAttributeArray("texCoord");
+    program->release();
+}
+
+GLVideoWidget::GLVideoWidget(QWidget *parent) :
+    QOpenGLWidget(parent),
+    isKeepAspectRatio(false)
+{
+
+}
+
+GLVideoWidget::~GLVideoWidget()
+{
+    makeCurrent();
+    renderer.release();
+    doneCurrent();
+}
+
+/* OpenGL 2.0 context can be made, hardware or software rasterizer */
+bool GLVideoWidget::isSupported()
+{
+    QOpenGLContext context;
+
+    if (!context.create()) {
+        qDebug() << "OpenGL context create failed.";
+        return false;
+    }
+
+    QSurfaceFormat format = context.format();
+    if (!context.isOpenGLES() && format.majorVersion() < 2) {
+        qDebug() << "OpenGL" << format.majorVersion() << "." << format.minorVersion() << "too old.";
+        return false;
+    }
+
+    return true;
+}
+
+/* frame referenced, YUV420P only */
+void GLVideoWidget::setFrame(const AVFrame *frame)
+{
+    if (frame->format != AV_PIX_FMT_YUV420P) {
+        qDebug() << "OpenGL video not supported format:" << frame->format;
+        return;
+    }
+
+    renderer.setFrame(frame);
+
+    update();
+}
+
+void GLVideoWidget::setKeepAspectRatio(bool keep)
+{
+    isKeepAspectRatio = keep;
+    update();
+}
+
+void GLVideoWidget::initializeGL()
+{
+    /* nothing drawn after, window paints frames itself */
+    if (!renderer.init()) {
+        emit initFailed();
+    }
+}
+
+void GLVideoWidget::paintGL()
+{
+    qreal ratio = devicePixelRatioF();
+    renderer.render(QSize(width() * ratio, height() * ratio), isKeepAspectRatio);
+}
@@ -0,0 +1,79 @@
+#ifndef GLVIDEOWIDGET_H
+#define GLVIDEOWIDGET_H
+
+#include <QOpenGLWidget>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QMatrix3x3>
+#include <QVector3D>
+#include <QSize>
+
+extern "C"
+{
+#include "libavutil/frame.h"
+}
+
+/* Draws YUV420P frames into current OpenGL context. Y, U & V planes are
+ * uploaded as textures, color conversion & scaling done by fragment shader.
+ * Needs only OpenGL 2.0 / ES 2.0, so Mesa llvmpipe runs it too. Shared by
+ * video widget & offscreen self-test, all calls with the context current.
+ */
+class GLVideoRenderer : protected QOpenGLFunctions
+{
+public:
+    explicit GLVideoRenderer();
+    ~GLVideoRenderer();
+
+    bool init();
+    void release();
+
+    void setFrame(const AVFrame *frame);
+    bool hasFrame();
+    void render(QSize area, bool isKeepAspectRatio);
+
+private:
+    void uploadPlanes();
+    void updateColorMatrix();
+
+    QOpenGLShaderProgram *program;
+    GLuint textures[3];
+    int textureWidth[3];        // uploaded line size, wider than plane for padded frames
+    int textureHeight[3];
+
+    AVFrame *frame;             // frame shown
+    bool isFrameChanged;        // frame not uploaded yet
+
+    int colorspace;             // of frame colorMatrix is made for
+    int colorRange;
+    QMatrix3x3 colorMatrix;     // rgb = colorMatrix * (yuv - colorOffset)
+    QVector3D colorOffset;
+};
+
+/* Video surface drawing frames with OpenGL. Used on gui thread only. */
+class GLVideoWidget : public QOpenGLWidget
+{
+    Q_OBJECT
+
+public:
+    explicit GLVideoWidget(QWidget *parent = nullptr);
+    ~GLVideoWidget();
+
+    static bool isSupported();
+
+    void setFrame(const AVFrame *frame);
+    void setKeepAspectRatio(bool keep);
+
+protected:
+    void initializeGL();
+    void paintGL();
+
+private:
+    GLVideoRenderer renderer;
+    bool isKeepAspectRatio;
+
+signals:
+    void initFailed();
+
+};
+
+#endif // GLVIDEOWIDGET_H
@@ -0,0 +1,519 @@
+#include <QDebug>
+#include <QDir>
+#include <QDataStream>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QMultiMap>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QNetworkReply>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+extern "C"
+{
+#include "libavutil/time.h"
+}
+
+#include "httprangeio.h"
+
+/* Size of one range request, in bytes. */
+#define HTTP_CHUNK_SIZE (1024 * 1024)
+/* Range requests in flight at most. */
+#define HTTP_PARALLEL_REQUESTS 4
+/* Chunks fetched ahead of read position. */
+#define HTTP_READAHEAD_CHUNKS 16
+/* Retries of a failed chunk before reading fails. */
+#define HTTP_MAX_RETRIES 3
+/* Interval to check demuxer interrupt while waiting for data, in ms. */
+#define HTTP_WAIT_INTERVAL 10
+/* Increase while cache map layout changes, old maps are ignored. */
+#define HTTP_CACHE_MAP_VERSION 1
+/* Disk used by cached files at most, least recently used removed first, in bytes. */
+#define HTTP_CACHE_MAX_SIZE (2048LL * 1024 * 1024)
+
+HttpFetcher::HttpFetcher(HttpRangeIO *io) :
+    io(io),
+    manager(NULL),
+    busyStart(0),
+    isStopping(false)
+{
+
+}
+
+/* runs on network thread, probe size & range support by first chunk */
+void HttpFetcher::start()
+{
+    manager = new QNetworkAccessManager(this);
+
+    QNetworkReply *reply = request(0);
+    replies.insert(reply, 0);
+    connect(reply, SIGNAL(metaDataChanged()), this, SLOT(probeMetaData()));
+    connect(reply, SIGNAL(finished()), this, SLOT(probeFinished()));
+}
+
+void HttpFetcher::stop()
+{
+    isStopping = true;
+
+    QList<QNetworkReply *> list = replies.keys();
+    foreach (QNetworkReply *reply, list) {
+        reply->abort();
+        reply->deleteLater();
+    }
+    replies.clear();
+
+    delete manager;
+    manager = NULL;
+
+    cacheFile.close();
+}
+
+QNetworkReply *HttpFetcher::request(qint64 chunk)
+{
+    qint64 offset = chunk * HTTP_CHUNK_SIZE;
+    qint64 end = offset + HTTP_CHUNK_SIZE - 1;
+
+    if (io->fileSize > 0 && end >= io->fileSize) {
+        end = io->fileSize - 1;
+    }
+
+    QNetworkRequest request(io->url);
+    request.setRawHeader("Range", QString("bytes=%1-%2").arg(offset).arg(end).toLatin1());
+    request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+
+    if (replies.isEmpty()) {
+        busyStart = av_gettime_relative();
+    }
+
+    return manager->get(request);
+}
+
+/* source time counts while any request in flight */
+void HttpFetcher::finishBusy()
+{
+    if (replies.isEmpty()) {
+        io->stats.sourceTime += av_gettime_relative() - busyStart;
+    }
+}
+
+void HttpFetcher::fail(int error)
+{
+    SDL_LockMutex(io->mutex);
+    io->error = error;
+    SDL_CondBroadcast(io->cond);
+    SDL_UnlockMutex(io->mutex);
+}
+
+/* headers arrive before body, server ignoring Range would send whole file, stop it right away */
+void HttpFetcher::probeMetaData()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    /* redirects are followed, their headers come first */
+    if (isStopping || status == 206 || (status >= 300 && status < 400)) {
+        return;
+    }
+
+    qDebug() << "Http range request not supported, status:" << status;
+
+    /* abort() emits finished() at once */
+    disconnect(reply, 0, this, 0);
+    replies.remove(reply);
+    reply->abort();
+    reply->deleteLater();
+    finishBusy();
+
+    fail(AVERROR(ENOSYS));
+}
+
+void HttpFetcher::probeFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    replies.remove(reply);
+    reply->deleteLater();
+    finishBusy();
+
+    if (isStopping) {
+        return;
+    }
+
+    /* "bytes 0-1048575/123456789" */
+    QString range = reply->rawHeader("Content-Range");
+    qint64 size = range.mid(range.lastIndexOf('/') + 1).toLongLong();
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    if (reply->error() != QNetworkReply::NoError || status != 206 || size <= 0) {
+        qDebug() << "Http range request not supported, status:" << status << reply->errorString();
+        fail(AVERROR(ENOSYS));
+        return;
+    }
+
+    QString validator = reply->rawHeader("ETag");
+    if (validator.isEmpty()) {
+        validator = reply->rawHeader("Last-Modified");
+    }
+
+    SDL_LockMutex(io->mutex);
+    io->prepareCache(size, validator);
+    SDL_UnlockMutex(io->mutex);
+
+    cacheFile.setFileName(io->cachePath);
+    if (!cacheFile.open(QIODevice::ReadWrite) || !cacheFile.resize(size)) {
+        qDebug() << "Http cache file open failed:" << io->cachePath;
+        fail(AVERROR(EIO));
+        return;
+    }
+
+    QByteArray data = reply->readAll();
+    cacheFile.seek(0);
+    cacheFile.write(data);
+    cacheFile.flush();
+
+    SDL_LockMutex(io->mutex);
+    io->fetched.setBit(0);
+    io->stats.sourceBytes += data.size();
+    io->isProbed = true;
+    SDL_CondBroadcast(io->cond);
+    SDL_UnlockMutex(io->mutex);
+
+    fill();
+}
+
+/* keep requests in flight for missing chunks from read position on */
+void HttpFetcher::fill()
+{
+    if (isStopping || !manager) {
+        return;
+    }
+
+    SDL_LockMutex(io->mutex);
+    qint64 wanted = io->wantedChunk;
+    QBitArray fetched = io->fetched;
+    SDL_UnlockMutex(io->mutex);
+
+    qint64 last = qMin(wanted + HTTP_READAHEAD_CHUNKS, static_cast<qint64>(fetched.size()));
+
+    /* read position jumped away, these are no use soon */
+    QList<QNetworkReply *> list = replies.keys();
+    foreach (QNetworkReply *reply, list) {
+        qint64 chunk = replies.value(reply);
+        if (chunk < wanted || chunk >= last) {
+            reply->abort();
+        }
+    }
+
+    for (qint64 chunk = wanted; chunk < last && replies.size() < HTTP_PARALLEL_REQUESTS; chunk++) {
+        if (fetched.testBit(chunk) || !replies.keys(chunk).isEmpty()) {
+            continue;
+        }
+
+        QNetworkReply *reply = request(chunk);
+        replies.insert(reply, chunk);
+        connect(reply, SIGNAL(finished()), this, SLOT(chunkFinished()));
+    }
+}
+
+void HttpFetcher::chunkFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    if (!replies.contains(reply)) {
+        return;
+    }
+
+    qint64 chunk = replies.take(reply);
+    reply->deleteLater();
+    finishBusy();
+
+    if (isStopping || reply->error() == QNetworkReply::OperationCanceledError) {
+        return;
+    }
+
+    qint64 offset = chunk * HTTP_CHUNK_SIZE;
+    qint64 length = qMin(static_cast<qint64>(HTTP_CHUNK_SIZE), io->fileSize - offset);
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    QByteArray data = reply->readAll();
+
+    if (reply->error() != QNetworkReply::NoError || status != 206 || data.size() != length) {
+        qDebug() << "Http chunk" << chunk << "failed, status:" << status << reply->errorString();
+
+        if (++retries[chunk] > HTTP_MAX_RETRIES) {
+            fail(AVERROR(EIO));
+            return;
+        }
+
+        fill();
+        return;
+    }
+
+    cacheFile.seek(offset);
+    cacheFile.write(data);
+    cacheFile.flush();
+
+    SDL_LockMutex(io->mutex);
+    io->fetched.setBit(chunk);
+    io->stats.sourceBytes += data.size();
+    SDL_CondBroadcast(io->cond);
+    SDL_UnlockMutex(io->mutex);
+
+    fill();
+}
+
+HttpRangeIO::HttpRangeIO() :
+    fetcher(NULL),
+    fileSize(0),
+    pos(0),
+    wantedChunk(0),
+    isProbed(false),
+    error(0)
+{
+    mutex = SDL_CreateMutex();
+    cond  = SDL_CreateCond();
+}
+
+HttpRangeIO::~HttpRangeIO()
+{
+    if (netThread.isRunning()) {
+        QMetaObject::invokeMethod(fetcher, "stop", Qt::BlockingQueuedConnection);
+        netThread.quit();
+        netThread.wait();
+    }
+
+    delete fetcher;
+
+    if (isProbed) {
+        saveCacheMap();
+    }
+
+    SDL_DestroyCond(cond);
+    SDL_DestroyMutex(mutex);
+}
+
+QString HttpRangeIO::name()
+{
+    return "Http range";
+}
+
+int HttpRangeIO::open(QString file, const AVIOInterruptCB *interrupt)
+{
+    if (interrupt) {
+        interruptCallback = *interrupt;
+    }
+
+    url = QUrl(file);
+    if (!url.isValid() || (url.scheme() != "http" && url.scheme() != "https")) {
+        return AVERROR(EINVAL);
+    }
+
+    QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/http";
+    if (!QDir().mkpath(cacheDir)) {
+        return AVERROR(EIO);
+    }
+    cachePath = cacheDir + "/" + QCryptographicHash::hash(file.toUtf8(), QCryptographicHash::Sha1).toHex() + ".part";
+    trimCache(cacheDir);
+
+    fetcher = new HttpFetcher(this);
+    fetcher->moveToThread(&netThread);
+    netThread.start();
+    QMetaObject::invokeMethod(fetcher, "start", Qt::QueuedConnection);
+
+    SDL_LockMutex(mutex);
+    while (!isProbed && error == 0) {
+        if (isInterrupted()) {
+            error = AVERROR_EXIT;
+            break;
+        }
+        SDL_CondWaitTimeout(cond, mutex, HTTP_WAIT_INTERVAL);
+    }
+    int ret = error;
+    SDL_UnlockMutex(mutex);
+
+    if (ret < 0) {
+        return ret;
+    }
+
+    /* network thread writes chunks through its own handle after we read around them,
+     * a read buffer would keep zeros of a hole filled since
+     */
+    cacheFile.setFileName(cachePath);
+    if (!cacheFile.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        return AVERROR(EIO);
+    }
+
+    return 0;
+}
+
+/* cache files are sparse, only fetched chunks take disk */
+static qint64 diskUsage(QString path)
+{
+#ifdef Q_OS_UNIX
+    struct stat st;
+    if (stat(QFile::encodeName(path).constData(), &st) == 0) {
+        return static_cast<qint64>(st.st_blocks) * 512;
+    }
+#endif
+
+    return QFileInfo(path).size();
+}
+
+/* remove least recently used cached files until rest fits HTTP_CACHE_MAX_SIZE,
+ * map is rewritten on every close, so its time is last use
+ */
+void HttpRangeIO::trimCache(QString cacheDir)
+{
+    QMultiMap<QDateTime, QString> byUse;
+    qint64 total = 0;
+
+    foreach (QFileInfo part, QDir(cacheDir).entryInfoList(QStringList("*.part"), QDir::Files)) {
+        QFileInfo map(part.filePath() + ".map");
+
+        total += diskUsage(part.filePath());
+        byUse.insert(map.exists() ? map.lastModified() : part.lastModified(), part.filePath());
+    }
+
+    for (QMultiMap<QDateTime, QString>::iterator it = byUse.begin(); it != byUse.end() && total > HTTP_CACHE_MAX_SIZE; ++it) {
+        if (it.value() == cachePath) {
+            continue;
+        }
+
+        qint64 used = diskUsage(it.value());
+
+        if (QFile::remove(it.value())) {
+            QFile::remove(it.value() + ".map");
+            total -= used;
+            qDebug() << "Http cache removed:" << it.value();
+        }
+    }
+}
+
+/* called on network thread with mutex locked, reuse ranges fetched before if content unchanged */
+void HttpRangeIO::prepareCache(qint64 size, QString validator)
+{
+    QString cachedUrl;
+    QString cachedValidator;
+    qint64 cachedSize = 0;
+    qint32 version = 0;
+    QBitArray cachedFetched;
+
+    fileSize = size;
+    this->validator = validator;
+    fetched = QBitArray((size + HTTP_CHUNK_SIZE - 1) / HTTP_CHUNK_SIZE);
+
+    QFile map(cachePath + ".map");
+    if (validator.isEmpty() || !QFile::exists(cachePath) || !map.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QDataStream in(&map);
+    in >> version >> cachedUrl >> cachedSize >> cachedValidator >> cachedFetched;
+
+    if (in.status() == QDataStream::Ok && version == HTTP_CACHE_MAP_VERSION && cachedUrl == url.toString()
+            && cachedSize == size && cachedValidator == validator && cachedFetched.size() == fetched.size()) {
+        fetched = cachedFetched;
+        qDebug() << "Http cache reused," << fetched.count(true) << "of" << fetched.size() << "chunks";
+    }
+}
+
+void HttpRangeIO::saveCacheMap()
+{
+    QFile map(cachePath + ".map");
+    if (!map.open(QIODevice::WriteOnly)) {
+        return;
+    }
+
+    QDataStream out(&map);
+    out << static_cast<qint32>(HTTP_CACHE_MAP_VERSION) << url.toString() << fileSize << validator << fetched;
+}
+
+int HttpRangeIO::read(uint8_t *buf, int size)
+{
+    qint64 stallStart = 0;
+
+    if (pos >= fileSize) {
+        return AVERROR_EOF;
+    }
+
+    qint64 chunk = pos / HTTP_CHUNK_SIZE;
+
+    SDL_LockMutex(mutex);
+
+    if (wantedChunk != chunk) {
+        wantedChunk = chunk;
+        QMetaObject::invokeMethod(fetcher, "fill", Qt::QueuedConnection);
+    }
+
+    while (!fetched.testBit(chunk)) {
+        if (error < 0) {
+            SDL_UnlockMutex(mutex);
+            return error;
+        }
+
+        if (isInterrupted()) {
+            SDL_UnlockMutex(mutex);
+            return AVERROR_EXIT;
+        }
+
+        if (stallStart == 0) {
+            stallStart = av_gettime_relative();
+        }
+
+        SDL_CondWaitTimeout(cond, mutex, HTTP_WAIT_INTERVAL);
+    }
+
+    SDL_UnlockMutex(mutex);
+
+    if (stallStart > 0) {
+        stats.stallTime += av_gettime_relative() - stallStart;
+    }
+
+    qint64 len = qMin(static_cast<qint64>(size), qMin((chunk + 1) * HTTP_CHUNK_SIZE, fileSize) - pos);
+
+    if (!cacheFile.seek(pos) || (len = cacheFile.read(reinterpret_cast<char *>(buf), len)) <= 0) {
+        return AVERROR(EIO);
+    }
+    pos += len;
+
+    return static_cast<int>(len);
+}
+
+int64_t HttpRangeIO::seek(int64_t offset, int whence)
+{
+    qint64 target;
+
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return fileSize;
+    case SEEK_SET:
+        target = offset;
+        break;
+    case SEEK_CUR:
+        target = pos + offset;
+        break;
+    case SEEK_END:
+        target = fileSize + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+
+    if (target < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    stats.seeks++;
+
+    SDL_LockMutex(mutex);
+    if (target < fileSize && fetched.testBit(target / HTTP_CHUNK_SIZE)) {
+        stats.seeksInBuffer++;
+    }
+    SDL_UnlockMutex(mutex);
+
+    pos = target;
+
+    return pos;
+}
@@ -0,0 +1,94 @@
+#ifndef HTTPRANGEIO_H
+#define HTTPRANGEIO_H
+
+#include <QObject>
+#include <QThread>
+#include <QFile>
+#include <QBitArray>
+#include <QHash>
+#include <QUrl>
+
+#include "SDL2/SDL.h"
+
+#include "mediaio.h"
+
+class QNetworkAccessManager;
+class QNetworkReply;
+class HttpRangeIO;
+
+/* Network side of HttpRangeIO, lives on its own thread with event loop. */
+class HttpFetcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit HttpFetcher(HttpRangeIO *io);
+
+public slots:
+    void start();
+    void stop();
+    void fill();
+
+private slots:
+    void probeMetaData();
+    void probeFinished();
+    void chunkFinished();
+
+private:
+    QNetworkReply *request(qint64 chunk);
+    void finishBusy();
+    void fail(int error);
+
+    HttpRangeIO *io;
+    QNetworkAccessManager *manager;
+    QFile cacheFile;                    // write side of sparse cache file
+    QHash<QNetworkReply *, qint64> replies; // requests in flight & their chunk
+    QHash<qint64, int> retries;
+    qint64 busyStart;                   // time requests in flight went from none to some
+    bool isStopping;
+};
+
+/* Fetch progressive http file by parallel range requests ahead of read position,
+ * fetched ranges kept in sparse cache file, so seeking back into them is instant.
+ * Cache files together are kept under a size cap, least recently used go first.
+ */
+class HttpRangeIO : public MediaIO
+{
+public:
+    explicit HttpRangeIO();
+    ~HttpRangeIO();
+
+    int open(QString file, const AVIOInterruptCB *interrupt);
+    QString name();
+
+protected:
+    int read(uint8_t *buf, int size);
+    int64_t seek(int64_t offset, int whence);
+
+private:
+    friend class HttpFetcher;
+
+    void trimCache(QString cacheDir);
+    void prepareCache(qint64 size, QString validator);
+    void saveCacheMap();
+
+    QUrl url;
+    QString cachePath;
+    QFile cacheFile;        // read side of sparse cache file
+
+    QThread netThread;
+    HttpFetcher *fetcher;
+
+    qint64 fileSize;
+    qint64 pos;
+    QString validator;      // ETag or Last-Modified of cached content
+    QBitArray fetched;      // chunks stored in cache file
+    qint64 wantedChunk;     // chunk at read position, requests start from it
+    bool isProbed;
+    int error;
+
+    SDL_mutex *mutex;
+    SDL_cond *cond;         // signalled on fetched chunk, probe & error
+};
+
+#endif // HTTPRANGEIO_H
@@ -0,0 +1,107 @@
+#include "jitterbuffer.h"
+
+/* Default live latency target, in ms. */
+#define JITTER_DEFAULT_LATENCY 200
+/* Target never grows more than this times of configured latency. */
+#define JITTER_MAX_TARGET_SCALE 4
+/* Drop buffered data while latency exceeds target by this, in ms. */
+#define JITTER_DROP_EXCESS 1000
+
+JitterBuffer::JitterBuffer() :
+    configuredLatency(JITTER_DEFAULT_LATENCY)
+{
+    reset();
+}
+
+void JitterBuffer::reset()
+{
+    targetLatency = configuredLatency;
+    latency = 0;
+
+    lastPts = 0;
+    lastArrival = 0;
+    jitter = 0;
+
+    isSpeedUp = false;
+
+    /* prebuffer before playing starts */
+    hold();
+}
+
+/* stop playing position until target latency is buffered again */
+void JitterBuffer::hold()
+{
+    isHolding = true;
+    holdPts = -1;
+}
+
+void JitterBuffer::setTargetLatency(int ms)
+{
+    configuredLatency = ms;
+    targetLatency = ms;
+}
+
+/* estimate interarrival jitter like RTP receiver does (RFC 3550) */
+void JitterBuffer::packetArrived(double pts, qint64 time)
+{
+    if (lastArrival > 0 && pts > lastPts) {
+        double transit = (time - lastArrival) / 1000000.0 - (pts - lastPts);
+        jitter += (qAbs(transit) - jitter) / 16;
+
+        /* keep three times of jitter buffered, so late packets still in time */
+        int wanted = static_cast<int>(jitter * 3 * 1000);
+        targetLatency = qBound(configuredLatency, wanted, configuredLatency * JITTER_MAX_TARGET_SCALE);
+    }
+
+    if (isHolding && holdPts < 0) {
+        holdPts = pts;
+    }
+
+    if (pts > lastPts || lastArrival == 0) {
+        lastPts = pts;
+        lastArrival = time;
+    }
+}
+
+JitterBuffer::Action JitterBuffer::update(double clock)
+{
+    /* nothing played since drop or start, buffered from first packet held */
+    double position = (clock > 0) ? clock : holdPts;
+
+    if (lastArrival == 0 || position < 0) {
+        return isHolding ? HOLD : KEEP;
+    }
+
+    latency = static_cast<int>((lastPts - position) * 1000);
+
+    if (latency > qMax(targetLatency * 3, targetLatency + JITTER_DROP_EXCESS)) {
+        isSpeedUp = false;
+        return DROP;
+    }
+
+    if (isHolding) {
+        if (latency < targetLatency) {
+            return HOLD;
+        }
+        isHolding = false;
+    }
+
+    /* hysteresis, speed up from 1.5 times target until target reached */
+    if (latency > targetLatency * 3 / 2) {
+        isSpeedUp = true;
+    } else if (latency <= targetLatency) {
+        isSpeedUp = false;
+    }
+
+    return isSpeedUp ? SPEEDUP : KEEP;
+}
+
+int JitterBuffer::getLatency()
+{
+    return latency;
+}
+
+int JitterBuffer::getTargetLatency()
+{
+    return targetLatency;
+}
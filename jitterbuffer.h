@@ -0,0 +1,45 @@
+#ifndef JITTERBUFFER_H
+#define JITTERBUFFER_H
+
+#include <QtGlobal>
+
+/* Keep latency of live stream near target, by measuring data buffered
+ * between newest received packet & playing position. Playing is held
+ * at start & after underrun or drop until target latency is buffered.
+ */
+class JitterBuffer
+{
+public:
+    enum Action {
+        KEEP,       // latency is fine
+        HOLD,       // prebuffering, keep playing position still
+        SPEEDUP,    // latency grows, play faster to catch up
+        DROP        // too far behind, drop buffered data & jump to live
+    };
+
+    explicit JitterBuffer();
+
+    void reset();
+    void setTargetLatency(int ms);
+    void hold();
+    void packetArrived(double pts, qint64 time);
+    JitterBuffer::Action update(double clock);
+
+    int getLatency();
+    int getTargetLatency();
+
+private:
+    int configuredLatency;  // latency wanted by user, in ms
+    int targetLatency;      // configured latency raised by network jitter, in ms
+    int latency;            // current buffered latency, in ms
+
+    double lastPts;         // newest received pts, in seconds
+    qint64 lastArrival;     // arrival time of newest pts, in microseconds
+    double jitter;          // smoothed interarrival jitter, in seconds
+
+    bool isSpeedUp;
+    bool isHolding;
+    double holdPts;         // first pts received while held & nothing played, -1 for none yet
+};
+
+#endif // JITTERBUFFER_H
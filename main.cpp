@@ -2,10 +2,22 @@
 #include <QTextCodec>
 
 #include "mainwindow.h"
+#include "bench.h"
+#include "threadpolicy.h"
 
 
 int main(int argc, char *argv[])
 {
+    /* benchmarks run without gui, OpenGL one needs a platform plugin, offscreen does */
+    if (argc > 2 && !strcmp(argv[1], "--bench") && !strcmp(argv[2], "gl")) {
+        QGuiApplication app(argc, argv);
+        return Bench::run(app.arguments().mid(2));
+    }
+    if (argc > 1 && !strcmp(argv[1], "--bench")) {
+        QCoreApplication app(argc, argv);
+        return Bench::run(app.arguments().mid(2));
+    }
+
     QApplication a(argc, argv);
 
     QTextCodec *codec = QTextCodec::codecForName("UTF-8");
@@ -14,7 +26,34 @@ int main(int argc, char *argv[])
 
     a.setFont(QFont("Microsoft YaHei"));
 
+    /* --sched video=fifo:10,audio=rr:20,demux=nice:-5 & --affinity video=2+3,audio=1,
+     * applied by each pipeline thread when it starts, gui thread presents frames
+     */
+    int schedArg = a.arguments().indexOf("--sched");
+    if (schedArg > 0 && schedArg + 1 < a.arguments().size()) {
+        ThreadPolicy::parseScheduling(a.arguments().at(schedArg + 1));
+    }
+
+    int affinityArg = a.arguments().indexOf("--affinity");
+    if (affinityArg > 0 && affinityArg + 1 < a.arguments().size()) {
+        ThreadPolicy::parseAffinity(a.arguments().at(affinityArg + 1));
+    }
+
+    ThreadPolicy::apply(ThreadPolicy::ROLE_PRESENT);
+
     MainWindow w;
+
+    /* --shm <name>: publish frames to shared memory for other processes */
+    int shmArg = a.arguments().indexOf("--shm");
+    if (shmArg > 0 && shmArg + 1 < a.arguments().size()) {
+        w.setShmOutput(a.arguments().at(shmArg + 1));
+    }
+
+    /* --gl: video drawn by OpenGL, color conversion & scaling on gpu */
+    if (a.arguments().contains("--gl")) {
+        w.setOpenGLVideo();
+    }
+
     w.show();
 
     return a.exec();
@@ -11,31 +11,43 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
-extern "C"
-{
-#include "libavformat/avformat.h"
-}
-
 #define VOLUME_INT  (13)
+/* preload next file while current file left time less than it, in seconds */
+#define PRELOAD_TIME (5)
+/* slots of shared memory frame output, a reader has this many frames less one to copy one */
+#define SHM_OUTPUT_SLOTS (3)
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow),
-    decoder(new Decoder),
+    player(NULL),
+    shmSink(NULL),
+    thumbnailer(new Thumbnailer),
+    thumbnailTime(0),
     menuTimer(new QTimer),
     progressTimer(new QTimer),
     menuIsVisible(true),
     isKeepAspectRatio(false),
     image(QImage(":/image/MUSIC.jpg")),
+    frame(av_frame_alloc()),
+    isFrameChanged(false),
+    paintFrame(av_frame_alloc()),
+    isImageValid(false),
+    videoWidget(NULL),
     autoPlay(true),
     loopPlay(false),
+    gaplessPlay(true),
     closeNotExit(false),
-    playState(Decoder::STOP),
+    playState(PlayerCore::STATE_STOPPED),
     seekInterval(15)
 {
     ui->setupUi(this);
 
-    qRegisterMetaType<Decoder::PlayState>("Decoder::PlayState");
+    qRegisterMetaType<PlayerCore::State>("PlayerCore::State");
+
+    /* libraries initialized before player opens anything */
+    initFFmpeg();
+    player = new PlayerCore;
 
     menuTimer->setInterval(8000);
     menuTimer->start(5000);
@@ -45,14 +57,28 @@ MainWindow::MainWindow(QWidget *parent) :
     initUI();
     initTray();
     initSlot();
-    initFFmpeg();
 }
 
 MainWindow::~MainWindow()
 {
+    delete player;
+    delete shmSink;
+    av_frame_free(&frame);
+    av_frame_free(&paintFrame);
+    delete thumbnailer;
     delete ui;
 }
 
+/* frames published to shared memory by name, then painted here as before */
+void MainWindow::setShmOutput(QString name)
+{
+    player->stop();
+
+    delete shmSink;
+    shmSink = new ShmFrameSink(name, SHM_OUTPUT_SLOTS, this);
+    player->setFrameSink(shmSink);
+}
+
 void MainWindow::initUI()
 {
     this->setWindowTitle("QtPlayer");
@@ -93,26 +119,18 @@ void MainWindow::initUI()
     setHide(ui->labelTime);
 
     ui->videoProgressSlider->installEventFilter(this);
+    ui->videoProgressSlider->setMouseTracking(true);
+
+    thumbnailLabel = new QLabel(this);
+    thumbnailLabel->setStyleSheet("border: 1px solid #5FFFFFFF;");
+    thumbnailLabel->hide();
 }
 
 void MainWindow::initFFmpeg()
 {
 //    av_log_set_level(AV_LOG_INFO);
 
-    avfilter_register_all();
-
-    /* ffmpeg init */
-    av_register_all();
-
-    /* ffmpeg network init for rtsp */
-    if (avformat_network_init()) {
-        qDebug() << "avformat network init failed";
-    }
-
-    /* init sdl audio */
-    if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_TIMER)) {
-        qDebug() << "SDL init failed";
-    }
+    PlayerCore::init();
 }
 
 void MainWindow::initSlot()
@@ -129,14 +147,23 @@ void MainWindow::initSlot()
     connect(progressTimer,  SIGNAL(timeout()), this, SLOT(timerSlot()));
 
     connect(ui->videoProgressSlider,    SIGNAL(sliderMoved(int)), this, SLOT(seekProgress(int)));
-
-    connect(this, SIGNAL(selectedVideoFile(QString,QString)),   decoder, SLOT(decoderFile(QString,QString)));
-    connect(this, SIGNAL(stopVideo()),                          decoder, SLOT(stopVideo()));
-    connect(this, SIGNAL(pauseVideo()),                         decoder, SLOT(pauseVideo()));
-
-    connect(decoder, SIGNAL(playStateChanged(Decoder::PlayState)),  this, SLOT(playStateChanged(Decoder::PlayState)));
-    connect(decoder, SIGNAL(gotVideoTime(qint64)),                  this, SLOT(videoTime(qint64)));
-    connect(decoder, SIGNAL(gotVideo(QImage)),                      this, SLOT(showVideo(QImage)));
+    connect(ui->videoProgressSlider,    SIGNAL(sliderReleased()), this, SLOT(seekRelease()));
+
+    /* player calls back on decoder threads, hand over to gui thread */
+    PlayerCore::Callbacks callbacks;
+    callbacks.stateChanged = [this](PlayerCore::State state) {
+        QMetaObject::invokeMethod(this, "playStateChanged", Qt::QueuedConnection, Q_ARG(PlayerCore::State, state));
+    };
+    callbacks.durationChanged = [this](qint64 duration) {
+        QMetaObject::invokeMethod(this, "videoTime", Qt::QueuedConnection, Q_ARG(qint64, duration));
+    };
+    callbacks.fileChanged = [this](QString file) {
+        QMetaObject::invokeMethod(this, "playingFileChanged", Qt::QueuedConnection, Q_ARG(QString, file));
+    };
+    player->setCallbacks(callbacks);
+    player->setFrameSink(this);
+
+    connect(thumbnailer, SIGNAL(gotThumbnail(QString,qint64)),      this, SLOT(gotThumbnail(QString,qint64)));
 }
 
 void MainWindow::initTray()
@@ -182,7 +209,30 @@ void MainWindow::paintEvent(QPaintEvent *event)
     painter.setBrush(Qt::black);
     painter.drawRect(0, 0, width, height);
 
-    if (isKeepAspectRatio) {
+    /* video drawn by OpenGL surface above, frames handed to it by showFrame() */
+    if (videoWidget) {
+        if (videoWidget->isVisible()) {
+            return;
+        }
+    } else {
+        takeFrame();
+    }
+
+    /* converted once, straight to the size it is drawn at */
+    if (paintFrame->data[0]) {
+        QSize size(width, height);
+        if (isKeepAspectRatio) {
+            size = QSize(paintFrame->width, paintFrame->height).scaled(size, Qt::KeepAspectRatio);
+        }
+
+        if (!isImageValid || frameImage.size() != size) {
+            isImageValid = converter.convert(paintFrame, size, &frameImage);
+        }
+
+        if (isImageValid) {
+            painter.drawImage(QPoint((width - frameImage.width()) / 2, (height - frameImage.height()) / 2), frameImage);
+        }
+    } else if (isKeepAspectRatio) {
         QImage img = image.scaled(QSize(width, height), Qt::KeepAspectRatio);
 
         /* calculate display position */
@@ -197,6 +247,15 @@ void MainWindow::paintEvent(QPaintEvent *event)
     }
 }
 
+void MainWindow::resizeEvent(QResizeEvent *event)
+{
+    Q_UNUSED(event);
+
+    if (videoWidget) {
+        videoWidget->setGeometry(rect());
+    }
+}
+
 void MainWindow::closeEvent(QCloseEvent *event)
 {
     if (closeNotExit) {
@@ -232,9 +291,14 @@ bool MainWindow::eventFilter(QObject *object, QEvent *event)
                 int pos = ui->videoProgressSlider->minimum() + duration * (static_cast<double>(mouseEvent->x()) / ui->videoProgressSlider->width());
                 if (pos != ui->videoProgressSlider->sliderPosition()) {
                     ui->videoProgressSlider->setValue(pos);
-                    decoder->seekProgress(static_cast<qint64>(pos) * 1000000);
+                    player->seek(static_cast<qint64>(pos) * 1000000);
                 }
             }
+        } else if (event->type() == QEvent::MouseMove) {
+            showSliderThumbnail(static_cast<QMouseEvent *>(event)->x());
+        } else if (event->type() == QEvent::Leave) {
+            thumbnailer->cancel();
+            thumbnailLabel->hide();
         }
     }
 
@@ -244,36 +308,47 @@ bool MainWindow::eventFilter(QObject *object, QEvent *event)
 void MainWindow::keyReleaseEvent(QKeyEvent *event)
 {
     int progressVal;
-    int volumnVal = decoder->getVolume();
+    int volumnVal = player->getVolume();
 
     switch (event->key()) {
     case Qt::Key_Up:
         if (volumnVal + VOLUME_INT > SDL_MIX_MAXVOLUME) {
-            decoder->setVolume(SDL_MIX_MAXVOLUME);
+            player->setVolume(SDL_MIX_MAXVOLUME);
         } else {
-            decoder->setVolume(volumnVal + VOLUME_INT);
+            player->setVolume(volumnVal + VOLUME_INT);
         }
         break;
 
     case Qt::Key_Down:
         if (volumnVal - VOLUME_INT < 0) {
-            decoder->setVolume(0);
+            player->setVolume(0);
         } else {
-            decoder->setVolume(volumnVal - VOLUME_INT);
+            player->setVolume(volumnVal - VOLUME_INT);
         }
         break;
 
     case Qt::Key_Left:
-        if (ui->videoProgressSlider->value() > seekInterval) {
+        /* live stream rewinds inside timeshift buffer */
+        if (player->isLiveStream()) {
+            player->shiftLive(-seekInterval);
+        } else if (ui->videoProgressSlider->value() > seekInterval) {
             progressVal = ui->videoProgressSlider->value() - seekInterval;
-            decoder->seekProgress(static_cast<qint64>(progressVal) * 1000000);
+            player->seek(static_cast<qint64>(progressVal) * 1000000, false);
         }
         break;
 
     case Qt::Key_Right:
-        if (ui->videoProgressSlider->value() + seekInterval < ui->videoProgressSlider->maximum()) {
+        if (player->isLiveStream()) {
+            player->shiftLive(seekInterval);
+        } else if (ui->videoProgressSlider->value() + seekInterval < ui->videoProgressSlider->maximum()) {
             progressVal = ui->videoProgressSlider->value() + seekInterval;
-            decoder->seekProgress(static_cast<qint64>(progressVal) * 1000000);
+            player->seek(static_cast<qint64>(progressVal) * 1000000, false);
+        }
+        break;
+
+    case Qt::Key_End:
+        if (player->isLiveStream()) {
+            player->seekToLive();
         }
         break;
 
@@ -282,7 +357,7 @@ void MainWindow::keyReleaseEvent(QKeyEvent *event)
         break;
 
     case Qt::Key_Space:
-        emit pauseVideo();
+        togglePause();
         break;
 
     default:
@@ -312,7 +387,7 @@ void MainWindow::mousePressEvent(QMouseEvent *event)
     if (event->buttons() == Qt::RightButton) {
         showPlayMenu();
     } else if (event->buttons() == Qt::LeftButton) {
-        emit pauseVideo();
+        togglePause();
     }
 }
 
@@ -355,18 +430,26 @@ void MainWindow::showPlayMenu()
         loopPlayAction->setChecked(true);
     }
 
+    QAction *gaplessPlayAction = new QAction("无缝播放", this);
+    gaplessPlayAction->setCheckable(true);
+    if (gaplessPlay) {
+        gaplessPlayAction->setChecked(true);
+    }
+
     QAction *captureAction = new QAction("截图", this);
 
     connect(fullSrcAction,      SIGNAL(triggered(bool)), this, SLOT(setFullScreen()));
     connect(keepRatioAction,    SIGNAL(triggered(bool)), this, SLOT(setKeepRatio()));
     connect(autoPlayAction,     SIGNAL(triggered(bool)), this, SLOT(setAutoPlay()));
     connect(loopPlayAction,     SIGNAL(triggered(bool)), this, SLOT(setLoopPlay()));
+    connect(gaplessPlayAction,  SIGNAL(triggered(bool)), this, SLOT(setGaplessPlay()));
     connect(captureAction,      SIGNAL(triggered(bool)), this, SLOT(saveCurrentFrame()));
 
     menu->addAction(fullSrcAction);
     menu->addAction(keepRatioAction);
     menu->addAction(autoPlayAction);
     menu->addAction(loopPlayAction);
+    menu->addAction(gaplessPlayAction);
     menu->addAction(captureAction);
 
     menu->exec(QCursor::pos());
@@ -375,12 +458,14 @@ void MainWindow::showPlayMenu()
     disconnect(keepRatioAction, SIGNAL(triggered(bool)), this, SLOT(setKeepRatio()));
     disconnect(autoPlayAction,  SIGNAL(triggered(bool)), this, SLOT(setAutoPlay()));
     disconnect(loopPlayAction,  SIGNAL(triggered(bool)), this, SLOT(setLoopPlay()));
+    disconnect(gaplessPlayAction,   SIGNAL(triggered(bool)), this, SLOT(setGaplessPlay()));
     disconnect(captureAction,       SIGNAL(triggered(bool)), this, SLOT(saveCurrentFrame()));
 
     delete fullSrcAction;
     delete keepRatioAction;
     delete autoPlayAction;
     delete loopPlayAction;
+    delete gaplessPlayAction;
     delete captureAction;
     delete menu;
 }
@@ -403,11 +488,46 @@ void MainWindow::showControl(bool show)
     }
 }
 
+void MainWindow::showSliderThumbnail(int x)
+{
+    if (currentPlayType != "video" || timeTotal <= 0 || playState == PlayerCore::STATE_STOPPED) {
+        return;
+    }
+
+    QSlider *slider = ui->videoProgressSlider;
+    x = qBound(0, x, slider->width());
+
+    thumbnailTime = static_cast<qint64>(timeTotal * (static_cast<double>(x) / slider->width()) * 1000000);
+
+    QImage thumbnail;
+    if (thumbnailer->getThumbnail(currentPlay, thumbnailTime, &thumbnail)) {
+        thumbnailLabel->setPixmap(QPixmap::fromImage(thumbnail));
+        thumbnailLabel->resize(thumbnail.size());
+    } else {
+        thumbnailer->requestThumbnail(currentPlay, thumbnailTime);
+    }
+
+    /* show above slider, centered at cursor */
+    QPoint pos = slider->mapTo(this, QPoint(x, 0));
+    int left = qBound(0, pos.x() - thumbnailLabel->width() / 2, width() - thumbnailLabel->width());
+    thumbnailLabel->move(left, pos.y() - thumbnailLabel->height() - 4);
+
+    if (thumbnailLabel->pixmap() && !thumbnailLabel->pixmap()->isNull()) {
+        thumbnailLabel->show();
+        thumbnailLabel->raise();
+    }
+}
+
 inline QString MainWindow::getFilenameFromPath(QString path)
 {
     return path.right(path.size() - path.lastIndexOf("/") - 1);
 }
 
+inline PlayerCore::MediaType MainWindow::mediaType(QString type)
+{
+    return (type == "video") ? PlayerCore::MEDIA_VIDEO : PlayerCore::MEDIA_MUSIC;
+}
+
 QString MainWindow::fileType(QString file)
 {
     QString type;
@@ -442,9 +562,12 @@ void MainWindow::addPathVideoToList(QString path)
     }
 }
 
+/* opening stops current file, its decoders & audio device are reused if they match */
 void MainWindow::playVideo(QString file)
 {
-    emit stopVideo();
+    thumbnailer->cancel();
+    thumbnailLabel->clear();
+    thumbnailLabel->hide();
 
     currentPlay = file;
     currentPlayType = fileType(file);
@@ -452,6 +575,7 @@ void MainWindow::playVideo(QString file)
         menuTimer->start();
         ui->titleLable->setText("");
     } else {
+        clearFrame();
         menuTimer->stop();
         if (!menuIsVisible) {
             showControl(true);
@@ -461,7 +585,32 @@ void MainWindow::playVideo(QString file)
         ui->titleLable->setText(QString("当前播放：%1").arg(getFilenameFromPath(file)));
     }
 
-    emit selectedVideoFile(file, currentPlayType);
+    player->open(file, mediaType(currentPlayType));
+}
+
+void MainWindow::togglePause()
+{
+    if (playState == PlayerCore::STATE_PAUSED) {
+        player->play();
+    } else if (playState == PlayerCore::STATE_PLAYING) {
+        player->pause();
+    }
+}
+
+/* file played after current one finished, empty if no one */
+QString MainWindow::nextFile()
+{
+    if (loopPlay) {
+        return currentPlay;
+    }
+
+    if (!autoPlay || playList.isEmpty()) {
+        return QString();
+    }
+
+    int currentIndex = playList.indexOf(currentPlay);
+
+    return playList.at((currentIndex + 1) % playList.size());
 }
 
 void MainWindow::playNext()
@@ -542,13 +691,12 @@ void MainWindow::buttonClickSlot()
     } else if (QObject::sender() == ui->btnOpenUrl) {   // open network file
         filePath = ui->lineEdit->text();
         if (!filePath.isNull() && !filePath.isEmpty()) {
-            QString type = "video";
-            emit selectedVideoFile(filePath, type);
+            player->open(filePath, PlayerCore::MEDIA_VIDEO);
         }
     } else if (QObject::sender() == ui->btnStop) {
-        emit stopVideo();
+        player->stop();
     } else if (QObject::sender() == ui->btnPause) {
-        emit pauseVideo();
+        togglePause();
     } else if (QObject::sender() == ui->btnPreview) {
         playPreview();
     } else if (QObject::sender() == ui->btnNext) {
@@ -583,6 +731,10 @@ void MainWindow::setFullScreen()
 void MainWindow::setKeepRatio()
 {
     isKeepAspectRatio = !isKeepAspectRatio;
+
+    if (videoWidget) {
+        videoWidget->setKeepAspectRatio(isKeepAspectRatio);
+    }
 }
 
 void MainWindow::setAutoPlay()
@@ -597,16 +749,32 @@ void MainWindow::setLoopPlay()
     autoPlay = false;
 }
 
+void MainWindow::setGaplessPlay()
+{
+    gaplessPlay = !gaplessPlay;
+    player->setGapless(gaplessPlay);
+}
+
 void MainWindow::saveCurrentFrame()
 {
     QString filename = QFileDialog::getSaveFileName(this, "保存截图", "/", "(*.jpg)");
-    image.save(filename);
+
+    /* frame at its own size, not as shown */
+    if (paintFrame->data[0]) {
+        FrameConverter fullConverter;
+        QImage fullImage;
+        if (fullConverter.convert(paintFrame, QSize(paintFrame->width, paintFrame->height), &fullImage)) {
+            fullImage.save(filename);
+        }
+    } else {
+        image.save(filename);
+    }
 }
 
 void MainWindow::timerSlot()
 {
     if (QObject::sender() == menuTimer) {
-        if (menuIsVisible && playState == Decoder::PLAYING) {
+        if (menuIsVisible && playState == PlayerCore::STATE_PLAYING) {
             if (isFullScreen()) {
                 QApplication::setOverrideCursor(Qt::BlankCursor);
             }
@@ -614,8 +782,13 @@ void MainWindow::timerSlot()
             menuIsVisible = false;
         }
     } else if (QObject::sender() == progressTimer) {
-        qint64 currentTime = static_cast<qint64>(decoder->getCurrentTime());
-        ui->videoProgressSlider->setValue(currentTime);
+        PlayerCore::Stats stats = player->getStats();
+
+        qint64 currentTime = static_cast<qint64>(stats.position);
+        /* do not move slider back while user is dragging it */
+        if (!ui->videoProgressSlider->isSliderDown()) {
+            ui->videoProgressSlider->setValue(currentTime);
+        }
 
         int hourCurrent = currentTime / 60 / 60;
         int minCurrent  = (currentTime / 60) % 60;
@@ -625,6 +798,25 @@ void MainWindow::timerSlot()
         int minTotal  = (timeTotal / 60) % 60;
         int secTotal  = timeTotal % 60;
 
+        /* open next file before current one finished */
+        if (timeTotal > 0 && timeTotal - currentTime <= PRELOAD_TIME) {
+            QString next = nextFile();
+            if (!next.isEmpty() && QFile::exists(next)) {
+                player->prepareNext(next, mediaType(fileType(next)));
+            }
+        }
+
+        /* live stream has no duration, show how far behind it is playing */
+        if (stats.isLive) {
+            ui->labelTime->setText(QString("%1.%2.%3 / 直播 延迟 %4 ms 时移 %5 s")
+                                   .arg(hourCurrent, 2, 10, QLatin1Char('0'))
+                                   .arg(minCurrent, 2, 10, QLatin1Char('0'))
+                                   .arg(secCurrent, 2, 10, QLatin1Char('0'))
+                                   .arg(stats.liveLatency)
+                                   .arg(static_cast<int>(stats.timeshiftDuration)));
+            return;
+        }
+
         ui->labelTime->setText(QString("%1.%2.%3 / %4:%5:%6")
                                .arg(hourCurrent, 2, 10, QLatin1Char('0'))
                                .arg(minCurrent, 2, 10, QLatin1Char('0'))
@@ -637,7 +829,13 @@ void MainWindow::timerSlot()
 
 void MainWindow::seekProgress(int value)
 {
-    decoder->seekProgress(static_cast<qint64>(value) * 1000000);
+    /* keyframe only preview while dragging, accurate seek done at release */
+    player->seek(static_cast<qint64>(value) * 1000000, false);
+}
+
+void MainWindow::seekRelease()
+{
+    player->seek(static_cast<qint64>(ui->videoProgressSlider->value()) * 1000000);
 }
 
 void MainWindow::editText()
@@ -662,25 +860,145 @@ void MainWindow::videoTime(qint64 time)
                            .arg(sec, 2, 10, QLatin1Char('0')));
 }
 
-void MainWindow::showVideo(QImage image)
+/* called on video thread, only newest frame kept, painted on gui thread */
+void MainWindow::frameReady(const AVFrame *frame, double pts)
+{
+    Q_UNUSED(pts);
+
+    frameMutex.lock();
+    av_frame_unref(this->frame);
+    av_frame_ref(this->frame, frame);
+    isFrameChanged = true;
+    frameMutex.unlock();
+
+    QMetaObject::invokeMethod(this, "showFrame", Qt::QueuedConnection);
+}
+
+/* show placeholder image again */
+void MainWindow::clearFrame()
+{
+    frameMutex.lock();
+    av_frame_unref(frame);
+    isFrameChanged = true;
+    frameMutex.unlock();
+
+    showFrame();
+}
+
+/* newest frame becomes paintFrame, false if there was no new one */
+bool MainWindow::takeFrame()
+{
+    bool isTaken = false;
+
+    /* only reference taken under lock, converted without holding it */
+    frameMutex.lock();
+    if (isFrameChanged) {
+        av_frame_unref(paintFrame);
+        if (frame->buf[0]) {
+            av_frame_ref(paintFrame, frame);
+        }
+        isFrameChanged = false;
+        isImageValid = false;
+        isTaken = true;
+    }
+    frameMutex.unlock();
+
+    return isTaken;
+}
+
+void MainWindow::showFrame()
+{
+    if (!videoWidget) {
+        update();
+        return;
+    }
+
+    if (!takeFrame()) {
+        return;
+    }
+
+    /* placeholder image painted by window while no video */
+    if (paintFrame->data[0]) {
+        videoWidget->setFrame(paintFrame);
+        videoWidget->show();
+    } else {
+        videoWidget->hide();
+        update();
+    }
+}
+
+/* OpenGL video surface over the window, raster painting kept if it cannot work */
+void MainWindow::setOpenGLVideo()
+{
+    if (videoWidget || !GLVideoWidget::isSupported()) {
+        return;
+    }
+
+    videoWidget = new GLVideoWidget(this);
+    videoWidget->setAttribute(Qt::WA_TransparentForMouseEvents);
+    videoWidget->setKeepAspectRatio(isKeepAspectRatio);
+    videoWidget->setGeometry(rect());
+    videoWidget->lower();
+    videoWidget->hide();
+
+    connect(videoWidget, SIGNAL(initFailed()), this, SLOT(videoWidgetFailed()), Qt::QueuedConnection);
+
+    /* frame already shown goes to new surface */
+    frameMutex.lock();
+    isFrameChanged = true;
+    frameMutex.unlock();
+    showFrame();
+}
+
+void MainWindow::videoWidgetFailed()
 {
-    this->image = image;
+    qDebug() << "OpenGL video failed, painted by raster.";
+
+    videoWidget->deleteLater();
+    videoWidget = NULL;
+
+    frameMutex.lock();
+    isFrameChanged = true;
+    frameMutex.unlock();
     update();
 }
 
-void MainWindow::playStateChanged(Decoder::PlayState state)
+void MainWindow::gotThumbnail(QString file, qint64 bucket)
+{
+    if (file != currentPlay || bucket != thumbnailer->timeToBucket(thumbnailTime)) {
+        return;
+    }
+
+    if (!ui->videoProgressSlider->underMouse()) {
+        return;
+    }
+
+    QPoint pos = ui->videoProgressSlider->mapFromGlobal(QCursor::pos());
+    showSliderThumbnail(pos.x());
+}
+
+/* decoder went on to next file by itself, gapless music */
+void MainWindow::playingFileChanged(QString file)
+{
+    currentPlay = file;
+    currentPlayType = fileType(file);
+
+    ui->titleLable->setText(QString("当前播放：%1").arg(getFilenameFromPath(file)));
+}
+
+void MainWindow::playStateChanged(PlayerCore::State state)
 {
     switch (state) {
-    case Decoder::PLAYING:
+    case PlayerCore::STATE_PLAYING:
         ui->btnPause->setIcon(QIcon(":/image/pause.ico"));
-        playState = Decoder::PLAYING;
+        playState = PlayerCore::STATE_PLAYING;
         progressTimer->start();
         break;
 
-    case Decoder::STOP:
-        image = QImage(":/image/MUSIC.jpg");
+    case PlayerCore::STATE_STOPPED:
+        clearFrame();
         ui->btnPause->setIcon(QIcon(":/image/play.ico"));
-        playState = Decoder::STOP;
+        playState = PlayerCore::STATE_STOPPED;
         progressTimer->stop();
         ui->labelTime->setText(QString("00.00.00 / 00:00:00"));
         ui->videoProgressSlider->setValue(0);
@@ -688,19 +1006,19 @@ void MainWindow::playStateChanged(Decoder::PlayState state)
         update();
         break;
 
-    case Decoder::PAUSE:
+    case PlayerCore::STATE_PAUSED:
         ui->btnPause->setIcon(QIcon(":/image/play.ico"));
-        playState = Decoder::PAUSE;
+        playState = PlayerCore::STATE_PAUSED;
         break;
 
-    case Decoder::FINISH:
+    case PlayerCore::STATE_FINISHED:
         if (autoPlay) {
             playNext();
         } else if (loopPlay) {
-            emit selectedVideoFile(currentPlay, currentPlayType);
+            player->open(currentPlay, mediaType(currentPlayType));
         }else {
-            image = QImage(":/image/MUSIC.jpg");
-            playState = Decoder::STOP;
+            clearFrame();
+            playState = PlayerCore::STATE_STOPPED;
             progressTimer->stop();
             ui->labelTime->setText(QString("00.00.00 / 00:00:00"));
             ui->videoProgressSlider->setValue(0);
@@ -7,14 +7,20 @@
 #include <QTimer>
 #include <QVector>
 #include <QList>
+#include <QLabel>
+#include <QMutex>
 
-#include "decoder.h"
+#include "playercore.h"
+#include "shmframesink.h"
+#include "frameconverter.h"
+#include "glvideowidget.h"
+#include "thumbnailer.h"
 
 namespace Ui {
 class MainWindow;
 }
 
-class MainWindow : public QMainWindow
+class MainWindow : public QMainWindow, public FrameSink
 {
     Q_OBJECT
 
@@ -22,8 +28,16 @@ public:
     explicit MainWindow(QWidget *parent = 0);
     ~MainWindow();
 
+    void setShmOutput(QString name);
+    void setOpenGLVideo();
+
 private:
+    void frameReady(const AVFrame *frame, double pts);
+    void clearFrame();
+    bool takeFrame();
+
     void paintEvent(QPaintEvent *event);
+    void resizeEvent(QResizeEvent *event);
     void closeEvent(QCloseEvent *event);
     void changeEvent(QEvent *event);
     void keyReleaseEvent(QKeyEvent *event);
@@ -40,18 +54,26 @@ private:
     QString fileType(QString file);
     void addPathVideoToList(QString path);
     void playVideo(QString file);
+    void togglePause();
     void playNext();
+    QString nextFile();
     void playPreview();
     void showPlayMenu();
 
     void setHide(QWidget *widget);
     void showControl(bool show);
+    void showSliderThumbnail(int x);
 
     inline QString getFilenameFromPath(QString path);
+    inline PlayerCore::MediaType mediaType(QString type);
 
     Ui::MainWindow *ui;
 
-    Decoder *decoder;
+    PlayerCore *player;
+    ShmFrameSink *shmSink;      // frames also published to other processes, NULL if not
+    Thumbnailer *thumbnailer;
+    QLabel *thumbnailLabel;     // seek bar hover preview
+    qint64 thumbnailTime;       // slider hover time of preview, in microseconds
     QList<QString> playList;    // list to stroe video files in same path
 
     QString currentPlay;        // current playing video file path
@@ -63,13 +85,24 @@ private:
     bool menuIsVisible;     // switch to control show/hide menu
     bool isKeepAspectRatio; // switch to control image scale whether keep aspect ratio
 
-    QImage image;
+    QImage image;           // shown while no video frame
+
+    /* newest video frame in decoder format, converted at window size when painted */
+    QMutex frameMutex;
+    AVFrame *frame;         // guarded by frameMutex, set by video thread
+    bool isFrameChanged;    // guarded by frameMutex
+    AVFrame *paintFrame;    // frame shown, gui thread only
+    QImage frameImage;      // paintFrame converted, valid while isImageValid
+    bool isImageValid;
+    FrameConverter converter;
+    GLVideoWidget *videoWidget; // OpenGL video surface, NULL for raster painting
 
     bool autoPlay;          // switch to control whether to continue to playing other file
     bool loopPlay;          // switch to control whether to continue to playing same file
+    bool gaplessPlay;       // switch to control music continues without gap between files
     bool closeNotExit;      // switch to control click exit button not exit but hide
 
-    Decoder::PlayState playState;
+    PlayerCore::State playState;
 
     QVector<QWidget *> hideVector;
 
@@ -78,27 +111,27 @@ private:
     int seekInterval;
 
 private slots:
+    void showFrame();
+    void videoWidgetFailed();
     void buttonClickSlot();
     void trayIconActivated(QSystemTrayIcon::ActivationReason reason);
     void timerSlot();
     void editText();
     void seekProgress(int value);
+    void seekRelease();
     void videoTime(qint64 time);
-    void playStateChanged(Decoder::PlayState state);
+    void playStateChanged(PlayerCore::State state);
+    void playingFileChanged(QString file);
 
     /* right click menu slot */
     void setFullScreen();
     void setKeepRatio();
     void setAutoPlay();
     void setLoopPlay();
+    void setGaplessPlay();
     void saveCurrentFrame();
 
-    void showVideo(QImage);
-
-signals:
-    void selectedVideoFile(QString file, QString type);
-    void stopVideo();
-    void pauseVideo();
+    void gotThumbnail(QString file, qint64 bucket);
 
 };
 
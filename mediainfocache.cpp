@@ -0,0 +1,326 @@
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QDateTime>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+
+#include "mediainfocache.h"
+
+/* Increase while MediaInfo layout changes, old cache files are ignored. */
+#define MEDIA_INFO_CACHE_VERSION 1
+
+static QDataStream &operator<<(QDataStream &out, const MediaInfo::Stream &stream)
+{
+    out << stream.codecType << stream.codecId << stream.codecTag << stream.extradata
+        << stream.format << stream.bitRate << stream.bitsPerCodedSample << stream.bitsPerRawSample
+        << stream.profile << stream.level << stream.width << stream.height
+        << stream.sarNum << stream.sarDen << stream.colorRange << stream.colorPrimaries
+        << stream.colorTrc << stream.colorSpace << stream.chromaLocation
+        << stream.channelLayout << stream.channels << stream.sampleRate << stream.blockAlign
+        << stream.frameSize << stream.initialPadding << stream.trailingPadding
+        << stream.timeBaseNum << stream.timeBaseDen << stream.frameRateNum << stream.frameRateDen
+        << stream.startTime << stream.duration;
+
+    return out;
+}
+
+static QDataStream &operator>>(QDataStream &in, MediaInfo::Stream &stream)
+{
+    in >> stream.codecType >> stream.codecId >> stream.codecTag >> stream.extradata
+       >> stream.format >> stream.bitRate >> stream.bitsPerCodedSample >> stream.bitsPerRawSample
+       >> stream.profile >> stream.level >> stream.width >> stream.height
+       >> stream.sarNum >> stream.sarDen >> stream.colorRange >> stream.colorPrimaries
+       >> stream.colorTrc >> stream.colorSpace >> stream.chromaLocation
+       >> stream.channelLayout >> stream.channels >> stream.sampleRate >> stream.blockAlign
+       >> stream.frameSize >> stream.initialPadding >> stream.trailingPadding
+       >> stream.timeBaseNum >> stream.timeBaseDen >> stream.frameRateNum >> stream.frameRateDen
+       >> stream.startTime >> stream.duration;
+
+    return in;
+}
+
+MediaInfoCache::MediaInfoCache()
+{
+    cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/mediainfo";
+}
+
+QString MediaInfoCache::cacheFile(QString file)
+{
+    QByteArray hash = QCryptographicHash::hash(file.toUtf8(), QCryptographicHash::Sha1).toHex();
+
+    return cacheDir + "/" + QString::fromLatin1(hash) + ".info";
+}
+
+/* only local file has a key, network stream is never cached */
+bool MediaInfoCache::fileKey(QString file, qint64 *size, qint64 *mtime)
+{
+    QFileInfo fileInfo(file);
+    if (!fileInfo.isFile()) {
+        return false;
+    }
+
+    *size  = fileInfo.size();
+    *mtime = fileInfo.lastModified().toMSecsSinceEpoch();
+
+    return true;
+}
+
+bool MediaInfoCache::load(QString file, MediaInfo *info)
+{
+    qint64 size, mtime;
+    if (!fileKey(file, &size, &mtime)) {
+        return false;
+    }
+
+    QFile cache(cacheFile(file));
+    if (!cache.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&cache);
+    qint32 version;
+    QString cachedPath;
+    qint64 cachedSize, cachedMtime;
+
+    in >> version >> cachedPath >> cachedSize >> cachedMtime;
+    if (version != MEDIA_INFO_CACHE_VERSION || cachedPath != file
+            || cachedSize != size || cachedMtime != mtime) {
+        return false;
+    }
+
+    in >> info->duration >> info->startTime >> info->streams
+       >> info->keyframeStream >> info->keyframeIndex;
+
+    return in.status() == QDataStream::Ok && !info->streams.isEmpty();
+}
+
+void MediaInfoCache::save(QString file, const MediaInfo &info)
+{
+    qint64 size, mtime;
+    if (!fileKey(file, &size, &mtime)) {
+        return;
+    }
+
+    if (!QDir().mkpath(cacheDir)) {
+        return;
+    }
+
+    QFile cache(cacheFile(file));
+    if (!cache.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "Media info cache write failed:" << cache.fileName();
+        return;
+    }
+
+    QDataStream out(&cache);
+
+    out << static_cast<qint32>(MEDIA_INFO_CACHE_VERSION) << file << size << mtime;
+    out << info.duration << info.startTime << info.streams
+        << info.keyframeStream << info.keyframeIndex;
+}
+
+void MediaInfoCache::remove(QString file)
+{
+    QFile::remove(cacheFile(file));
+}
+
+/* Open file & get stream info, from cache while file is known.
+ * pFormatCtx must be allocated by caller, it is freed on failure.
+ */
+int MediaInfoCache::openInput(QString file, AVFormatContext **pFormatCtx, MediaInfo *info, bool *isCached)
+{
+    int ret;
+
+    /* known file, stream info comes from cache, demuxer header probing is enough */
+    AVDictionary *options = NULL;
+    *isCached = load(file, info);
+    if (*isCached) {
+        av_dict_set(&options, "probesize", "65536", 0);
+        av_dict_set(&options, "analyzeduration", "100000", 0);
+    }
+
+    ret = avformat_open_input(pFormatCtx, file.toLocal8Bit().data(), NULL, &options);
+    av_dict_free(&options);
+    if (ret != 0) {
+        qDebug() << "Open file failed.";
+        return ret;
+    }
+
+    if (*isCached && !applyToFormat(*info, *pFormatCtx)) {
+        qDebug() << "Media info cache mismatch, probe again.";
+        *isCached = false;
+        remove(file);
+        /* back to default probing limits */
+        (*pFormatCtx)->probesize = 5000000;
+        (*pFormatCtx)->max_analyze_duration = 0;
+    }
+
+    if (!*isCached) {
+        if ((ret = avformat_find_stream_info(*pFormatCtx, NULL)) < 0) {
+            qDebug() << "Could't find stream infomation.";
+            avformat_close_input(pFormatCtx);
+            return ret;
+        }
+
+        fromFormat(*pFormatCtx, info);
+    }
+
+    return 0;
+}
+
+void MediaInfoCache::fromFormat(AVFormatContext *pFormatCtx, MediaInfo *info)
+{
+    info->duration  = pFormatCtx->duration;
+    info->startTime = pFormatCtx->start_time;
+    info->streams.clear();
+    info->keyframeIndex.clear();
+    info->keyframeStream = -1;
+
+    for (unsigned int i = 0; i < pFormatCtx->nb_streams; i++) {
+        AVStream *st = pFormatCtx->streams[i];
+        AVCodecParameters *par = st->codecpar;
+        MediaInfo::Stream stream;
+
+        stream.codecType            = par->codec_type;
+        stream.codecId              = par->codec_id;
+        stream.codecTag             = par->codec_tag;
+        stream.extradata            = QByteArray(reinterpret_cast<const char *>(par->extradata), par->extradata_size);
+        stream.format               = par->format;
+        stream.bitRate              = par->bit_rate;
+        stream.bitsPerCodedSample   = par->bits_per_coded_sample;
+        stream.bitsPerRawSample     = par->bits_per_raw_sample;
+        stream.profile              = par->profile;
+        stream.level                = par->level;
+        stream.width                = par->width;
+        stream.height               = par->height;
+        stream.sarNum               = par->sample_aspect_ratio.num;
+        stream.sarDen               = par->sample_aspect_ratio.den;
+        stream.colorRange           = par->color_range;
+        stream.colorPrimaries       = par->color_primaries;
+        stream.colorTrc             = par->color_trc;
+        stream.colorSpace           = par->color_space;
+        stream.chromaLocation       = par->chroma_location;
+        stream.channelLayout        = par->channel_layout;
+        stream.channels             = par->channels;
+        stream.sampleRate           = par->sample_rate;
+        stream.blockAlign           = par->block_align;
+        stream.frameSize            = par->frame_size;
+        stream.initialPadding       = par->initial_padding;
+        stream.trailingPadding      = par->trailing_padding;
+        stream.timeBaseNum          = st->time_base.num;
+        stream.timeBaseDen          = st->time_base.den;
+        stream.frameRateNum         = st->avg_frame_rate.num;
+        stream.frameRateDen         = st->avg_frame_rate.den;
+        stream.startTime            = st->start_time;
+        stream.duration             = st->duration;
+
+        info->streams.append(stream);
+    }
+}
+
+/* Fill parameters which demuxer header doesn't give from cache.
+ * Return false while cache doesn't match this file, then caller must probe.
+ */
+bool MediaInfoCache::applyToFormat(const MediaInfo &info, AVFormatContext *pFormatCtx)
+{
+    if (pFormatCtx->nb_streams != static_cast<unsigned int>(info.streams.size())) {
+        return false;
+    }
+
+    for (unsigned int i = 0; i < pFormatCtx->nb_streams; i++) {
+        AVStream *st = pFormatCtx->streams[i];
+        AVCodecParameters *par = st->codecpar;
+        const MediaInfo::Stream &stream = info.streams.at(i);
+
+        if (par->codec_type != stream.codecType) {
+            return false;
+        }
+
+        if (par->codec_id == AV_CODEC_ID_NONE) {
+            par->codec_id = static_cast<AVCodecID>(stream.codecId);
+        } else if (par->codec_id != stream.codecId) {
+            return false;
+        }
+
+        if (!par->extradata && !stream.extradata.isEmpty()) {
+            par->extradata = static_cast<uint8_t *>(av_mallocz(stream.extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+            if (!par->extradata) {
+                return false;
+            }
+            memcpy(par->extradata, stream.extradata.constData(), stream.extradata.size());
+            par->extradata_size = stream.extradata.size();
+        }
+
+        if (!par->codec_tag)                par->codec_tag = stream.codecTag;
+        if (par->format < 0)                par->format = stream.format;
+        if (!par->bit_rate)                 par->bit_rate = stream.bitRate;
+        if (!par->bits_per_coded_sample)    par->bits_per_coded_sample = stream.bitsPerCodedSample;
+        if (!par->bits_per_raw_sample)      par->bits_per_raw_sample = stream.bitsPerRawSample;
+        if (par->profile < 0)               par->profile = stream.profile;
+        if (par->level < 0)                 par->level = stream.level;
+
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+            if (!par->width || !par->height) {
+                par->width  = stream.width;
+                par->height = stream.height;
+            }
+            if (!par->sample_aspect_ratio.num) {
+                par->sample_aspect_ratio = av_make_q(stream.sarNum, stream.sarDen);
+            }
+            if (par->color_range == AVCOL_RANGE_UNSPECIFIED) {
+                par->color_range = static_cast<AVColorRange>(stream.colorRange);
+            }
+            if (par->color_primaries == AVCOL_PRI_UNSPECIFIED) {
+                par->color_primaries = static_cast<AVColorPrimaries>(stream.colorPrimaries);
+            }
+            if (par->color_trc == AVCOL_TRC_UNSPECIFIED) {
+                par->color_trc = static_cast<AVColorTransferCharacteristic>(stream.colorTrc);
+            }
+            if (par->color_space == AVCOL_SPC_UNSPECIFIED) {
+                par->color_space = static_cast<AVColorSpace>(stream.colorSpace);
+            }
+            if (par->chroma_location == AVCHROMA_LOC_UNSPECIFIED) {
+                par->chroma_location = static_cast<AVChromaLocation>(stream.chromaLocation);
+            }
+            if (!st->avg_frame_rate.num && stream.frameRateDen) {
+                st->avg_frame_rate = av_make_q(stream.frameRateNum, stream.frameRateDen);
+            }
+
+            if (par->width <= 0 || par->height <= 0 || par->format < 0) {
+                return false;
+            }
+        } else if (par->codec_type == AVMEDIA_TYPE_AUDIO) {
+            if (!par->channels) {
+                par->channels       = stream.channels;
+                par->channel_layout = stream.channelLayout;
+            }
+            if (!par->sample_rate)      par->sample_rate = stream.sampleRate;
+            if (!par->block_align)      par->block_align = stream.blockAlign;
+            if (!par->frame_size)       par->frame_size = stream.frameSize;
+            if (!par->initial_padding)  par->initial_padding = stream.initialPadding;
+            if (!par->trailing_padding) par->trailing_padding = stream.trailingPadding;
+
+            if (par->channels <= 0 || par->sample_rate <= 0 || par->format < 0) {
+                return false;
+            }
+        }
+
+        if (st->start_time == AV_NOPTS_VALUE) {
+            st->start_time = stream.startTime;
+        }
+        if (st->duration == AV_NOPTS_VALUE) {
+            st->duration = stream.duration;
+        }
+    }
+
+    if (pFormatCtx->duration == AV_NOPTS_VALUE) {
+        pFormatCtx->duration = info.duration;
+    }
+    if (pFormatCtx->start_time == AV_NOPTS_VALUE) {
+        pFormatCtx->start_time = info.startTime;
+    }
+
+    return true;
+}
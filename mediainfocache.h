@@ -0,0 +1,82 @@
+#ifndef MEDIAINFOCACHE_H
+#define MEDIAINFOCACHE_H
+
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+
+extern "C"
+{
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+}
+
+/* Stream layout & codec parameters of one media file, enough to play it
+ * without avformat_find_stream_info() on next open.
+ */
+struct MediaInfo
+{
+    struct Stream
+    {
+        int codecType;
+        int codecId;
+        quint32 codecTag;
+        QByteArray extradata;
+        int format;
+        qint64 bitRate;
+        int bitsPerCodedSample;
+        int bitsPerRawSample;
+        int profile;
+        int level;
+        int width;
+        int height;
+        int sarNum;
+        int sarDen;
+        int colorRange;
+        int colorPrimaries;
+        int colorTrc;
+        int colorSpace;
+        int chromaLocation;
+        quint64 channelLayout;
+        int channels;
+        int sampleRate;
+        int blockAlign;
+        int frameSize;
+        int initialPadding;
+        int trailingPadding;
+        int timeBaseNum;
+        int timeBaseDen;
+        int frameRateNum;
+        int frameRateDen;
+        qint64 startTime;
+        qint64 duration;
+    };
+
+    qint64 duration;
+    qint64 startTime;
+    QVector<Stream> streams;
+    QVector<qint64> keyframeIndex;  // video keyframe pts in stream time base
+    int keyframeStream;             // stream index of keyframe index, -1 if none
+};
+
+class MediaInfoCache
+{
+public:
+    explicit MediaInfoCache();
+
+    bool load(QString file, MediaInfo *info);
+    void save(QString file, const MediaInfo &info);
+    void remove(QString file);
+    int openInput(QString file, AVFormatContext **pFormatCtx, MediaInfo *info, bool *isCached);
+
+    static void fromFormat(AVFormatContext *pFormatCtx, MediaInfo *info);
+    static bool applyToFormat(const MediaInfo &info, AVFormatContext *pFormatCtx);
+
+private:
+    QString cacheFile(QString file);
+    bool fileKey(QString file, qint64 *size, qint64 *mtime);
+
+    QString cacheDir;
+};
+
+#endif // MEDIAINFOCACHE_H
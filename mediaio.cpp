@@ -0,0 +1,152 @@
+#include <QDebug>
+
+extern "C"
+{
+#include "libavutil/time.h"
+}
+
+#include "mediaio.h"
+#include "readaheadio.h"
+#include "mmapio.h"
+#include "memoryio.h"
+#include "httprangeio.h"
+#ifdef HAVE_LIBURING
+#include "uringio.h"
+#endif
+
+/* Buffer size of AVIOContext handed to demuxer. */
+#define MEDIAIO_BUFFER_SIZE (32 * 1024)
+
+MediaIO::MediaIO() :
+    avioCtx(NULL)
+{
+    interruptCallback.callback = NULL;
+    interruptCallback.opaque = NULL;
+
+    memset(&stats, 0, sizeof(stats));
+}
+
+MediaIO::~MediaIO()
+{
+    if (avioCtx) {
+        av_freep(&avioCtx->buffer);
+        avio_context_free(&avioCtx);
+    }
+}
+
+/* open file by backend, falls back to read-ahead while backend cannot serve it,
+ * NULL means demuxer uses libavformat own I/O
+ */
+MediaIO *MediaIO::create(MediaIO::Backend backend, QString file, const AVIOInterruptCB *interrupt, qint64 readAheadSize)
+{
+    MediaIO *io = NULL;
+
+    if (backend == BACKEND_MMAP) {
+        io = new MmapIO;
+    } else if (backend == BACKEND_MEMORY) {
+        io = new MemoryIO;
+    } else if (backend == BACKEND_HTTP) {
+        io = new HttpRangeIO;
+#ifdef HAVE_LIBURING
+    } else if (backend == BACKEND_URING) {
+        io = new UringIO;
+#endif
+    } else if (backend == BACKEND_READAHEAD && readAheadSize > 0) {
+        io = new ReadAheadIO(readAheadSize);
+    } else if (backend == BACKEND_READAHEAD || backend == BACKEND_DEFAULT) {
+        return NULL;
+    } else {
+        qDebug() << "I/O backend not built in, use read-ahead.";
+        return create(BACKEND_READAHEAD, file, interrupt, readAheadSize);
+    }
+
+    if (io->open(file, interrupt) >= 0 && io->context()) {
+        return io;
+    }
+
+    delete io;
+
+    if (backend != BACKEND_READAHEAD) {
+        qDebug() << "I/O backend not usable for" << file << ", use read-ahead.";
+        return create(BACKEND_READAHEAD, file, interrupt, readAheadSize);
+    }
+
+    return NULL;
+}
+
+MediaIO::Backend MediaIO::backendFromName(QString name)
+{
+    int index = backendNames().indexOf(name);
+
+    return (index < 0) ? BACKEND_DEFAULT : static_cast<Backend>(index);
+}
+
+/* same order as Backend */
+QStringList MediaIO::backendNames()
+{
+    return QStringList() << "default" << "readahead" << "mmap" << "uring" << "memory" << "http";
+}
+
+/* created at first call, owned by this object */
+AVIOContext *MediaIO::context()
+{
+    if (!avioCtx) {
+        uint8_t *buffer = (uint8_t *)av_malloc(MEDIAIO_BUFFER_SIZE);
+        if (!buffer) {
+            return NULL;
+        }
+
+        avioCtx = avio_alloc_context(buffer, MEDIAIO_BUFFER_SIZE, 0, this,
+                                     &MediaIO::readPacket, NULL, &MediaIO::seekPacket);
+        if (!avioCtx) {
+            av_free(buffer);
+        }
+    }
+
+    return avioCtx;
+}
+
+MediaIO::Stats MediaIO::getStats()
+{
+    return stats;
+}
+
+void MediaIO::printStats()
+{
+    double throughput = 0;
+    if (stats.sourceTime > 0) {
+        throughput = stats.sourceBytes / 1048576.0 / (stats.sourceTime / 1000000.0);
+    }
+
+    qDebug() << name() << "I/O:" << stats.bytesRead / 1048576.0 << "MB read,"
+             << throughput << "MB/s from source, stall" << stats.stallTime / 1000.0 << "ms,"
+             << stats.seeksInBuffer << "of" << stats.seeks << "seeks in buffer,"
+             << stats.memory / 1048576.0 << "MB memory";
+}
+
+bool MediaIO::isInterrupted()
+{
+    return interruptCallback.callback && interruptCallback.callback(interruptCallback.opaque);
+}
+
+int MediaIO::readPacket(void *opaque, uint8_t *buf, int size)
+{
+    MediaIO *io = (MediaIO *)opaque;
+    qint64 start = av_gettime_relative();
+
+    int ret = io->read(buf, size);
+
+    io->stats.readTime += av_gettime_relative() - start;
+    if (ret > 0) {
+        io->stats.bytesRead += ret;
+    }
+
+    return ret;
+}
+
+int64_t MediaIO::seekPacket(void *opaque, int64_t offset, int whence)
+{
+    MediaIO *io = (MediaIO *)opaque;
+
+    return io->seek(offset, whence);
+}
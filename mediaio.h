@@ -0,0 +1,70 @@
+#ifndef MEDIAIO_H
+#define MEDIAIO_H
+
+#include <QString>
+#include <QStringList>
+
+extern "C"
+{
+#include "libavformat/avformat.h"
+}
+
+/* Custom input of demuxer, subclasses serve reads from their own storage
+ * through the AVIOContext returned by context().
+ */
+class MediaIO
+{
+public:
+    enum Backend {
+        BACKEND_DEFAULT,    // libavformat own I/O
+        BACKEND_READAHEAD,  // threaded read-ahead ring buffer
+        BACKEND_MMAP,       // memory mapped local file
+        BACKEND_URING,      // io_uring reads in flight, linux only
+        BACKEND_MEMORY,     // whole file loaded into memory
+        BACKEND_HTTP        // parallel http range requests with disk cache
+    };
+
+    struct Stats
+    {
+        qint64 bytesRead;       // bytes delivered to demuxer
+        qint64 readTime;        // time demuxer spent in read calls, in microseconds
+        qint64 stallTime;       // time demuxer waited for data not ready, in microseconds
+        qint64 sourceBytes;     // bytes fetched from file or network
+        qint64 sourceTime;      // time spent fetching them, in microseconds
+        int seeks;
+        int seeksInBuffer;      // seeks served without touching file or network
+        qint64 memory;          // buffer memory held, in bytes
+    };
+
+    explicit MediaIO();
+    virtual ~MediaIO();
+
+    virtual int open(QString file, const AVIOInterruptCB *interrupt) = 0;
+    virtual QString name() = 0;
+
+    static MediaIO *create(MediaIO::Backend backend, QString file, const AVIOInterruptCB *interrupt,
+                           qint64 readAheadSize = 64 * 1024 * 1024);
+    static MediaIO::Backend backendFromName(QString name);
+    static QStringList backendNames();
+
+    AVIOContext *context();
+    MediaIO::Stats getStats();
+    void printStats();
+
+protected:
+    virtual int read(uint8_t *buf, int size) = 0;
+    virtual int64_t seek(int64_t offset, int whence) = 0;
+
+    bool isInterrupted();
+
+    AVIOInterruptCB interruptCallback;  // demuxer interrupt, checked while waiting
+    Stats stats;
+
+private:
+    static int readPacket(void *opaque, uint8_t *buf, int size);
+    static int64_t seekPacket(void *opaque, int64_t offset, int whence);
+
+    AVIOContext *avioCtx;
+};
+
+#endif // MEDIAIO_H
@@ -0,0 +1,279 @@
+#include <QDebug>
+
+#include "mediapreloader.h"
+
+/* Maximum packets read to get first video frame. */
+#define PRELOAD_MAX_PACKETS 1024
+
+MediaPreloader::MediaPreloader() :
+    prepared(NULL)
+{
+    mutex = SDL_CreateMutex();
+}
+
+MediaPreloader::~MediaPreloader()
+{
+    cancel();
+
+    /* canceled tasks still use mediaInfoCache */
+    for (std::shared_future<void> &pending : tasks) {
+        pending.wait();
+    }
+
+    SDL_DestroyMutex(mutex);
+}
+
+/* preload token until handed over, callback of new owner after */
+int MediaPreloader::interruptCallback(void *arg)
+{
+    PreloadInterrupt *interrupt = (PreloadInterrupt *)arg;
+
+    if (interrupt->target.callback) {
+        return interrupt->target.callback(interrupt->target.opaque);
+    }
+
+    return interrupt->token.isCanceled();
+}
+
+/* start preparing file, nothing to do while it is prepared or preparing,
+ * task of previous file is canceled & left to finish on its own
+ */
+void MediaPreloader::prepare(QString file, QString type)
+{
+    SDL_LockMutex(mutex);
+
+    if (file == this->file && type == this->type) {
+        SDL_UnlockMutex(mutex);
+        return;
+    }
+
+    token.cancel();
+    PreparedMedia *old = prepared;
+    prepared = NULL;
+
+    this->file = file;
+    this->type = type;
+
+    qDebug() << "Preload:" << file;
+
+    /* finished tasks need no waiting on destroy */
+    for (int i = tasks.size() - 1; i >= 0; i--) {
+        if (tasks[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            tasks.removeAt(i);
+        }
+    }
+
+    token = CancelToken();
+    CancelToken taskToken = token;
+    task = TaskPool::instance()->submit("preload", TaskPool::PRIORITY_PREFETCH,
+                                        [this, file, type, taskToken]() { run(file, type, taskToken); },
+                                        token).share();
+    tasks.append(task);
+
+    SDL_UnlockMutex(mutex);
+
+    freePrepared(old);
+}
+
+/* take prepared media of file, wait while preparing, NULL if it isn't prepared */
+PreparedMedia *MediaPreloader::take(QString file)
+{
+    SDL_LockMutex(mutex);
+
+    if (file != this->file) {
+        SDL_UnlockMutex(mutex);
+        cancel();
+        return NULL;
+    }
+
+    std::shared_future<void> pending = task;
+    SDL_UnlockMutex(mutex);
+
+    /* not under mutex, gui may prepare another file meanwhile */
+    if (pending.valid()) {
+        pending.wait();
+    }
+
+    PreparedMedia *media = NULL;
+
+    SDL_LockMutex(mutex);
+    if (file == this->file) {
+        media = prepared;
+        prepared = NULL;
+        this->file.clear();
+        this->type.clear();
+    }
+    SDL_UnlockMutex(mutex);
+
+    return media;
+}
+
+QString MediaPreloader::preparedFile()
+{
+    SDL_LockMutex(mutex);
+    QString preparedFile = file;
+    SDL_UnlockMutex(mutex);
+
+    return preparedFile;
+}
+
+QString MediaPreloader::preparedType()
+{
+    SDL_LockMutex(mutex);
+    QString preparedType = type;
+    SDL_UnlockMutex(mutex);
+
+    return preparedType;
+}
+
+/* running task stops at its next I/O & frees what it opened */
+void MediaPreloader::cancel()
+{
+    SDL_LockMutex(mutex);
+
+    token.cancel();
+
+    PreparedMedia *old = prepared;
+    prepared = NULL;
+
+    file.clear();
+    type.clear();
+
+    SDL_UnlockMutex(mutex);
+
+    freePrepared(old);
+}
+
+/* new owner's callback serves I/O from now on, no I/O may be running */
+void MediaPreloader::handOver(PreparedMedia *media, AVIOInterruptCB callback)
+{
+    media->interrupt->target = callback;
+    media->pFormatCtx->interrupt_callback = callback;
+}
+
+void MediaPreloader::freePrepared(PreparedMedia *media)
+{
+    if (!media) {
+        return;
+    }
+
+    while (!media->audioPackets.isEmpty()) {
+        AVPacket packet = media->audioPackets.dequeue();
+        av_packet_unref(&packet);
+    }
+
+    if (media->firstFrame) {
+        av_frame_free(&media->firstFrame);
+    }
+
+    if (media->pCodecCtx) {
+        avcodec_free_context(&media->pCodecCtx);
+    }
+
+    avformat_close_input(&media->pFormatCtx);
+    delete media->interrupt;
+
+    delete media;
+}
+
+/* open video decoder & decode until first frame comes out */
+bool MediaPreloader::preroll(PreparedMedia *media, int videoIndex, int audioIndex)
+{
+    AVCodec *pCodec;
+    AVPacket packet;
+
+    media->pCodecCtx = avcodec_alloc_context3(NULL);
+    avcodec_parameters_to_context(media->pCodecCtx, media->pFormatCtx->streams[videoIndex]->codecpar);
+
+    if ((pCodec = avcodec_find_decoder(media->pCodecCtx->codec_id)) == NULL) {
+        qDebug() << "Preload video decoder not found.";
+        return false;
+    }
+
+    if (avcodec_open2(media->pCodecCtx, pCodec, NULL) < 0) {
+        qDebug() << "Preload could not open video decoder.";
+        return false;
+    }
+
+    AVFrame *frame = av_frame_alloc();
+
+    for (int i = 0; i < PRELOAD_MAX_PACKETS && !media->interrupt->token.isCanceled(); i++) {
+        if (av_read_frame(media->pFormatCtx, &packet) < 0) {
+            break;
+        }
+
+        if (packet.stream_index == videoIndex) {
+            avcodec_send_packet(media->pCodecCtx, &packet);
+            av_packet_unref(&packet);
+
+            if (avcodec_receive_frame(media->pCodecCtx, frame) == 0) {
+                media->firstFrame = frame;
+                return true;
+            }
+        } else if (packet.stream_index == audioIndex) {
+            media->audioPackets.enqueue(packet);
+        } else {
+            av_packet_unref(&packet);
+        }
+    }
+
+    av_frame_free(&frame);
+
+    return false;
+}
+
+void MediaPreloader::run(QString file, QString type, CancelToken token)
+{
+    int videoIndex = -1;
+    int audioIndex = -1;
+
+    PreparedMedia *media = new PreparedMedia;
+    media->file = file;
+    media->type = type;
+    media->pCodecCtx = NULL;
+    media->firstFrame = NULL;
+    media->interrupt = new PreloadInterrupt;
+    media->interrupt->token = token;
+    media->interrupt->target.callback = NULL;
+    media->interrupt->target.opaque = NULL;
+
+    media->pFormatCtx = avformat_alloc_context();
+    media->pFormatCtx->interrupt_callback.callback = &MediaPreloader::interruptCallback;
+    media->pFormatCtx->interrupt_callback.opaque = media->interrupt;
+
+    if (mediaInfoCache.openInput(file, &media->pFormatCtx, &media->mediaInfo, &media->isInfoCached) < 0) {
+        freePrepared(media);
+        return;
+    }
+
+    /* same stream choice as decoder */
+    for (unsigned int i = 0; i < media->pFormatCtx->nb_streams; i++) {
+        if (media->pFormatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+            videoIndex = i;
+        }
+
+        if (media->pFormatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+            audioIndex = i;
+        }
+    }
+
+    if (type == "video" && (videoIndex < 0 || !preroll(media, videoIndex, audioIndex))) {
+        freePrepared(media);
+        return;
+    }
+
+    /* published only while still wanted, cancel() takes it under same mutex */
+    SDL_LockMutex(mutex);
+    bool isWanted = !token.isCanceled() && file == this->file;
+    if (isWanted) {
+        prepared = media;
+    }
+    SDL_UnlockMutex(mutex);
+
+    if (!isWanted) {
+        freePrepared(media);
+        return;
+    }
+
+    qDebug() << "Preload finished:" << file;
+}
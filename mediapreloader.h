@@ -0,0 +1,81 @@
+#ifndef MEDIAPRELOADER_H
+#define MEDIAPRELOADER_H
+
+#include <QQueue>
+#include <QList>
+#include <future>
+
+extern "C"
+{
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+}
+
+#include "SDL2/SDL.h"
+
+#include "mediainfocache.h"
+#include "taskpool.h"
+
+/* Interrupt callback of a preloaded input. Demuxer I/O copies the callback
+ * at open, so it can't be replaced later, it forwards to new owner instead.
+ */
+struct PreloadInterrupt
+{
+    CancelToken token;          // preload canceled, checked until handed over
+    AVIOInterruptCB target;     // callback of new owner, set while I/O is idle
+};
+
+/* Opened & prerolled media, handed over to decoder as a whole. */
+struct PreparedMedia
+{
+    QString file;
+    QString type;
+
+    AVFormatContext *pFormatCtx;
+    PreloadInterrupt *interrupt;    // freed after pFormatCtx is closed
+    AVCodecContext *pCodecCtx;  // opened video decoder, NULL for music
+    AVFrame *firstFrame;        // first decoded video frame, NULL for music
+
+    QQueue<AVPacket> audioPackets;  // audio read while prerolling video
+
+    MediaInfo mediaInfo;
+    bool isInfoCached;
+};
+
+/* Open, probe & decode first frame of next playlist item in background,
+ * while current item is still playing. Runs as prefetch task on TaskPool.
+ */
+class MediaPreloader
+{
+public:
+    explicit MediaPreloader();
+    ~MediaPreloader();
+
+    void prepare(QString file, QString type);
+    PreparedMedia *take(QString file);
+    void cancel();
+    QString preparedFile();
+    QString preparedType();
+
+    static void freePrepared(PreparedMedia *media);
+    static void handOver(PreparedMedia *media, AVIOInterruptCB callback);
+    static int interruptCallback(void *arg);
+
+private:
+    void run(QString file, QString type, CancelToken token);
+    bool preroll(PreparedMedia *media, int videoIndex, int audioIndex);
+
+    SDL_mutex *mutex;   // guards request & result, never held while waiting on a task
+
+    QString file;
+    QString type;
+    CancelToken token;                  // of current task, canceled task stops reading
+    std::shared_future<void> task;      // current task
+    QList<std::shared_future<void>> tasks;  // not finished yet, waited for on destroy
+
+    PreparedMedia *prepared;
+
+    MediaInfoCache mediaInfoCache;
+};
+
+#endif // MEDIAPRELOADER_H
@@ -0,0 +1,199 @@
+#include <QDebug>
+
+extern "C"
+{
+#include "libavutil/time.h"
+}
+
+#include "memoryio.h"
+
+/* Bytes loaded by one bulk read. */
+#define MEMORY_LOAD_CHUNK_SIZE (4 * 1024 * 1024)
+/* Interval to check demuxer interrupt while waiting for data, in ms. */
+#define MEMORY_WAIT_INTERVAL 10
+
+/* loaded: whole file kept from last open, used without reading again */
+MemoryIO::MemoryIO(QByteArray loaded) :
+    data(loaded),
+    buffer(NULL),
+    size(0),
+    pos(0),
+    loadedSize(0),
+    error(0),
+    isQuit(false),
+    tid(NULL)
+{
+    mutex = SDL_CreateMutex();
+    cond  = SDL_CreateCond();
+}
+
+MemoryIO::~MemoryIO()
+{
+    SDL_LockMutex(mutex);
+    isQuit = true;
+    SDL_UnlockMutex(mutex);
+
+    if (tid) {
+        SDL_WaitThread(tid, NULL);
+    }
+
+    SDL_DestroyCond(cond);
+    SDL_DestroyMutex(mutex);
+}
+
+QString MemoryIO::name()
+{
+    return "Memory";
+}
+
+int MemoryIO::open(QString file, const AVIOInterruptCB *interrupt)
+{
+    if (interrupt) {
+        interruptCallback = *interrupt;
+    }
+
+    this->file.setFileName(file);
+    size = this->file.size();
+    if (size <= 0) {
+        return AVERROR(ENOENT);
+    }
+
+    stats.memory = size;
+
+    /* loaded before, nothing to read */
+    if (data.size() == size) {
+        /* shared with last open & only read, do not detach */
+        buffer = const_cast<char *>(data.constData());
+        loadedSize = size;
+        return 0;
+    }
+
+    if (!this->file.open(QIODevice::ReadOnly)) {
+        return AVERROR(ENOENT);
+    }
+
+    data.resize(size);
+    if (data.size() != size) {
+        return AVERROR(ENOMEM);
+    }
+    buffer = data.data();
+
+    tid = SDL_CreateThread(&MemoryIO::loadThread, "memory_load_thread", this);
+
+    return 0;
+}
+
+/* whole file, empty while still loading or failed */
+QByteArray MemoryIO::loadedData()
+{
+    SDL_LockMutex(mutex);
+    bool isLoaded = (loadedSize == size);
+    SDL_UnlockMutex(mutex);
+
+    return isLoaded ? data : QByteArray();
+}
+
+int MemoryIO::loadThread(void *arg)
+{
+    MemoryIO *io = (MemoryIO *)arg;
+    qint64 offset = 0;
+    qint64 start = av_gettime_relative();
+
+    while (offset < io->size && !io->isQuit) {
+        qint64 len = io->file.read(io->buffer + offset, qMin(io->size - offset, static_cast<qint64>(MEMORY_LOAD_CHUNK_SIZE)));
+
+        SDL_LockMutex(io->mutex);
+        if (len <= 0) {
+            qDebug() << "Memory load read failed:" << io->file.errorString();
+            io->error = AVERROR(EIO);
+        } else {
+            offset += len;
+            io->loadedSize = offset;
+            io->stats.sourceBytes = offset;
+            io->stats.sourceTime  = av_gettime_relative() - start;
+        }
+        SDL_CondBroadcast(io->cond);
+        SDL_UnlockMutex(io->mutex);
+
+        if (len <= 0) {
+            break;
+        }
+    }
+
+    io->file.close();
+
+    return 0;
+}
+
+int MemoryIO::read(uint8_t *buf, int size)
+{
+    qint64 stallStart = 0;
+
+    if (pos >= this->size) {
+        return AVERROR_EOF;
+    }
+
+    SDL_LockMutex(mutex);
+    while (pos >= loadedSize) {
+        if (error < 0) {
+            SDL_UnlockMutex(mutex);
+            return error;
+        }
+
+        if (isInterrupted()) {
+            SDL_UnlockMutex(mutex);
+            return AVERROR_EXIT;
+        }
+
+        if (stallStart == 0) {
+            stallStart = av_gettime_relative();
+        }
+
+        SDL_CondWaitTimeout(cond, mutex, MEMORY_WAIT_INTERVAL);
+    }
+    qint64 available = loadedSize - pos;
+    SDL_UnlockMutex(mutex);
+
+    if (stallStart > 0) {
+        stats.stallTime += av_gettime_relative() - stallStart;
+    }
+
+    /* loaded part is never written again */
+    int len = static_cast<int>(qMin(static_cast<qint64>(size), available));
+    memcpy(buf, buffer + pos, len);
+    pos += len;
+
+    return len;
+}
+
+int64_t MemoryIO::seek(int64_t offset, int whence)
+{
+    qint64 target;
+
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return size;
+    case SEEK_SET:
+        target = offset;
+        break;
+    case SEEK_CUR:
+        target = pos + offset;
+        break;
+    case SEEK_END:
+        target = size + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+
+    if (target < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    stats.seeks++;
+    stats.seeksInBuffer++;
+
+    pos = target;
+
+    return pos;
+}
@@ -0,0 +1,45 @@
+#ifndef MEMORYIO_H
+#define MEMORYIO_H
+
+#include <QFile>
+#include <QByteArray>
+
+#include "SDL2/SDL.h"
+
+#include "mediaio.h"
+
+/* Load whole local file into memory by bulk reads on its own thread,
+ * demuxer reads wait only for the part not loaded yet.
+ */
+class MemoryIO : public MediaIO
+{
+public:
+    explicit MemoryIO(QByteArray loaded = QByteArray());
+    ~MemoryIO();
+
+    int open(QString file, const AVIOInterruptCB *interrupt);
+    QString name();
+    QByteArray loadedData();
+
+protected:
+    int read(uint8_t *buf, int size);
+    int64_t seek(int64_t offset, int whence);
+
+private:
+    static int loadThread(void *arg);
+
+    QFile file;
+    QByteArray data;
+    char *buffer;           // data of whole file, written by load thread
+    qint64 size;
+    qint64 pos;
+    qint64 loadedSize;      // bytes loaded from start of file
+    int error;
+    bool isQuit;
+
+    SDL_mutex *mutex;
+    SDL_cond *cond;         // signalled while more data loaded
+    SDL_Thread *tid;
+};
+
+#endif // MEMORYIO_H
@@ -0,0 +1,142 @@
+#include <QDebug>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "mmapio.h"
+
+/* Prefetch this much ahead of read position, in bytes. */
+#define MMAP_READAHEAD_SIZE (16 * 1024 * 1024)
+/* Keep this much behind read position mapped, in bytes. */
+#define MMAP_KEEP_BEHIND (32 * 1024 * 1024)
+/* Renew paging hints after read position moved this far, in bytes. */
+#define MMAP_ADVISE_STEP (4 * 1024 * 1024)
+
+MmapIO::MmapIO() :
+    data(NULL),
+    size(0),
+    pos(0),
+    pageSize(4096),
+    advisedPos(0),
+    releasedEnd(0)
+{
+#ifdef Q_OS_UNIX
+    pageSize = sysconf(_SC_PAGESIZE);
+#endif
+}
+
+MmapIO::~MmapIO()
+{
+    if (data) {
+        file.unmap(data);
+    }
+}
+
+QString MmapIO::name()
+{
+    return "Mmap";
+}
+
+int MmapIO::open(QString file, const AVIOInterruptCB *interrupt)
+{
+    if (interrupt) {
+        interruptCallback = *interrupt;
+    }
+
+    /* local file only */
+    this->file.setFileName(file);
+    if (!this->file.open(QIODevice::ReadOnly)) {
+        return AVERROR(ENOENT);
+    }
+
+    size = this->file.size();
+    if (size <= 0 || (data = this->file.map(0, size)) == NULL) {
+        qDebug() << "Mmap file failed:" << file;
+        return AVERROR(EIO);
+    }
+
+#ifdef Q_OS_UNIX
+    madvise(data, size, MADV_SEQUENTIAL);
+#endif
+    advise(0);
+
+    return 0;
+}
+
+/* prefetch pages ahead of position, release pages far behind it */
+void MmapIO::advise(qint64 position)
+{
+    advisedPos = position;
+
+#ifdef Q_OS_UNIX
+    qint64 start = position & ~(pageSize - 1);
+    if (start < size) {
+        madvise(data + start, qMin(static_cast<qint64>(MMAP_READAHEAD_SIZE), size - start), MADV_WILLNEED);
+    }
+
+    /* seeking back faults released pages in again, from page cache */
+    qint64 end = qMax(static_cast<qint64>(0), start - MMAP_KEEP_BEHIND) & ~(pageSize - 1);
+    if (end < releasedEnd) {
+        releasedEnd = end;
+    } else if (end > releasedEnd) {
+        madvise(data + releasedEnd, end - releasedEnd, MADV_DONTNEED);
+        releasedEnd = end;
+    }
+#endif
+}
+
+int MmapIO::read(uint8_t *buf, int size)
+{
+    if (pos >= this->size) {
+        return AVERROR_EOF;
+    }
+
+    int len = static_cast<int>(qMin(static_cast<qint64>(size), this->size - pos));
+
+    memcpy(buf, data + pos, len);
+    pos += len;
+
+    if (pos - advisedPos >= MMAP_ADVISE_STEP) {
+        advise(pos);
+    }
+
+    return len;
+}
+
+int64_t MmapIO::seek(int64_t offset, int whence)
+{
+    qint64 target;
+
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return size;
+    case SEEK_SET:
+        target = offset;
+        break;
+    case SEEK_CUR:
+        target = pos + offset;
+        break;
+    case SEEK_END:
+        target = size + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+
+    if (target < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    /* whole file is mapped, no seek touches the file */
+    stats.seeks++;
+    stats.seeksInBuffer++;
+
+    pos = target;
+    if (qAbs(pos - advisedPos) >= MMAP_ADVISE_STEP) {
+        advise(pos);
+    }
+
+    return pos;
+}
@@ -0,0 +1,37 @@
+#ifndef MMAPIO_H
+#define MMAPIO_H
+
+#include <QFile>
+
+#include "mediaio.h"
+
+/* Map local file into memory, demuxer reads copy from page cache directly
+ * without read syscalls, paging hinted around read position.
+ */
+class MmapIO : public MediaIO
+{
+public:
+    explicit MmapIO();
+    ~MmapIO();
+
+    int open(QString file, const AVIOInterruptCB *interrupt);
+    QString name();
+
+protected:
+    int read(uint8_t *buf, int size);
+    int64_t seek(int64_t offset, int whence);
+
+private:
+    void advise(qint64 position);
+
+    QFile file;
+    uchar *data;
+    qint64 size;
+    qint64 pos;
+
+    qint64 pageSize;
+    qint64 advisedPos;      // read position at last paging hint
+    qint64 releasedEnd;     // pages before this released from mapping
+};
+
+#endif // MMAPIO_H
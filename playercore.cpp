@@ -0,0 +1,219 @@
+#include <QDebug>
+
+extern "C"
+{
+#include "libavformat/avformat.h"
+#include "libavfilter/avfilter.h"
+}
+
+#include "playercore.h"
+#include "decoder.h"
+#include "threadpolicy.h"
+
+PlayerCore::PlayerCore() :
+    decoder(new Decoder),
+    state(STATE_STOPPED)
+{
+    /* no receiver, called directly on the thread emitting */
+    QObject::connect(decoder, &Decoder::playStateChanged, [this](Decoder::PlayState playState) {
+        State newState;
+
+        switch (playState) {
+        case Decoder::PLAYING:
+            newState = STATE_PLAYING;
+            break;
+        case Decoder::PAUSE:
+            newState = STATE_PAUSED;
+            break;
+        case Decoder::FINISH:
+            newState = STATE_FINISHED;
+            break;
+        case Decoder::STOP:
+        default:
+            newState = STATE_STOPPED;
+            break;
+        }
+
+        state = newState;
+        if (callbacks.stateChanged) {
+            callbacks.stateChanged(newState);
+        }
+    });
+
+    QObject::connect(decoder, &Decoder::gotVideoTime, [this](qint64 duration) {
+        if (callbacks.durationChanged) {
+            callbacks.durationChanged(duration);
+        }
+    });
+
+    QObject::connect(decoder, &Decoder::fileChanged, [this](QString file) {
+        if (callbacks.fileChanged) {
+            callbacks.fileChanged(file);
+        }
+    });
+}
+
+PlayerCore::~PlayerCore()
+{
+    decoder->stopVideo();
+    delete decoder;
+}
+
+/* libraries used by player, call once before creating it */
+void PlayerCore::init()
+{
+    static bool isInited = false;
+
+    if (isInited) {
+        return;
+    }
+    isInited = true;
+
+    avfilter_register_all();
+
+    /* ffmpeg init */
+    av_register_all();
+
+    /* ffmpeg network init for rtsp */
+    if (avformat_network_init()) {
+        qDebug() << "avformat network init failed";
+    }
+
+    /* init sdl audio */
+    if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_TIMER)) {
+        qDebug() << "SDL init failed";
+    }
+}
+
+void PlayerCore::setCallbacks(const PlayerCore::Callbacks &callbacks)
+{
+    this->callbacks = callbacks;
+}
+
+void PlayerCore::setFrameSink(FrameSink *sink)
+{
+    decoder->setFrameSink(sink);
+}
+
+void PlayerCore::setAudioSink(AudioSink *sink)
+{
+    decoder->setAudioSink(sink);
+}
+
+QString PlayerCore::typeName(PlayerCore::MediaType type)
+{
+    return (type == MEDIA_VIDEO) ? "video" : "music";
+}
+
+/* stops current file, future gets whether playing started */
+std::future<bool> PlayerCore::open(QString file, PlayerCore::MediaType type)
+{
+    qDebug() << "File name:" << file << ", type:" << typeName(type);
+
+    return decoder->requestOpen(file, typeName(type));
+}
+
+std::future<void> PlayerCore::play()
+{
+    return decoder->requestPause(false);
+}
+
+std::future<void> PlayerCore::pause()
+{
+    return decoder->requestPause(true);
+}
+
+/* pos in microseconds, not accurate seek lands on nearest keyframe */
+std::future<void> PlayerCore::seek(qint64 pos, bool isAccurate)
+{
+    return decoder->seekProgress(pos, isAccurate ? Decoder::SEEK_ACCURATE : Decoder::SEEK_FAST);
+}
+
+/* returns once threads exited, decoders & audio device are released */
+void PlayerCore::stop()
+{
+    decoder->stopVideo();
+}
+
+void PlayerCore::prepareNext(QString file, PlayerCore::MediaType type)
+{
+    decoder->prepareNext(file, typeName(type));
+}
+
+void PlayerCore::setGapless(bool gapless)
+{
+    decoder->setGapless(gapless);
+}
+
+std::future<void> PlayerCore::shiftLive(double offset)
+{
+    return decoder->shiftLive(offset);
+}
+
+std::future<void> PlayerCore::seekToLive()
+{
+    return decoder->seekToLive();
+}
+
+int PlayerCore::getVolume()
+{
+    return decoder->getVolume();
+}
+
+void PlayerCore::setVolume(int volume)
+{
+    decoder->setVolume(volume);
+}
+
+void PlayerCore::setLiveLatency(int ms)
+{
+    decoder->setLiveLatency(ms);
+}
+
+void PlayerCore::setTimeshift(qint64 memoryCap, qint64 diskCap)
+{
+    decoder->setTimeshift(memoryCap, diskCap);
+}
+
+void PlayerCore::setReadAheadSize(qint64 size)
+{
+    decoder->setReadAheadSize(size);
+}
+
+void PlayerCore::setIOBackend(MediaIO::Backend backend)
+{
+    decoder->setIOBackend(backend);
+}
+
+void PlayerCore::setMemoryThreshold(qint64 size)
+{
+    decoder->setMemoryThreshold(size);
+}
+
+PlayerCore::State PlayerCore::getState()
+{
+    return static_cast<State>(state.load());
+}
+
+bool PlayerCore::isLiveStream()
+{
+    return decoder->isLiveStream();
+}
+
+PlayerCore::Stats PlayerCore::getStats()
+{
+    Stats stats;
+
+    stats.state             = getState();
+    stats.position          = decoder->getCurrentTime();
+    stats.duration          = decoder->getDuration();
+    stats.isLive            = decoder->isLiveStream();
+    stats.liveLatency       = stats.isLive ? decoder->getLiveLatency() : 0;
+    stats.timeshiftDuration = decoder->getTimeshiftDuration();
+    stats.seekLatency       = decoder->getSeekLatency();
+    stats.switchLatency     = decoder->getSwitchLatency();
+    stats.inputMemory       = decoder->getInputMemory();
+    stats.threadPolicies    = ThreadPolicy::report();
+
+    return stats;
+}
@@ -0,0 +1,97 @@
+#ifndef PLAYERCORE_H
+#define PLAYERCORE_H
+
+#include <QString>
+#include <QStringList>
+#include <atomic>
+#include <functional>
+#include <future>
+
+#include "framesink.h"
+#include "audiosink.h"
+#include "mediaio.h"
+
+class Decoder;
+
+/* Playback engine without gui, open, play, pause, seek & stop one file at a time.
+ * It must be created on a thread running a Qt event loop, QCoreApplication is enough.
+ * Callbacks & sinks are called on decoder threads, they must hand data over
+ * without blocking & must not call back into PlayerCore except its getters.
+ */
+class PlayerCore
+{
+public:
+    enum State {
+        STATE_STOPPED,
+        STATE_PLAYING,
+        STATE_PAUSED,
+        STATE_FINISHED      // played to the end, threads exited
+    };
+
+    enum MediaType {
+        MEDIA_VIDEO,
+        MEDIA_MUSIC         // audio only
+    };
+
+    struct Stats
+    {
+        State state;
+        double position;            // playing time, in seconds
+        qint64 duration;            // in microseconds, 0 for live stream
+        bool isLive;
+        int liveLatency;            // behind live edge, in ms
+        double timeshiftDuration;   // live stream recorded for rewinding, in seconds
+        qint64 seekLatency;         // last seek request to first frame, in microseconds
+        qint64 switchLatency;       // last open request to first frame, in microseconds
+        qint64 inputMemory;         // memory held by input buffering, in bytes
+        QStringList threadPolicies; // effective scheduling & affinity of each pipeline thread started so far
+    };
+
+    struct Callbacks
+    {
+        std::function<void (PlayerCore::State state)> stateChanged;
+        std::function<void (qint64 duration)> durationChanged;  // in microseconds, 0 for live stream
+        std::function<void (QString file)> fileChanged;         // gapless music went on to next file
+    };
+
+    explicit PlayerCore();
+    ~PlayerCore();
+
+    static void init();
+
+    void setCallbacks(const PlayerCore::Callbacks &callbacks);
+    void setFrameSink(FrameSink *sink);
+    void setAudioSink(AudioSink *sink);
+
+    std::future<bool> open(QString file, PlayerCore::MediaType type);
+    std::future<void> play();
+    std::future<void> pause();
+    std::future<void> seek(qint64 pos, bool isAccurate = true);
+    void stop();
+
+    void prepareNext(QString file, PlayerCore::MediaType type);
+    void setGapless(bool gapless);
+    std::future<void> shiftLive(double offset);
+    std::future<void> seekToLive();
+
+    int getVolume();
+    void setVolume(int volume);
+    void setLiveLatency(int ms);
+    void setTimeshift(qint64 memoryCap, qint64 diskCap);
+    void setReadAheadSize(qint64 size);
+    void setIOBackend(MediaIO::Backend backend);
+    void setMemoryThreshold(qint64 size);
+
+    PlayerCore::State getState();
+    PlayerCore::Stats getStats();
+    bool isLiveStream();
+
+private:
+    static QString typeName(PlayerCore::MediaType type);
+
+    Decoder *decoder;
+    Callbacks callbacks;    // set while stopped
+    std::atomic<int> state;
+};
+
+#endif // PLAYERCORE_H
@@ -0,0 +1,71 @@
+# playback core without widgets, shared by QtPlayer and playercore.pro library
+
+QT       += core gui network
+
+SOURCES += \
+    $$PWD/playercore.cpp \
+    $$PWD/avpacketqueue.cpp \
+    $$PWD/decoder.cpp \
+    $$PWD/audiodecoder.cpp \
+    $$PWD/audiosink.cpp \
+    $$PWD/mediainfocache.cpp \
+    $$PWD/mediapreloader.cpp \
+    $$PWD/jitterbuffer.cpp \
+    $$PWD/mediaio.cpp \
+    $$PWD/readaheadio.cpp \
+    $$PWD/mmapio.cpp \
+    $$PWD/memoryio.cpp \
+    $$PWD/httprangeio.cpp \
+    $$PWD/timeshiftbuffer.cpp \
+    $$PWD/shmframesink.cpp \
+    $$PWD/frameconverter.cpp \
+    $$PWD/yuvconvert.cpp \
+    $$PWD/taskpool.cpp \
+    $$PWD/threadpolicy.cpp
+
+HEADERS += \
+    $$PWD/playercore.h \
+    $$PWD/framesink.h \
+    $$PWD/avpacketqueue.h \
+    $$PWD/decoder.h \
+    $$PWD/audiodecoder.h \
+    $$PWD/audiosink.h \
+    $$PWD/mediainfocache.h \
+    $$PWD/mediapreloader.h \
+    $$PWD/jitterbuffer.h \
+    $$PWD/mediaio.h \
+    $$PWD/readaheadio.h \
+    $$PWD/mmapio.h \
+    $$PWD/memoryio.h \
+    $$PWD/httprangeio.h \
+    $$PWD/timeshiftbuffer.h \
+    $$PWD/shmframesink.h \
+    $$PWD/frameconverter.h \
+    $$PWD/yuvconvert.h \
+    $$PWD/taskpool.h \
+    $$PWD/threadpolicy.h
+
+INCLUDEPATH += $$PWD \
+                $$PWD/ffmpeg/include \
+                $$PWD/sdl/include
+
+LIBS    += $$PWD/ffmpeg/lib/avcodec.lib \
+            $$PWD/ffmpeg/lib/avdevice.lib \
+            $$PWD/ffmpeg/lib/avfilter.lib \
+            $$PWD/ffmpeg/lib/avformat.lib \
+            $$PWD/ffmpeg/lib/avutil.lib \
+            $$PWD/ffmpeg/lib/postproc.lib \
+            $$PWD/ffmpeg/lib/swresample.lib \
+            $$PWD/ffmpeg/lib/swscale.lib \
+            $$PWD/sdl/lib/libSDL2.a
+
+# shm_open of shared memory frame output
+linux: LIBS += -lrt
+
+# optional io_uring demux backend on linux, build with: qmake CONFIG+=uring
+linux:uring {
+    DEFINES += HAVE_LIBURING
+    LIBS    += -luring
+    SOURCES += $$PWD/uringio.cpp
+    HEADERS += $$PWD/uringio.h
+}
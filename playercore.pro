@@ -0,0 +1,17 @@
+#-------------------------------------------------
+#
+# Playback core as static library, for embedding without QtPlayer gui.
+# Link it with the ffmpeg & SDL libraries listed in playercore.pri.
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+TARGET = playercore
+TEMPLATE = lib
+
+CONFIG += staticlib c++11
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(playercore.pri)
@@ -0,0 +1,271 @@
+#include <QDebug>
+
+extern "C"
+{
+#include "libavutil/time.h"
+}
+
+#include "readaheadio.h"
+
+/* Bytes fetched from source by one read. */
+#define READAHEAD_CHUNK_SIZE (256 * 1024)
+/* Part of window kept behind read position for backward seeks, 1 / n. */
+#define READAHEAD_BEHIND_RATIO 4
+/* Interval to check demuxer interrupt while waiting for data, in ms. */
+#define READAHEAD_WAIT_INTERVAL 10
+
+ReadAheadIO::ReadAheadIO(qint64 windowSize) :
+    windowSize(windowSize),
+    source(NULL),
+    fileSize(-1),
+    ring(NULL),
+    ringSize(0),
+    windowStart(0),
+    windowEnd(0),
+    readPos(0),
+    seekRequest(-1),
+    isEof(false),
+    error(0),
+    isQuit(false),
+    tid(NULL)
+{
+    mutex = SDL_CreateMutex();
+    cond  = SDL_CreateCond();
+}
+
+ReadAheadIO::~ReadAheadIO()
+{
+    SDL_LockMutex(mutex);
+    isQuit = true;
+    SDL_CondBroadcast(cond);
+    SDL_UnlockMutex(mutex);
+
+    if (tid) {
+        SDL_WaitThread(tid, NULL);
+    }
+
+    if (source) {
+        avio_closep(&source);
+    }
+
+    av_free(ring);
+
+    SDL_DestroyCond(cond);
+    SDL_DestroyMutex(mutex);
+}
+
+QString ReadAheadIO::name()
+{
+    return "Read-ahead";
+}
+
+/* source reads abort on quit or on demuxer interrupt */
+int ReadAheadIO::sourceInterrupt(void *arg)
+{
+    ReadAheadIO *io = (ReadAheadIO *)arg;
+
+    return io->isQuit || io->isInterrupted();
+}
+
+int ReadAheadIO::open(QString file, const AVIOInterruptCB *interrupt)
+{
+    int ret;
+    AVIOInterruptCB cb = {&ReadAheadIO::sourceInterrupt, this};
+
+    if (interrupt) {
+        interruptCallback = *interrupt;
+    }
+
+    if ((ret = avio_open2(&source, file.toLocal8Bit().data(), AVIO_FLAG_READ, &cb, NULL)) < 0) {
+        qDebug() << "Read-ahead open source failed, error code:" << ret;
+        return ret;
+    }
+
+    fileSize = avio_size(source);
+
+    /* small file needs no full window */
+    ringSize = windowSize;
+    if (fileSize > 0 && fileSize < ringSize) {
+        ringSize = qMax(fileSize, static_cast<qint64>(READAHEAD_CHUNK_SIZE));
+    }
+
+    if ((ring = (uint8_t *)av_malloc(ringSize)) == NULL) {
+        qDebug() << "Read-ahead buffer alloc failed, size:" << ringSize;
+        return AVERROR(ENOMEM);
+    }
+    stats.memory = ringSize;
+
+    tid = SDL_CreateThread(&ReadAheadIO::ioThread, "readahead_thread", this);
+
+    return 0;
+}
+
+int ReadAheadIO::ioThread(void *arg)
+{
+    ReadAheadIO *io = (ReadAheadIO *)arg;
+
+    SDL_LockMutex(io->mutex);
+
+    while (!io->isQuit) {
+        /* seek outside window, restart window at target */
+        if (io->seekRequest >= 0) {
+            qint64 target = io->seekRequest;
+
+            SDL_UnlockMutex(io->mutex);
+            int64_t ret = avio_seek(io->source, target, SEEK_SET);
+            SDL_LockMutex(io->mutex);
+
+            /* newer request came while seeking, serve it first */
+            if (io->seekRequest != target) {
+                continue;
+            }
+
+            io->seekRequest = -1;
+            io->windowStart = target;
+            io->windowEnd   = target;
+            io->isEof = false;
+            io->error = (ret < 0) ? static_cast<int>(ret) : 0;
+
+            SDL_CondBroadcast(io->cond);
+            continue;
+        }
+
+        /* free space by dropping data far behind read position */
+        qint64 start = qMax(io->windowStart, io->readPos - io->ringSize / READAHEAD_BEHIND_RATIO);
+        qint64 space = io->ringSize - (io->windowEnd - start);
+
+        if (space <= 0 || io->isEof || io->error < 0) {
+            SDL_CondWait(io->cond, io->mutex);
+            continue;
+        }
+
+        io->windowStart = start;
+
+        /* contiguous part of ring only */
+        qint64 offset = io->windowEnd % io->ringSize;
+        int size = static_cast<int>(qMin(qMin(space, io->ringSize - offset), static_cast<qint64>(READAHEAD_CHUNK_SIZE)));
+
+        SDL_UnlockMutex(io->mutex);
+        qint64 readStart = av_gettime_relative();
+        int ret = avio_read(io->source, io->ring + offset, size);
+        qint64 readTime = av_gettime_relative() - readStart;
+        SDL_LockMutex(io->mutex);
+
+        /* data of old position, seek has dropped window */
+        if (io->seekRequest >= 0) {
+            continue;
+        }
+
+        if (ret > 0) {
+            io->windowEnd += ret;
+            io->stats.sourceBytes += ret;
+            io->stats.sourceTime  += readTime;
+        } else if (ret == AVERROR_EOF || ret == 0) {
+            io->isEof = true;
+        } else {
+            qDebug() << "Read-ahead source read failed, error code:" << ret;
+            io->error = ret;
+        }
+
+        SDL_CondBroadcast(io->cond);
+    }
+
+    SDL_UnlockMutex(io->mutex);
+
+    return 0;
+}
+
+int ReadAheadIO::read(uint8_t *buf, int size)
+{
+    qint64 stallStart = 0;
+
+    SDL_LockMutex(mutex);
+
+    while (seekRequest >= 0 || readPos >= windowEnd) {
+        if (seekRequest < 0 && isEof) {
+            SDL_UnlockMutex(mutex);
+            return AVERROR_EOF;
+        }
+
+        if (seekRequest < 0 && error < 0) {
+            SDL_UnlockMutex(mutex);
+            return error;
+        }
+
+        if (isInterrupted()) {
+            SDL_UnlockMutex(mutex);
+            return AVERROR_EXIT;
+        }
+
+        if (stallStart == 0) {
+            stallStart = av_gettime_relative();
+        }
+
+        SDL_CondWaitTimeout(cond, mutex, READAHEAD_WAIT_INTERVAL);
+    }
+
+    if (stallStart > 0) {
+        stats.stallTime += av_gettime_relative() - stallStart;
+    }
+
+    qint64 offset = readPos % ringSize;
+    int len = static_cast<int>(qMin(qMin(static_cast<qint64>(size), windowEnd - readPos), ringSize - offset));
+
+    memcpy(buf, ring + offset, len);
+    readPos += len;
+
+    /* space may be freed behind read position */
+    SDL_CondBroadcast(cond);
+    SDL_UnlockMutex(mutex);
+
+    return len;
+}
+
+int64_t ReadAheadIO::seek(int64_t offset, int whence)
+{
+    qint64 target;
+
+    if (whence == AVSEEK_SIZE) {
+        return fileSize >= 0 ? fileSize : AVERROR(ENOSYS);
+    }
+
+    SDL_LockMutex(mutex);
+
+    switch (whence & ~AVSEEK_FORCE) {
+    case SEEK_SET:
+        target = offset;
+        break;
+    case SEEK_CUR:
+        target = readPos + offset;
+        break;
+    case SEEK_END:
+        target = (fileSize >= 0) ? fileSize + offset : -1;
+        break;
+    default:
+        target = -1;
+        break;
+    }
+
+    if (target < 0) {
+        SDL_UnlockMutex(mutex);
+        return AVERROR(EINVAL);
+    }
+
+    stats.seeks++;
+
+    if (seekRequest < 0 && target >= windowStart && target <= windowEnd) {
+        stats.seeksInBuffer++;
+    } else {
+        /* io thread refills window from target */
+        seekRequest = target;
+        windowStart = target;
+        windowEnd   = target;
+        SDL_CondBroadcast(cond);
+    }
+
+    readPos = target;
+
+    SDL_UnlockMutex(mutex);
+
+    return target;
+}
@@ -0,0 +1,48 @@
+#ifndef READAHEADIO_H
+#define READAHEADIO_H
+
+#include "SDL2/SDL.h"
+
+#include "mediaio.h"
+
+/* Read file or network stream on its own thread into a large ring buffer,
+ * demuxer reads & seeks inside the window never wait for the source.
+ */
+class ReadAheadIO : public MediaIO
+{
+public:
+    explicit ReadAheadIO(qint64 windowSize);
+    ~ReadAheadIO();
+
+    int open(QString file, const AVIOInterruptCB *interrupt);
+    QString name();
+
+protected:
+    int read(uint8_t *buf, int size);
+    int64_t seek(int64_t offset, int whence);
+
+private:
+    static int ioThread(void *arg);
+    static int sourceInterrupt(void *arg);
+
+    qint64 windowSize;
+
+    AVIOContext *source;
+    qint64 fileSize;        // -1 while source size unknown
+
+    uint8_t *ring;
+    qint64 ringSize;
+    qint64 windowStart;     // file offset of oldest buffered byte
+    qint64 windowEnd;       // file offset after newest buffered byte
+    qint64 readPos;         // file offset of next demuxer read
+    qint64 seekRequest;     // source offset wanted by demuxer, -1 for none
+    bool isEof;
+    int error;
+    bool isQuit;
+
+    SDL_mutex *mutex;
+    SDL_cond *cond;         // signalled on new data, consumed data, seek & quit
+    SDL_Thread *tid;
+};
+
+#endif // READAHEADIO_H
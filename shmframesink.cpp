@@ -0,0 +1,357 @@
+#include <QDebug>
+#include <new>
+
+#ifdef Q_OS_UNIX
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+extern "C"
+{
+#include "libavutil/pixdesc.h"
+}
+
+#include "shmframesink.h"
+
+/* Reader gives up after a slot changed under it this many times in a row. */
+#define SHM_READ_RETRIES (4)
+
+static qint64 alignUp(qint64 size)
+{
+    return (size + SHM_FRAME_ALIGN - 1) & ~static_cast<qint64>(SHM_FRAME_ALIGN - 1);
+}
+
+static qint64 slotStride(quint32 slotSize)
+{
+    return alignUp(sizeof(ShmFrameSlot)) + alignUp(slotSize);
+}
+
+/* shm_open wants one leading slash & no other */
+static QByteArray shmName(QString name)
+{
+    return ("/" + name.remove('/')).toLocal8Bit();
+}
+
+ShmFrameSink::ShmFrameSink(QString name, int slotCount, FrameSink *next) :
+    name(name),
+    slotCount(qMax(2, slotCount)),
+    next(next),
+    fd(-1),
+    data(NULL),
+    size(0),
+    slotSize(0),
+    frameNumber(0),
+    isFailed(false)
+{
+#ifndef Q_OS_UNIX
+    qDebug() << "Shared memory frame output not supported on this system.";
+    isFailed = true;
+#endif
+}
+
+ShmFrameSink::~ShmFrameSink()
+{
+    destroy();
+}
+
+bool ShmFrameSink::isOpen()
+{
+    return data != NULL;
+}
+
+/* segment sized by first frame, created again only when a frame does not fit */
+bool ShmFrameSink::create(quint32 slotSize)
+{
+#ifdef Q_OS_UNIX
+    QByteArray path = shmName(name);
+    qint64 newSize = alignUp(sizeof(ShmFrameHeader)) + slotStride(slotSize) * slotCount;
+
+    /* mapped readers keep old segment, told to map the name again */
+    destroy();
+
+    fd = shm_open(path.constData(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0) {
+        qDebug() << "Shared memory open failed:" << path << strerror(errno);
+        return false;
+    }
+
+    if (ftruncate(fd, newSize) < 0) {
+        qDebug() << "Shared memory resize failed:" << strerror(errno);
+        goto fail;
+    }
+
+    data = static_cast<uchar *>(mmap(NULL, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+    if (data == MAP_FAILED) {
+        qDebug() << "Shared memory map failed:" << strerror(errno);
+        data = NULL;
+        goto fail;
+    }
+    size = newSize;
+    this->slotSize = slotSize;
+
+    {
+        ShmFrameHeader *header = new (data) ShmFrameHeader;
+        header->slotCount = slotCount;
+        header->slotSize  = slotSize;
+        header->isStale.store(0, std::memory_order_relaxed);
+        header->latest.store(0, std::memory_order_relaxed);
+        header->version   = SHM_FRAME_VERSION;
+
+        for (int i = 0; i < slotCount; i++) {
+            ShmFrameSlot *slot = new (data + alignUp(sizeof(ShmFrameHeader)) + slotStride(slotSize) * i) ShmFrameSlot;
+            slot->sequence.store(0, std::memory_order_relaxed);
+        }
+
+        /* readers check magic last */
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = SHM_FRAME_MAGIC;
+    }
+
+    qDebug() << "Shared memory frame output:" << path << slotCount << "slots of" << slotSize << "bytes";
+
+    return true;
+
+fail:
+    ::close(fd);
+    fd = -1;
+    shm_unlink(path.constData());
+    return false;
+#else
+    Q_UNUSED(slotSize);
+    return false;
+#endif
+}
+
+void ShmFrameSink::destroy()
+{
+#ifdef Q_OS_UNIX
+    if (data) {
+        ShmFrameHeader *header = reinterpret_cast<ShmFrameHeader *>(data);
+        header->isStale.store(1, std::memory_order_release);
+
+        munmap(data, size);
+        data = NULL;
+        size = 0;
+    }
+
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+        shm_unlink(shmName(name).constData());
+    }
+#endif
+}
+
+ShmFrameSlot *ShmFrameSink::slotAt(quint64 frameNumber)
+{
+    return reinterpret_cast<ShmFrameSlot *>(data + alignUp(sizeof(ShmFrameHeader))
+                                            + slotStride(slotSize) * (frameNumber % slotCount));
+}
+
+/* plane data bytes of frame, rows of each plane with their stride */
+static quint32 frameDataSize(const AVFrame *frame, int *planes, int rows[SHM_FRAME_PLANES])
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+    quint32 size = 0;
+
+    *planes = 0;
+    if (!desc) {
+        return 0;
+    }
+
+    for (int p = 0; p < SHM_FRAME_PLANES && frame->data[p] && frame->linesize[p] > 0; p++) {
+        /* chroma planes of yuv are subsampled */
+        bool isChroma = (p == 1 || p == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+        rows[p] = isChroma ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h) : frame->height;
+        size += frame->linesize[p] * rows[p];
+        (*planes)++;
+    }
+
+    return size;
+}
+
+void ShmFrameSink::frameReady(const AVFrame *frame, double pts)
+{
+    int planes;
+    int rows[SHM_FRAME_PLANES];
+    quint32 frameSize = frameDataSize(frame, &planes, rows);
+
+    if (!isFailed && frameSize > 0 && (!data || frameSize > slotSize)) {
+        isFailed = !create(frameSize);
+    }
+
+    if (data && frameSize > 0 && frameSize <= slotSize) {
+        ShmFrameHeader *header = reinterpret_cast<ShmFrameHeader *>(data);
+        ShmFrameSlot *slot = slotAt(++frameNumber);
+        uchar *dst = reinterpret_cast<uchar *>(slot) + alignUp(sizeof(ShmFrameSlot));
+        quint32 seq = slot->sequence.load(std::memory_order_relaxed);
+        quint32 offset = 0;
+
+        /* odd while writing, readers copying this slot retry */
+        slot->sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot->frameNumber = frameNumber;
+        slot->pts       = pts;
+        slot->format    = frame->format;
+        slot->width     = frame->width;
+        slot->height    = frame->height;
+        slot->planes    = planes;
+        slot->size      = frameSize;
+        for (int p = 0; p < SHM_FRAME_PLANES; p++) {
+            slot->stride[p] = (p < planes) ? frame->linesize[p] : 0;
+            slot->offset[p] = (p < planes) ? offset : 0;
+            if (p < planes) {
+                memcpy(dst + offset, frame->data[p], frame->linesize[p] * rows[p]);
+                offset += frame->linesize[p] * rows[p];
+            }
+        }
+
+        slot->sequence.store(seq + 2, std::memory_order_release);
+        header->latest.store(frameNumber, std::memory_order_release);
+    }
+
+    if (next) {
+        next->frameReady(frame, pts);
+    }
+}
+
+ShmFrameReader::ShmFrameReader() :
+    fd(-1),
+    data(NULL),
+    size(0),
+    lastFrame(0)
+{
+
+}
+
+ShmFrameReader::~ShmFrameReader()
+{
+    close();
+}
+
+bool ShmFrameReader::open(QString name)
+{
+#ifdef Q_OS_UNIX
+    struct stat st;
+    QByteArray path = shmName(name);
+
+    close();
+    this->name = name;
+
+    fd = shm_open(path.constData(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size < alignUp(sizeof(ShmFrameHeader))) {
+        goto fail;
+    }
+
+    data = static_cast<uchar *>(mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0));
+    if (data == MAP_FAILED) {
+        data = NULL;
+        goto fail;
+    }
+    size = st.st_size;
+
+    {
+        const ShmFrameHeader *header = reinterpret_cast<const ShmFrameHeader *>(data);
+        if (header->magic != SHM_FRAME_MAGIC || header->version != SHM_FRAME_VERSION
+                || alignUp(sizeof(ShmFrameHeader)) + slotStride(header->slotSize) * header->slotCount > size) {
+            qDebug() << "Shared memory frames not ready or of other version:" << path;
+            goto fail;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+
+    return true;
+
+fail:
+    close();
+    return false;
+#else
+    Q_UNUSED(name);
+    return false;
+#endif
+}
+
+void ShmFrameReader::close()
+{
+#ifdef Q_OS_UNIX
+    if (data) {
+        munmap(data, size);
+        data = NULL;
+        size = 0;
+    }
+
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+#endif
+    lastFrame = 0;
+}
+
+bool ShmFrameReader::read(ShmFrameSlot *info, QByteArray *planes)
+{
+    if (!data) {
+        return false;
+    }
+
+    const ShmFrameHeader *header = reinterpret_cast<const ShmFrameHeader *>(data);
+
+    /* writer moved to a bigger segment */
+    if (header->isStale.load(std::memory_order_acquire)) {
+        if (!open(name)) {
+            return false;
+        }
+        header = reinterpret_cast<const ShmFrameHeader *>(data);
+    }
+
+    for (int i = 0; i < SHM_READ_RETRIES; i++) {
+        quint64 latest = header->latest.load(std::memory_order_acquire);
+        if (latest == 0 || latest == lastFrame) {
+            return false;
+        }
+
+        const ShmFrameSlot *slot = reinterpret_cast<const ShmFrameSlot *>(
+                    data + alignUp(sizeof(ShmFrameHeader)) + slotStride(header->slotSize) * (latest % header->slotCount));
+
+        quint32 seq = slot->sequence.load(std::memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+
+        quint32 frameSize = qMin(slot->size, header->slotSize);
+        info->frameNumber = slot->frameNumber;
+        info->pts     = slot->pts;
+        info->format  = slot->format;
+        info->width   = slot->width;
+        info->height  = slot->height;
+        info->planes  = slot->planes;
+        info->size    = frameSize;
+        for (int p = 0; p < SHM_FRAME_PLANES; p++) {
+            info->stride[p] = slot->stride[p];
+            info->offset[p] = slot->offset[p];
+        }
+        planes->resize(frameSize);
+        memcpy(planes->data(), reinterpret_cast<const uchar *>(slot) + alignUp(sizeof(ShmFrameSlot)), frameSize);
+
+        /* slot overwritten while copying, take newest again */
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->sequence.load(std::memory_order_relaxed) != seq) {
+            continue;
+        }
+
+        info->sequence.store(seq, std::memory_order_relaxed);
+        lastFrame = latest;
+        return true;
+    }
+
+    return false;
+}
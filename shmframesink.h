@@ -0,0 +1,99 @@
+#ifndef SHMFRAMESINK_H
+#define SHMFRAMESINK_H
+
+#include <QString>
+#include <QByteArray>
+#include <atomic>
+
+#include "framesink.h"
+
+/* Layout of shared memory segment: ShmFrameHeader, then slotCount slots,
+ * each a ShmFrameSlot followed by slotSize bytes of plane data.
+ * Structures are aligned to SHM_FRAME_ALIGN.
+ */
+#define SHM_FRAME_MAGIC     (0x46535051)    // "QPSF"
+#define SHM_FRAME_VERSION   (1)
+#define SHM_FRAME_ALIGN     (64)
+#define SHM_FRAME_PLANES    (4)
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+              "shared memory frames need lock free atomics");
+
+struct ShmFrameHeader
+{
+    quint32 magic;
+    quint32 version;
+    quint32 slotCount;
+    quint32 slotSize;               // plane data bytes of one slot
+    std::atomic<quint32> isStale;   // segment replaced by a bigger one, map the name again
+    std::atomic<quint64> latest;    // number of newest complete frame, 0 for none
+};
+
+/* Seqlock, sequence is odd while writer fills the slot. */
+struct ShmFrameSlot
+{
+    std::atomic<quint32> sequence;
+    quint64 frameNumber;            // in slot frameNumber % slotCount
+    double pts;                     // presentation time, in seconds
+    qint32 format;                  // AVPixelFormat, decoder format (YUV420P)
+    qint32 width;
+    qint32 height;
+    qint32 planes;
+    qint32 stride[SHM_FRAME_PLANES];
+    quint32 offset[SHM_FRAME_PLANES];   // from start of slot data
+    quint32 size;                   // plane data bytes used
+};
+
+/* Publish frames into a POSIX shared memory ring for other processes on the
+ * same machine, then pass them on to next sink. Frames arrive at presentation
+ * time on video thread. Writer never waits for readers, a slow reader only
+ * misses frames or retries a torn read.
+ */
+class ShmFrameSink : public FrameSink
+{
+public:
+    explicit ShmFrameSink(QString name, int slotCount = 3, FrameSink *next = NULL);
+    ~ShmFrameSink();
+
+    bool isOpen();
+    void frameReady(const AVFrame *frame, double pts);
+
+private:
+    bool create(quint32 slotSize);
+    void destroy();
+    ShmFrameSlot *slotAt(quint64 frameNumber);
+
+    QString name;
+    int slotCount;
+    FrameSink *next;
+
+    int fd;
+    uchar *data;
+    qint64 size;
+    quint32 slotSize;
+    quint64 frameNumber;
+    bool isFailed;      // shared memory unusable, frames only passed on
+};
+
+/* Consumer side of ShmFrameSink, copies newest frame out of the ring. */
+class ShmFrameReader
+{
+public:
+    explicit ShmFrameReader();
+    ~ShmFrameReader();
+
+    bool open(QString name);
+    void close();
+
+    /* false while no new frame, slot info & planes copied on success */
+    bool read(ShmFrameSlot *info, QByteArray *planes);
+
+private:
+    QString name;
+    int fd;
+    uchar *data;
+    qint64 size;
+    quint64 lastFrame;
+};
+
+#endif // SHMFRAMESINK_H
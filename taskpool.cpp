@@ -0,0 +1,366 @@
+extern "C"
+{
+#include "libavutil/time.h"
+}
+
+#include "taskpool.h"
+#include "threadpolicy.h"
+
+/* Worker index of current thread, -1 outside pool. */
+static thread_local int currentWorker = -1;
+/* Priority of task current thread runs, tasks it helps with while waiting are at least this urgent. */
+static thread_local TaskPool::Priority currentPriority = TaskPool::PRIORITY_LIBRARY;
+
+class TaskWorker : public QThread
+{
+public:
+    TaskWorker(TaskPool *pool, int index) :
+        pool(pool),
+        index(index)
+    {
+
+    }
+
+private:
+    void run()
+    {
+        currentWorker = index;
+        /* not what the thread creating pool happened to have */
+        if (pool->isBackground(index)) {
+            ThreadPolicy::applyBackground();
+        } else {
+            ThreadPolicy::applyDefault();
+        }
+        pool->workerLoop(index);
+    }
+
+    TaskPool *pool;
+    int index;
+};
+
+CancelToken::CancelToken() :
+    canceled(std::make_shared<std::atomic<bool>>(false))
+{
+
+}
+
+void CancelToken::cancel()
+{
+    *canceled = true;
+}
+
+bool CancelToken::isCanceled() const
+{
+    return *canceled;
+}
+
+/* created on first use, lives until process exits, playback workers one per core */
+TaskPool *TaskPool::instance()
+{
+    static TaskPool *pool = new TaskPool(QThread::idealThreadCount());
+
+    return pool;
+}
+
+TaskPool::TaskPool(int threadCount) :
+    playbackCount(threadCount),
+    running(0),
+    waiters(0),
+    stolen(0),
+    isQuit(false)
+{
+    mutex = SDL_CreateMutex();
+    playbackCond   = SDL_CreateCond();
+    backgroundCond = SDL_CreateCond();
+    waitCond       = SDL_CreateCond();
+    injected.mutex = SDL_CreateMutex();
+
+    for (int i = 0; i < PRIORITY_COUNT; i++) {
+        pending[i] = 0;
+    }
+
+    /* prefetch & library together get half as many workers */
+    threadCount += qMax(1, threadCount / 2);
+
+    for (int i = 0; i < threadCount; i++) {
+        TaskQueue *queue = new TaskQueue;
+        queue->mutex = SDL_CreateMutex();
+        queues.append(queue);
+    }
+
+    /* queues complete before any worker looks at them */
+    for (int i = 0; i < threadCount; i++) {
+        TaskWorker *worker = new TaskWorker(this, i);
+        workers.append(worker);
+        /* lowered once more by ThreadPolicy, thread priority is ignored by Linux */
+        worker->start(isBackground(i) ? QThread::LowestPriority : QThread::NormalPriority);
+    }
+}
+
+TaskPool::~TaskPool()
+{
+    SDL_LockMutex(mutex);
+    isQuit = true;
+    SDL_CondBroadcast(playbackCond);
+    SDL_CondBroadcast(backgroundCond);
+    SDL_UnlockMutex(mutex);
+
+    for (TaskWorker *worker : workers) {
+        worker->wait();
+        delete worker;
+    }
+
+    /* tasks never claimed are finished without running */
+    QList<TaskQueue *> allQueues = queues.toList();
+    allQueues.append(&injected);
+
+    for (TaskQueue *queue : allQueues) {
+        for (int i = 0; i < PRIORITY_COUNT; i++) {
+            for (Task *task : queue->tasks[i]) {
+                task->done.set_value();
+                delete task;
+            }
+        }
+        SDL_DestroyMutex(queue->mutex);
+    }
+    qDeleteAll(queues);
+
+    SDL_DestroyCond(waitCond);
+    SDL_DestroyCond(backgroundCond);
+    SDL_DestroyCond(playbackCond);
+    SDL_DestroyMutex(mutex);
+}
+
+int TaskPool::getThreadCount()
+{
+    return workers.size();
+}
+
+bool TaskPool::isBackground(int index)
+{
+    return index >= playbackCount;
+}
+
+/* future is ready once job returned, or was skipped by canceled token */
+std::future<void> TaskPool::submit(QString name, TaskPool::Priority priority, std::function<void ()> job,
+                                   CancelToken token)
+{
+    Task *task = new Task;
+    task->name = name;
+    task->priority = priority;
+    task->job = job;
+    task->token = token;
+    task->submitTime = av_gettime_relative();
+
+    std::future<void> future = task->done.get_future();
+
+    /* worker keeps own tasks, likely with data still in its cache */
+    TaskQueue *queue = (currentWorker >= 0) ? queues[currentWorker] : &injected;
+    SDL_LockMutex(queue->mutex);
+    queue->tasks[priority].append(task);
+    SDL_UnlockMutex(queue->mutex);
+
+    SDL_LockMutex(mutex);
+    pending[priority]++;
+    SDL_CondSignal((priority == PRIORITY_PLAYBACK) ? playbackCond : backgroundCond);
+    if (waiters > 0) {
+        SDL_CondBroadcast(waitCond);
+    }
+    SDL_UnlockMutex(mutex);
+
+    return future;
+}
+
+/* workers waiting on other tasks run queued ones meanwhile, so nested tasks never deadlock,
+ * only tasks of their own kind at least as urgent as the one waiting, a long library task
+ * never delays playback task waiting for its slices
+ */
+void TaskPool::wait(std::future<void> &future)
+{
+    if (currentWorker < 0) {
+        future.wait();
+        return;
+    }
+
+    Priority first = isBackground(currentWorker) ? PRIORITY_PREFETCH : PRIORITY_PLAYBACK;
+    Priority last  = qMax(first, currentPriority);
+
+    SDL_LockMutex(mutex);
+    waiters++;
+
+    /* done is set before waitCond broadcast under mutex, so checking it under mutex misses nothing */
+    while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        Priority priority = claimTask(first, last);
+
+        if (priority != PRIORITY_COUNT) {
+            SDL_UnlockMutex(mutex);
+            runTask(findTask(currentWorker, priority));
+            SDL_LockMutex(mutex);
+        } else {
+            SDL_CondWait(waitCond, mutex);
+        }
+    }
+
+    waiters--;
+    SDL_UnlockMutex(mutex);
+}
+
+/* most urgent queued task from first to last priority, PRIORITY_COUNT for none, under mutex */
+TaskPool::Priority TaskPool::claimTask(TaskPool::Priority first, TaskPool::Priority last)
+{
+    for (int i = first; i <= last; i++) {
+        if (pending[i] == 0) {
+            continue;
+        }
+
+        pending[i]--;
+        running++;
+
+        return static_cast<Priority>(i);
+    }
+
+    return PRIORITY_COUNT;
+}
+
+/* a task of claimed priority is queued somewhere, claims never exceed queued tasks */
+TaskPool::Task *TaskPool::findTask(int index, TaskPool::Priority priority)
+{
+    Task *task = NULL;
+
+    while (!task) {
+        /* own newest */
+        SDL_LockMutex(queues[index]->mutex);
+        if (!queues[index]->tasks[priority].isEmpty()) {
+            task = queues[index]->tasks[priority].takeLast();
+        }
+        SDL_UnlockMutex(queues[index]->mutex);
+
+        if (task) {
+            break;
+        }
+
+        /* submitted from outside, oldest */
+        SDL_LockMutex(injected.mutex);
+        if (!injected.tasks[priority].isEmpty()) {
+            task = injected.tasks[priority].takeFirst();
+        }
+        SDL_UnlockMutex(injected.mutex);
+
+        if (task) {
+            break;
+        }
+
+        /* steal oldest of others, starting next to us so victims are spread */
+        for (int i = 1; i < queues.size() && !task; i++) {
+            TaskQueue *victim = queues[(index + i) % queues.size()];
+
+            SDL_LockMutex(victim->mutex);
+            if (!victim->tasks[priority].isEmpty()) {
+                task = victim->tasks[priority].takeFirst();
+            }
+            SDL_UnlockMutex(victim->mutex);
+        }
+
+        if (task) {
+            SDL_LockMutex(mutex);
+            stolen++;
+            SDL_UnlockMutex(mutex);
+        }
+    }
+
+    return task;
+}
+
+void TaskPool::runTask(TaskPool::Task *task)
+{
+    bool isCanceled = task->token.isCanceled();
+    qint64 start = av_gettime_relative();
+
+    if (!isCanceled) {
+        /* restored for task that waits on this one */
+        Priority previous = currentPriority;
+        currentPriority = task->priority;
+
+        task->job();
+
+        currentPriority = previous;
+    }
+
+    qint64 end = av_gettime_relative();
+
+    SDL_LockMutex(mutex);
+
+    if (!stats.contains(task->name)) {
+        TaskStats taskStats = {task->name, task->priority, 0, 0, 0, 0, 0};
+        stats.insert(task->name, taskStats);
+    }
+
+    TaskStats &taskStats = stats[task->name];
+    if (isCanceled) {
+        taskStats.canceled++;
+    } else {
+        taskStats.finished++;
+        taskStats.runTime += end - start;
+        taskStats.maxRunTime = qMax(taskStats.maxRunTime, end - start);
+    }
+    taskStats.waitTime += start - task->submitTime;
+
+    running--;
+
+    SDL_UnlockMutex(mutex);
+
+    task->done.set_value();
+    delete task;
+
+    SDL_LockMutex(mutex);
+    if (waiters > 0) {
+        SDL_CondBroadcast(waitCond);
+    }
+    SDL_UnlockMutex(mutex);
+}
+
+void TaskPool::workerLoop(int index)
+{
+    bool isBackgroundWorker = isBackground(index);
+    Priority first = isBackgroundWorker ? PRIORITY_PREFETCH : PRIORITY_PLAYBACK;
+    Priority last  = isBackgroundWorker ? PRIORITY_LIBRARY : PRIORITY_PLAYBACK;
+    SDL_cond *cond = isBackgroundWorker ? backgroundCond : playbackCond;
+
+    while (true) {
+        SDL_LockMutex(mutex);
+
+        Priority priority;
+        while ((priority = claimTask(first, last)) == PRIORITY_COUNT && !isQuit) {
+            SDL_CondWait(cond, mutex);
+        }
+
+        if (priority == PRIORITY_COUNT) {
+            SDL_UnlockMutex(mutex);
+            break;
+        }
+
+        SDL_UnlockMutex(mutex);
+
+        runTask(findTask(index, priority));
+    }
+}
+
+TaskPool::Stats TaskPool::getStats()
+{
+    Stats poolStats;
+
+    SDL_LockMutex(mutex);
+
+    poolStats.threadCount = workers.size();
+    poolStats.queued = 0;
+    for (int i = 0; i < PRIORITY_COUNT; i++) {
+        poolStats.queued += pending[i];
+    }
+    poolStats.running = running;
+    poolStats.stolen = stolen;
+    poolStats.tasks = stats.values();
+
+    SDL_UnlockMutex(mutex);
+
+    return poolStats;
+}
@@ -0,0 +1,125 @@
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <QThread>
+#include <QList>
+#include <QMap>
+#include <QVector>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+
+#include "SDL2/SDL.h"
+
+/* Shared flag telling tasks to give up, copies refer to the same flag. */
+class CancelToken
+{
+public:
+    explicit CancelToken();
+
+    void cancel();
+    bool isCanceled() const;
+
+private:
+    std::shared_ptr<std::atomic<bool>> canceled;
+};
+
+class TaskWorker;
+
+/* Worker threads shared by the whole player for short background jobs.
+ * Playback tasks run on one worker per core at normal priority, prefetch &
+ * library tasks on half as many workers of their own at lowered priority,
+ * as an unprivileged thread can lower its priority but never raise it back.
+ * Each worker has own queues, takes newest of them first, then oldest of
+ * pool queue, then steals oldest of other workers, higher priority first.
+ * Long lived playback threads (reading, video, audio) stay dedicated threads.
+ */
+class TaskPool
+{
+public:
+    enum Priority {
+        PRIORITY_PLAYBACK,  // needed for next frame, conversion slices
+        PRIORITY_PREFETCH,  // preloading next playlist item
+        PRIORITY_LIBRARY,   // thumbnails, probing, scanning
+        PRIORITY_COUNT
+    };
+
+    /* totals of tasks of one name */
+    struct TaskStats
+    {
+        QString name;
+        TaskPool::Priority priority;
+        int finished;
+        int canceled;           // token canceled before it started, job not run
+        qint64 waitTime;        // queued, in microseconds
+        qint64 runTime;         // in microseconds
+        qint64 maxRunTime;
+    };
+
+    struct Stats
+    {
+        int threadCount;
+        int queued;
+        int running;
+        int stolen;             // tasks taken from queue of another worker
+        QList<TaskPool::TaskStats> tasks;
+    };
+
+    static TaskPool *instance();
+
+    std::future<void> submit(QString name, TaskPool::Priority priority, std::function<void ()> job,
+                             CancelToken token = CancelToken());
+    void wait(std::future<void> &future);
+    TaskPool::Stats getStats();
+    int getThreadCount();
+
+private:
+    struct Task
+    {
+        QString name;
+        TaskPool::Priority priority;
+        std::function<void ()> job;
+        CancelToken token;
+        std::promise<void> done;
+        qint64 submitTime;
+    };
+
+    /* deque per priority of one worker, or of pool for tasks from other threads */
+    struct TaskQueue
+    {
+        SDL_mutex *mutex;
+        QList<Task *> tasks[PRIORITY_COUNT];
+    };
+
+    friend class TaskWorker;
+
+    explicit TaskPool(int threadCount);
+    ~TaskPool();
+
+    bool isBackground(int index);
+    void workerLoop(int index);
+    TaskPool::Priority claimTask(TaskPool::Priority first, TaskPool::Priority last);
+    Task *findTask(int index, TaskPool::Priority priority);
+    void runTask(Task *task);
+
+    QVector<TaskWorker *> workers;  // playback workers first, background after
+    QVector<TaskQueue *> queues;    // one per worker
+    TaskQueue injected;             // submitted by threads outside pool
+    int playbackCount;              // workers running playback tasks
+
+    SDL_mutex *mutex;               // guards counts, stats & quit
+    SDL_cond *playbackCond;         // signalled while playback task queued
+    SDL_cond *backgroundCond;       // signalled while prefetch or library task queued
+    SDL_cond *waitCond;             // broadcast on task queued or done while someone waits
+
+    int pending[PRIORITY_COUNT];    // queued tasks not claimed by a worker yet
+    int running;
+    int waiters;                    // workers blocked in wait()
+    int stolen;
+    bool isQuit;
+
+    QMap<QString, TaskPool::TaskStats> stats;
+};
+
+#endif // TASKPOOL_H
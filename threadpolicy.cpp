@@ -0,0 +1,370 @@
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+#include "SDL2/SDL.h"
+
+#include "threadpolicy.h"
+
+/* Real time priority taken for fifo & rr without one given. */
+#define POLICY_DEFAULT_RT_PRIORITY (10)
+/* Nice of threads running prefetch & library work, can't be raised back without privilege. */
+#define POLICY_BACKGROUND_NICE (10)
+
+struct PolicyConfig
+{
+    ThreadPolicy::Policy policy;
+    int value;          // nice level or real time priority
+    QList<int> cpus;    // empty for any
+};
+
+static PolicyConfig configs[ThreadPolicy::ROLE_COUNT];
+static QString effective[ThreadPolicy::ROLE_COUNT];     // empty until thread applied it
+
+static const char *roleNames[ThreadPolicy::ROLE_COUNT] = {"demux", "video", "present", "audio"};
+
+/* guards configs & effective, threads apply while gui reads report */
+static SDL_mutex *policyMutex()
+{
+    static SDL_mutex *mutex = SDL_CreateMutex();
+
+    return mutex;
+}
+
+#ifdef Q_OS_LINUX
+struct ProcessDefaults
+{
+    int nice;
+    cpu_set_t cpus;
+};
+
+/* scheduling of process at start, taken by first thread asking, which is main
+ * applying present before it changes anything, or a thread still inheriting it
+ */
+static const ProcessDefaults &processDefaults()
+{
+    static ProcessDefaults defaults = []() {
+        ProcessDefaults process;
+
+        errno = 0;
+        process.nice = getpriority(PRIO_PROCESS, syscall(SYS_gettid));
+        if (errno != 0) {
+            process.nice = 0;
+        }
+
+        CPU_ZERO(&process.cpus);
+        if (pthread_getaffinity_np(pthread_self(), sizeof(process.cpus), &process.cpus) != 0) {
+            for (int cpu = 0; cpu < sysconf(_SC_NPROCESSORS_ONLN) && cpu < CPU_SETSIZE; cpu++) {
+                CPU_SET(cpu, &process.cpus);
+            }
+        }
+
+        return process;
+    }();
+
+    return defaults;
+}
+#endif
+
+bool ThreadPolicy::parseRole(QString name, ThreadPolicy::Role *role)
+{
+    for (int i = 0; i < ROLE_COUNT; i++) {
+        if (name == roleNames[i]) {
+            *role = static_cast<Role>(i);
+            return true;
+        }
+    }
+
+    qDebug() << "Unknown thread:" << name << ", one of demux, video, present, audio.";
+    return false;
+}
+
+bool ThreadPolicy::parseScheduling(QString spec)
+{
+    foreach (QString item, spec.split(',', QString::SkipEmptyParts)) {
+        QStringList parts = item.split('=');
+        Role role;
+
+        if (parts.size() != 2 || !parseRole(parts[0].trimmed(), &role)) {
+            qDebug() << "Bad thread scheduling:" << item;
+            return false;
+        }
+
+        QStringList policy = parts[1].trimmed().split(':');
+        bool isNumber = true;
+        int value = (policy.size() > 1) ? policy[1].toInt(&isNumber) : 0;
+
+        PolicyConfig config = configs[role];
+        if (policy[0] == "nice" && isNumber) {
+            config.policy = POLICY_NICE;
+            config.value = qBound(-20, value, 19);
+        } else if ((policy[0] == "fifo" || policy[0] == "rr") && isNumber) {
+            config.policy = (policy[0] == "fifo") ? POLICY_FIFO : POLICY_RR;
+            config.value = (policy.size() > 1) ? value : POLICY_DEFAULT_RT_PRIORITY;
+        } else if (policy[0] == "default") {
+            config.policy = POLICY_DEFAULT;
+        } else {
+            qDebug() << "Bad thread scheduling:" << item << ", nice:<level>, fifo:<priority>, rr:<priority> or default.";
+            return false;
+        }
+
+        SDL_LockMutex(policyMutex());
+        configs[role] = config;
+        SDL_UnlockMutex(policyMutex());
+    }
+
+    return true;
+}
+
+bool ThreadPolicy::parseAffinity(QString spec)
+{
+    foreach (QString item, spec.split(',', QString::SkipEmptyParts)) {
+        QStringList parts = item.split('=');
+        Role role;
+
+        if (parts.size() != 2 || !parseRole(parts[0].trimmed(), &role)) {
+            qDebug() << "Bad thread affinity:" << item;
+            return false;
+        }
+
+        /* cpus joined by '+' inside one item, commas separate threads: "video=0+2-3" */
+        QList<int> cpus;
+        foreach (QString range, parts[1].split('+', QString::SkipEmptyParts)) {
+            QStringList bounds = range.split('-');
+            bool isFirst = false;
+            bool isLast = true;
+            int first = bounds[0].toInt(&isFirst);
+            int last = (bounds.size() > 1) ? bounds[1].toInt(&isLast) : first;
+
+            if (bounds.size() > 2 || !isFirst || (bounds.size() > 1 && !isLast) || first < 0 || last < first) {
+                qDebug() << "Bad thread affinity:" << item;
+                return false;
+            }
+
+            for (int cpu = first; cpu <= last; cpu++) {
+                cpus.append(cpu);
+            }
+        }
+
+        SDL_LockMutex(policyMutex());
+        configs[role].cpus = cpus;
+        SDL_UnlockMutex(policyMutex());
+    }
+
+    return true;
+}
+
+/* nice of calling thread, down to what RLIMIT_NICE allows while denied */
+bool ThreadPolicy::setNice(int nice, QString *note)
+{
+#ifdef Q_OS_LINUX
+    pid_t tid = syscall(SYS_gettid);
+
+    if (setpriority(PRIO_PROCESS, tid, nice) == 0) {
+        return true;
+    }
+
+    if (errno != EACCES && errno != EPERM) {
+        *note = QString("nice %1 failed: %2").arg(nice).arg(strerror(errno));
+        return false;
+    }
+
+    /* ceiling is 20 - rlimit */
+    struct rlimit limit;
+    int allowed = 20;
+    if (getrlimit(RLIMIT_NICE, &limit) == 0) {
+        allowed = (limit.rlim_cur == RLIM_INFINITY) ? -20 : 20 - static_cast<int>(limit.rlim_cur);
+    }
+
+    errno = 0;
+    int current = getpriority(PRIO_PROCESS, tid);
+    if (errno == 0 && allowed > nice && allowed < current && setpriority(PRIO_PROCESS, tid, allowed) == 0) {
+        *note = QString("nice %1 denied, %2 by RLIMIT_NICE").arg(nice).arg(allowed);
+        return true;
+    }
+
+    *note = QString("nice %1 denied").arg(nice);
+#else
+    Q_UNUSED(nice);
+    *note = "not supported on this system";
+#endif
+
+    return false;
+}
+
+/* scheduling of calling thread as it is now */
+QString ThreadPolicy::describe()
+{
+#ifdef Q_OS_LINUX
+    int policy;
+    struct sched_param param;
+    QString text;
+
+    if (pthread_getschedparam(pthread_self(), &policy, &param) == 0 && (policy == SCHED_FIFO || policy == SCHED_RR)) {
+        text = QString("%1 %2").arg(policy == SCHED_FIFO ? "fifo" : "rr").arg(param.sched_priority);
+    } else {
+        text = QString("nice %1").arg(getpriority(PRIO_PROCESS, syscall(SYS_gettid)));
+    }
+
+    /* cpus as ranges, "all" while not restricted */
+    cpu_set_t set;
+    QStringList ranges;
+    int count = 0;
+
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, &set)) {
+                continue;
+            }
+
+            int last = cpu;
+            while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &set)) {
+                last++;
+            }
+            ranges << ((last > cpu) ? QString("%1-%2").arg(cpu).arg(last) : QString::number(cpu));
+            count += last - cpu + 1;
+            cpu = last;
+        }
+    }
+
+    text += ", cpus " + ((count == 0 || count == sysconf(_SC_NPROCESSORS_ONLN)) ? QString("all") : ranges.join('+'));
+
+    return text;
+#else
+    return "default";
+#endif
+}
+
+/* threads inherit scheduling & cpus of thread creating them, so whatever is
+ * not configured is set back to process defaults instead of left as inherited
+ */
+void ThreadPolicy::setThread(ThreadPolicy::Policy policy, int value, QList<int> cpus, QStringList *notes)
+{
+#ifdef Q_OS_LINUX
+    const ProcessDefaults &defaults = processDefaults();
+
+    if (policy == POLICY_FIFO || policy == POLICY_RR) {
+        int schedPolicy = (policy == POLICY_FIFO) ? SCHED_FIFO : SCHED_RR;
+        struct sched_param param;
+        param.sched_priority = qBound(sched_get_priority_min(schedPolicy), value, sched_get_priority_max(schedPolicy));
+
+        int ret = pthread_setschedparam(pthread_self(), schedPolicy, &param);
+        if (ret != 0) {
+            /* no CAP_SYS_NICE or RLIMIT_RTPRIO, highest nice left */
+            *notes << QString("%1 %2 denied: %3").arg(schedPolicy == SCHED_FIFO ? "fifo" : "rr")
+                      .arg(param.sched_priority).arg(strerror(ret));
+
+            QString note;
+            setNice(-20, &note);
+            if (!note.isEmpty()) {
+                *notes << note;
+            }
+        }
+    } else {
+        /* real time inherited from gui thread has to be dropped before nice counts */
+        int current;
+        struct sched_param param;
+        if (pthread_getschedparam(pthread_self(), &current, &param) == 0 && current != SCHED_OTHER) {
+            param.sched_priority = 0;
+            int ret = pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+            if (ret != 0) {
+                *notes << QString("leaving real time failed: %1").arg(strerror(ret));
+            }
+        }
+
+        QString note;
+        setNice((policy == POLICY_NICE) ? value : defaults.nice, &note);
+        if (!note.isEmpty()) {
+            *notes << note;
+        }
+    }
+
+    cpu_set_t set = defaults.cpus;
+    if (!cpus.isEmpty()) {
+        CPU_ZERO(&set);
+        foreach (int cpu, cpus) {
+            if (cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+    }
+
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0) {
+        *notes << QString("affinity failed: %1").arg(strerror(ret));
+    }
+#else
+    Q_UNUSED(value);
+    if (policy != POLICY_DEFAULT || !cpus.isEmpty()) {
+        *notes << "not supported on this system";
+    }
+#endif
+}
+
+/* called by each pipeline thread on itself, effective result kept for report */
+void ThreadPolicy::apply(ThreadPolicy::Role role)
+{
+    SDL_LockMutex(policyMutex());
+    PolicyConfig config = configs[role];
+    SDL_UnlockMutex(policyMutex());
+
+    QStringList notes;
+    setThread(config.policy, config.value, config.cpus, &notes);
+
+    QString text = describe();
+    if (!notes.isEmpty()) {
+        text += " (" + notes.join(", ") + ")";
+    }
+
+    SDL_LockMutex(policyMutex());
+    effective[role] = text;
+    SDL_UnlockMutex(policyMutex());
+
+    qDebug() << "Thread" << roleNames[role] << "scheduling:" << text;
+}
+
+/* called by threads outside pipeline roles on themselves, like pool workers */
+void ThreadPolicy::applyDefault()
+{
+    QStringList notes;
+    setThread(POLICY_DEFAULT, 0, QList<int>(), &notes);
+
+    if (!notes.isEmpty()) {
+        qDebug() << "Thread default scheduling:" << notes.join(", ");
+    }
+}
+
+/* called by threads doing background work on themselves, for good */
+void ThreadPolicy::applyBackground()
+{
+    QStringList notes;
+    setThread(POLICY_NICE, POLICY_BACKGROUND_NICE, QList<int>(), &notes);
+
+    if (!notes.isEmpty()) {
+        qDebug() << "Thread background scheduling:" << notes.join(", ");
+    }
+}
+
+/* one line per thread applied so far, "video: fifo 10, cpus 2-3" */
+QStringList ThreadPolicy::report()
+{
+    QStringList lines;
+
+    SDL_LockMutex(policyMutex());
+    for (int i = 0; i < ROLE_COUNT; i++) {
+        if (!effective[i].isEmpty()) {
+            lines << QString("%1: %2").arg(roleNames[i]).arg(effective[i]);
+        }
+    }
+    SDL_UnlockMutex(policyMutex());
+
+    return lines;
+}
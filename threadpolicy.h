@@ -0,0 +1,49 @@
+#ifndef THREADPOLICY_H
+#define THREADPOLICY_H
+
+#include <QString>
+#include <QStringList>
+
+/* Scheduling & cpu affinity of pipeline threads, set before playback from
+ * command line, applied by each thread to itself when it starts. Threads not
+ * configured, or not in a role, are set back to what the process started
+ * with, as they would otherwise inherit gui thread's policy. Real time
+ * policies need CAP_SYS_NICE or RLIMIT_RTPRIO, without them thread falls back
+ * to highest priority RLIMIT_NICE allows, then to default. Linux only.
+ */
+class ThreadPolicy
+{
+public:
+    enum Role {
+        ROLE_DEMUX,     // reading thread, decoders are opened there
+        ROLE_VIDEO,     // video decode & frame timing
+        ROLE_PRESENT,   // gui thread painting frames
+        ROLE_AUDIO,     // audio device callback
+        ROLE_COUNT
+    };
+
+    enum Policy {
+        POLICY_DEFAULT, // as process started
+        POLICY_NICE,    // SCHED_OTHER with nice level
+        POLICY_FIFO,
+        POLICY_RR
+    };
+
+    /* "video=fifo:10,audio=rr:20,demux=nice:-5" */
+    static bool parseScheduling(QString spec);
+    /* "video=0+2-3,audio=1", cpus of one thread joined by + */
+    static bool parseAffinity(QString spec);
+
+    static void apply(ThreadPolicy::Role role);
+    static void applyDefault();
+    static void applyBackground();
+    static QStringList report();
+
+private:
+    static bool parseRole(QString name, ThreadPolicy::Role *role);
+    static bool setNice(int nice, QString *note);
+    static void setThread(ThreadPolicy::Policy policy, int value, QList<int> cpus, QStringList *notes);
+    static QString describe();
+};
+
+#endif // THREADPOLICY_H
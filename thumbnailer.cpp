@@ -0,0 +1,314 @@
+#include <QDebug>
+
+#include "thumbnailer.h"
+
+/* Thumbnail width, height follows video aspect ratio. */
+#define THUMBNAIL_WIDTH 160
+/* Length of one thumbnail time bucket, in microseconds. */
+#define THUMBNAIL_BUCKET_TIME (5 * AV_TIME_BASE)
+/* Buckets generated on each side of the cursor after the one under it. */
+#define THUMBNAIL_PREFETCH 4
+/* Maximum thumbnail count kept in cache. */
+#define THUMBNAIL_CACHE_SIZE 300
+/* Maximum packets read to find a keyframe for one bucket. */
+#define THUMBNAIL_MAX_PACKETS 512
+
+Thumbnailer::Thumbnailer() :
+    isQuit(false),
+    isTaskActive(false),
+    requestBucket(0),
+    requestSerial(0),
+    hasRequest(false),
+    cache(THUMBNAIL_CACHE_SIZE),
+    pFormatCtx(NULL),
+    pCodecCtx(NULL),
+    videoStream(NULL),
+    videoIndex(-1),
+    frame(av_frame_alloc()),
+    swsCtx(NULL)
+{
+    mutex   = SDL_CreateMutex();
+}
+
+Thumbnailer::~Thumbnailer()
+{
+    SDL_LockMutex(mutex);
+    isQuit = true;
+    requestSerial++;
+    token.cancel();
+    SDL_UnlockMutex(mutex);
+
+    if (task.valid()) {
+        task.wait();
+    }
+
+    closeFile();
+    av_frame_free(&frame);
+
+    SDL_DestroyMutex(mutex);
+}
+
+qint64 Thumbnailer::timeToBucket(qint64 time)
+{
+    return time / THUMBNAIL_BUCKET_TIME;
+}
+
+QString Thumbnailer::cacheKey(QString file, qint64 bucket)
+{
+    return QString("%1|%2").arg(file).arg(bucket);
+}
+
+bool Thumbnailer::getThumbnail(QString file, qint64 time, QImage *image)
+{
+    bool found = false;
+
+    SDL_LockMutex(mutex);
+    QImage *cached = cache.object(cacheKey(file, timeToBucket(time)));
+    if (cached) {
+        *image = *cached;
+        found = true;
+    }
+    SDL_UnlockMutex(mutex);
+
+    return found;
+}
+
+/* newest request replaces pending one, generation restarts around new cursor */
+void Thumbnailer::requestThumbnail(QString file, qint64 time)
+{
+    qint64 bucket = timeToBucket(time);
+
+    SDL_LockMutex(mutex);
+    if (!hasRequest || requestFile != file || requestBucket != bucket) {
+        requestFile = file;
+        requestBucket = bucket;
+        requestSerial++;
+        hasRequest = true;
+    }
+
+    /* running task picks new request up by serial */
+    if (!isTaskActive && !isQuit) {
+        isTaskActive = true;
+        task = TaskPool::instance()->submit("thumbnail", TaskPool::PRIORITY_LIBRARY,
+                                            [this]() { generate(); }, token);
+    }
+    SDL_UnlockMutex(mutex);
+}
+
+void Thumbnailer::cancel()
+{
+    SDL_LockMutex(mutex);
+    hasRequest = false;
+    requestSerial++;
+    SDL_UnlockMutex(mutex);
+}
+
+bool Thumbnailer::openFile(QString file)
+{
+    AVCodec *pCodec;
+
+    closeFile();
+
+    if (avformat_open_input(&pFormatCtx, file.toLocal8Bit().data(), NULL, NULL) != 0) {
+        qDebug() << "Thumbnail open file failed.";
+        return false;
+    }
+
+    if (avformat_find_stream_info(pFormatCtx, NULL) < 0) {
+        qDebug() << "Thumbnail could't find stream infomation.";
+        closeFile();
+        return false;
+    }
+
+    videoIndex = av_find_best_stream(pFormatCtx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (videoIndex < 0) {
+        closeFile();
+        return false;
+    }
+
+    /* only video stream is needed */
+    for (unsigned int i = 0; i < pFormatCtx->nb_streams; i++) {
+        if (static_cast<int>(i) != videoIndex) {
+            pFormatCtx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    videoStream = pFormatCtx->streams[videoIndex];
+
+    pCodecCtx = avcodec_alloc_context3(NULL);
+    avcodec_parameters_to_context(pCodecCtx, videoStream->codecpar);
+
+    if ((pCodec = avcodec_find_decoder(pCodecCtx->codec_id)) == NULL) {
+        qDebug() << "Thumbnail video decoder not found.";
+        closeFile();
+        return false;
+    }
+
+    /* decode keyframes only, one thread is enough & leave cpu to playback */
+    pCodecCtx->skip_frame = AVDISCARD_NONKEY;
+    pCodecCtx->thread_count = 1;
+
+    if (avcodec_open2(pCodecCtx, pCodec, NULL) < 0) {
+        qDebug() << "Thumbnail could not open video decoder.";
+        closeFile();
+        return false;
+    }
+
+    currentFile = file;
+
+    return true;
+}
+
+void Thumbnailer::closeFile()
+{
+    if (pCodecCtx) {
+        avcodec_free_context(&pCodecCtx);
+    }
+
+    if (pFormatCtx) {
+        avformat_close_input(&pFormatCtx);
+    }
+
+    if (swsCtx) {
+        sws_freeContext(swsCtx);
+        swsCtx = NULL;
+    }
+
+    videoStream = NULL;
+    videoIndex = -1;
+    currentFile.clear();
+}
+
+bool Thumbnailer::decodeThumbnail(qint64 bucket, int serial)
+{
+    AVPacket packet;
+    int ret;
+    bool gotFrame = false;
+
+    /* take thumbnail at middle of bucket */
+    qint64 time = bucket * THUMBNAIL_BUCKET_TIME + THUMBNAIL_BUCKET_TIME / 2;
+    if (pFormatCtx->duration > 0 && time >= pFormatCtx->duration) {
+        return false;
+    }
+
+    qint64 pos = av_rescale_q(time, av_get_time_base_q(), videoStream->time_base);
+    if (av_seek_frame(pFormatCtx, videoIndex, pos, AVSEEK_FLAG_BACKWARD) < 0) {
+        return false;
+    }
+
+    avcodec_flush_buffers(pCodecCtx);
+
+    for (int i = 0; i < THUMBNAIL_MAX_PACKETS && !gotFrame; i++) {
+        /* give up while request changed */
+        if (serial != requestSerial) {
+            return false;
+        }
+
+        if (av_read_frame(pFormatCtx, &packet) < 0) {
+            break;
+        }
+
+        if (packet.stream_index != videoIndex || !(packet.flags & AV_PKT_FLAG_KEY)) {
+            av_packet_unref(&packet);
+            continue;
+        }
+
+        ret = avcodec_send_packet(pCodecCtx, &packet);
+        av_packet_unref(&packet);
+        if (ret < 0) {
+            continue;
+        }
+
+        /* drain decoder, so delayed keyframe comes out without next packets */
+        avcodec_send_packet(pCodecCtx, NULL);
+        if (avcodec_receive_frame(pCodecCtx, frame) == 0) {
+            gotFrame = true;
+        } else {
+            avcodec_flush_buffers(pCodecCtx);
+        }
+    }
+
+    if (!gotFrame) {
+        return false;
+    }
+
+    int width  = THUMBNAIL_WIDTH;
+    int height = THUMBNAIL_WIDTH * frame->height / FFMAX(frame->width, 1);
+    if (frame->sample_aspect_ratio.num > 0 && frame->sample_aspect_ratio.den > 0) {
+        height = height * frame->sample_aspect_ratio.den / frame->sample_aspect_ratio.num;
+    }
+    height = FFMAX(height & ~1, 2);
+
+    /* scale directly to thumbnail size */
+    swsCtx = sws_getCachedContext(swsCtx, frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+                                  width, height, AV_PIX_FMT_RGB32, SWS_BILINEAR, NULL, NULL, NULL);
+    if (!swsCtx) {
+        av_frame_unref(frame);
+        return false;
+    }
+
+    QImage *image = new QImage(width, height, QImage::Format_RGB32);
+    uint8_t *dst[] = {image->bits()};
+    int dstStride[] = {image->bytesPerLine()};
+
+    sws_scale(swsCtx, frame->data, frame->linesize, 0, frame->height, dst, dstStride);
+    av_frame_unref(frame);
+
+    SDL_LockMutex(mutex);
+    cache.insert(cacheKey(currentFile, bucket), image);
+    SDL_UnlockMutex(mutex);
+
+    return true;
+}
+
+/* generate until no request is left, next request submits task again */
+void Thumbnailer::generate()
+{
+    while (true) {
+        SDL_LockMutex(mutex);
+        if (!hasRequest || isQuit) {
+            isTaskActive = false;
+            SDL_UnlockMutex(mutex);
+            break;
+        }
+
+        QString file  = requestFile;
+        qint64 cursor = requestBucket;
+        int serial    = requestSerial;
+        SDL_UnlockMutex(mutex);
+
+        if (file != currentFile && !openFile(file)) {
+            SDL_LockMutex(mutex);
+            if (serial == requestSerial) {
+                hasRequest = false;
+            }
+            SDL_UnlockMutex(mutex);
+            continue;
+        }
+
+        /* bucket under cursor first, then neighbours by distance */
+        for (int distance = 0; distance <= THUMBNAIL_PREFETCH; distance++) {
+            qint64 buckets[] = {cursor + distance, cursor - distance};
+
+            for (int i = 0; i < (distance ? 2 : 1); i++) {
+                if (serial != requestSerial || buckets[i] < 0) {
+                    continue;
+                }
+
+                SDL_LockMutex(mutex);
+                bool cached = cache.contains(cacheKey(file, buckets[i]));
+                SDL_UnlockMutex(mutex);
+
+                if (!cached && decodeThumbnail(buckets[i], serial)) {
+                    emit gotThumbnail(file, buckets[i]);
+                }
+            }
+        }
+
+        SDL_LockMutex(mutex);
+        if (serial == requestSerial) {
+            hasRequest = false;
+        }
+        SDL_UnlockMutex(mutex);
+    }
+}
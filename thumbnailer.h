@@ -0,0 +1,73 @@
+#ifndef THUMBNAILER_H
+#define THUMBNAILER_H
+
+#include <QObject>
+#include <QImage>
+#include <QCache>
+#include <future>
+
+extern "C"
+{
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+#include "libswscale/swscale.h"
+}
+
+#include "SDL2/SDL.h"
+
+#include "taskpool.h"
+
+/* Generate seek bar preview images in background, with its own demuxer
+ * & decoder, so it never touches the playback pipeline. Runs as library
+ * task on TaskPool, at most one at a time, while requests are pending.
+ */
+class Thumbnailer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Thumbnailer();
+    ~Thumbnailer();
+
+    bool getThumbnail(QString file, qint64 time, QImage *image);
+    void requestThumbnail(QString file, qint64 time);
+    void cancel();
+    qint64 timeToBucket(qint64 time);
+
+private:
+    void generate();
+    bool openFile(QString file);
+    void closeFile();
+    bool decodeThumbnail(qint64 bucket, int serial);
+    QString cacheKey(QString file, qint64 bucket);
+
+    bool isQuit;
+
+    SDL_mutex *mutex;
+
+    bool isTaskActive;          // generate() queued or running
+    std::future<void> task;
+    CancelToken token;          // canceled on quit, task skipped if not started
+
+    QString requestFile;    // file of newest request
+    qint64 requestBucket;   // bucket under cursor of newest request
+    int requestSerial;      // increased by every request or cancel
+    bool hasRequest;
+
+    QCache<QString, QImage> cache;  // LRU cache, key is file & time bucket
+
+    QString currentFile;
+    AVFormatContext *pFormatCtx;
+    AVCodecContext *pCodecCtx;
+    AVStream *videoStream;
+    int videoIndex;
+
+    AVFrame *frame;
+    struct SwsContext *swsCtx;
+
+signals:
+    void gotThumbnail(QString file, qint64 bucket);
+
+};
+
+#endif // THUMBNAILER_H
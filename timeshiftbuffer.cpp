@@ -0,0 +1,234 @@
+#include <QDebug>
+#include <QDir>
+#include <QStandardPaths>
+
+#include "timeshiftbuffer.h"
+
+/* Size of one storage block, larger packets are not recorded. */
+#define TIMESHIFT_BLOCK_SIZE (4 * 1024 * 1024)
+
+TimeshiftBuffer::TimeshiftBuffer() :
+    memorySlots(0),
+    currentSlot(-1),
+    blockUsed(0),
+    spillData(NULL),
+    first(0),
+    duration(0)
+{
+
+}
+
+TimeshiftBuffer::~TimeshiftBuffer()
+{
+    close();
+}
+
+/* caps in bytes, false while they hold less than two blocks */
+bool TimeshiftBuffer::open(qint64 memoryCap, qint64 diskCap)
+{
+    close();
+
+    memorySlots = static_cast<int>(memoryCap / TIMESHIFT_BLOCK_SIZE);
+    int diskSlots = static_cast<int>(diskCap / TIMESHIFT_BLOCK_SIZE);
+
+    if (diskSlots > 0) {
+        QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+        QDir().mkpath(dir);
+        spillFile.setFileTemplate(dir + "/timeshift-XXXXXX");
+
+        qint64 size = static_cast<qint64>(diskSlots) * TIMESHIFT_BLOCK_SIZE;
+        if (!spillFile.open() || !spillFile.resize(size) || (spillData = spillFile.map(0, size)) == NULL) {
+            qDebug() << "Timeshift spill file failed, memory only.";
+            spillFile.close();
+            spillData = NULL;
+            diskSlots = 0;
+        }
+    }
+
+    if (memorySlots + diskSlots < 2) {
+        close();
+        return false;
+    }
+
+    /* memory blocks allocated at first use */
+    for (int i = 0; i < memorySlots + diskSlots; i++) {
+        blocks.append(i < memorySlots ? NULL : spillData + static_cast<qint64>(i - memorySlots) * TIMESHIFT_BLOCK_SIZE);
+        freeSlots.enqueue(i);
+    }
+
+    qDebug() << "Timeshift buffer," << memorySlots << "memory blocks," << diskSlots << "disk blocks";
+
+    return true;
+}
+
+void TimeshiftBuffer::close()
+{
+    for (int i = 0; i < memorySlots && i < blocks.size(); i++) {
+        delete[] blocks[i];
+    }
+    blocks.clear();
+    memorySlots = 0;
+
+    freeSlots.clear();
+    usedSlots.clear();
+    currentSlot = -1;
+    blockUsed = 0;
+
+    if (spillData) {
+        spillFile.unmap(spillData);
+        spillData = NULL;
+    }
+    spillFile.close();
+
+    entries.clear();
+    keyframes.clear();
+    first = 0;
+    duration = 0;
+}
+
+/* take free block, memory first, or overwrite oldest one */
+void TimeshiftBuffer::nextBlock()
+{
+    int slot;
+
+    if (!freeSlots.isEmpty()) {
+        slot = freeSlots.dequeue();
+    } else {
+        slot = usedSlots.dequeue();
+
+        while (!entries.isEmpty() && entries.first().slot == slot) {
+            entries.dequeue();
+            first++;
+        }
+
+        while (!keyframes.isEmpty() && keyframes.first() < first) {
+            keyframes.dequeue();
+        }
+    }
+
+    if (!blocks[slot]) {
+        blocks[slot] = new uchar[TIMESHIFT_BLOCK_SIZE];
+    }
+
+    usedSlots.enqueue(slot);
+    currentSlot = slot;
+    blockUsed = 0;
+}
+
+void TimeshiftBuffer::write(AVPacket *packet, double time, bool isKey)
+{
+    if (blocks.isEmpty()) {
+        return;
+    }
+
+    if (packet->size > TIMESHIFT_BLOCK_SIZE) {
+        qDebug() << "Timeshift packet too large, size:" << packet->size;
+        return;
+    }
+
+    if (currentSlot < 0 || blockUsed + packet->size > TIMESHIFT_BLOCK_SIZE) {
+        nextBlock();
+    }
+
+    memcpy(blocks[currentSlot] + blockUsed, packet->data, packet->size);
+
+    Entry entry;
+    entry.slot        = currentSlot;
+    entry.offset      = blockUsed;
+    entry.size        = packet->size;
+    entry.streamIndex = packet->stream_index;
+    entry.flags       = packet->flags;
+    entry.pts         = packet->pts;
+    entry.dts         = packet->dts;
+    entry.duration    = packet->duration;
+    entry.time        = time;
+
+    blockUsed += packet->size;
+
+    if (isKey) {
+        keyframes.enqueue(endSeq());
+    }
+    entries.enqueue(entry);
+
+    duration = entries.last().time - entries.first().time;
+}
+
+/* copy of recorded packet, false while it is overwritten or not recorded yet */
+bool TimeshiftBuffer::read(qint64 seq, AVPacket *packet)
+{
+    if (seq < first || seq >= endSeq()) {
+        return false;
+    }
+
+    const Entry &entry = entries.at(static_cast<int>(seq - first));
+
+    if (av_new_packet(packet, entry.size) < 0) {
+        return false;
+    }
+
+    memcpy(packet->data, blocks[entry.slot] + entry.offset, entry.size);
+    packet->stream_index = entry.streamIndex;
+    packet->flags        = entry.flags;
+    packet->pts          = entry.pts;
+    packet->dts          = entry.dts;
+    packet->duration     = entry.duration;
+
+    return true;
+}
+
+qint64 TimeshiftBuffer::firstSeq()
+{
+    return first;
+}
+
+qint64 TimeshiftBuffer::endSeq()
+{
+    return first + entries.size();
+}
+
+/* last keyframe at or before time, oldest keyframe if time is older, -1 if none */
+qint64 TimeshiftBuffer::findKeyframe(double time)
+{
+    if (keyframes.isEmpty()) {
+        return -1;
+    }
+
+    int low = 0;
+    int high = keyframes.size() - 1;
+
+    while (low < high) {
+        int mid = (low + high + 1) / 2;
+        if (packetTime(keyframes.at(mid)) <= time) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    return keyframes.at(low);
+}
+
+qint64 TimeshiftBuffer::lastKeyframe()
+{
+    return keyframes.isEmpty() ? -1 : keyframes.last();
+}
+
+double TimeshiftBuffer::packetTime(qint64 seq)
+{
+    if (seq < first || seq >= endSeq()) {
+        return 0;
+    }
+
+    return entries.at(static_cast<int>(seq - first)).time;
+}
+
+double TimeshiftBuffer::newestTime()
+{
+    return entries.isEmpty() ? 0 : entries.last().time;
+}
+
+/* seconds recorded */
+double TimeshiftBuffer::getDuration()
+{
+    return duration;
+}
@@ -0,0 +1,71 @@
+#ifndef TIMESHIFTBUFFER_H
+#define TIMESHIFTBUFFER_H
+
+#include <QQueue>
+#include <QVector>
+#include <QTemporaryFile>
+
+extern "C"
+{
+#include "libavcodec/avcodec.h"
+}
+
+/* Record live packets into bounded ring of blocks, memory blocks first,
+ * then blocks of a memory mapped spill file. Oldest block is overwritten
+ * while all are used. Packets are numbered by sequence, keyframes indexed
+ * for seeking. Used by decoder thread only.
+ */
+class TimeshiftBuffer
+{
+public:
+    explicit TimeshiftBuffer();
+    ~TimeshiftBuffer();
+
+    bool open(qint64 memoryCap, qint64 diskCap);
+    void close();
+
+    void write(AVPacket *packet, double time, bool isKey);
+    bool read(qint64 seq, AVPacket *packet);
+
+    qint64 firstSeq();
+    qint64 endSeq();
+    qint64 findKeyframe(double time);
+    qint64 lastKeyframe();
+    double packetTime(qint64 seq);
+    double newestTime();
+    double getDuration();
+
+private:
+    struct Entry
+    {
+        int slot;
+        int offset;
+        int size;
+        int streamIndex;
+        int flags;
+        qint64 pts;
+        qint64 dts;
+        qint64 duration;
+        double time;        // seconds on playing clock
+    };
+
+    void nextBlock();
+
+    QVector<uchar *> blocks;    // block storage, memory slots then spill file slots
+    int memorySlots;
+    QQueue<int> freeSlots;
+    QQueue<int> usedSlots;      // oldest first
+    int currentSlot;
+    int blockUsed;
+
+    QTemporaryFile spillFile;
+    uchar *spillData;
+
+    QQueue<Entry> entries;
+    QQueue<qint64> keyframes;   // sequence of keyframe entries, ascending
+    qint64 first;               // sequence of entries.first()
+
+    double duration;            // seconds recorded, cached for gui
+};
+
+#endif // TIMESHIFTBUFFER_H
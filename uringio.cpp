@@ -0,0 +1,301 @@
+#include <QDebug>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <liburing.h>
+
+extern "C"
+{
+#include "libavutil/time.h"
+}
+
+#include "uringio.h"
+
+/* Size of one read, multiple of alignment, in bytes. */
+#define URING_BLOCK_SIZE (1024 * 1024)
+/* Reads kept in flight ahead of read position. */
+#define URING_QUEUE_DEPTH 8
+/* Buffer & offset alignment required by O_DIRECT. */
+#define URING_ALIGNMENT 4096
+
+UringIO::UringIO() :
+    fd(-1),
+    ring(NULL),
+    fileSize(0),
+    pos(0),
+    blocks(NULL),
+    blockCount(URING_QUEUE_DEPTH),
+    firstBlock(0),
+    nextBlock(0),
+    inflight(0),
+    busyStart(0)
+{
+
+}
+
+UringIO::~UringIO()
+{
+    if (ring) {
+        while (inflight > 0 && reap(true) >= 0) {
+        }
+        io_uring_queue_exit(ring);
+        delete ring;
+    }
+
+    if (blocks) {
+        for (int i = 0; i < blockCount; i++) {
+            free(blocks[i].buf);
+        }
+        delete[] blocks;
+    }
+
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+QString UringIO::name()
+{
+    return "io_uring";
+}
+
+int UringIO::open(QString file, const AVIOInterruptCB *interrupt)
+{
+    int ret;
+    struct stat st;
+    QByteArray path = file.toLocal8Bit();
+
+    if (interrupt) {
+        interruptCallback = *interrupt;
+    }
+
+    /* bypass page cache if file system allows, reads are aligned anyway */
+    if ((fd = ::open(path.data(), O_RDONLY | O_DIRECT)) < 0
+            && (fd = ::open(path.data(), O_RDONLY)) < 0) {
+        return AVERROR(errno);
+    }
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        return AVERROR(EINVAL);
+    }
+    fileSize = st.st_size;
+
+    ring = new struct io_uring;
+    if ((ret = io_uring_queue_init(URING_QUEUE_DEPTH, ring, 0)) < 0) {
+        qDebug() << "io_uring not available, error code:" << ret;
+        delete ring;
+        ring = NULL;
+        return ret;
+    }
+
+    blocks = new Block[blockCount];
+    for (int i = 0; i < blockCount; i++) {
+        if (posix_memalign(reinterpret_cast<void **>(&blocks[i].buf), URING_ALIGNMENT, URING_BLOCK_SIZE) != 0) {
+            blocks[i].buf = NULL;
+        }
+        blocks[i].iov.iov_base = blocks[i].buf;
+        blocks[i].iov.iov_len  = URING_BLOCK_SIZE;
+        blocks[i].index = -1;
+        blocks[i].length = 0;
+        blocks[i].isInflight = false;
+        blocks[i].isReady = false;
+
+        if (!blocks[i].buf) {
+            return AVERROR(ENOMEM);
+        }
+    }
+
+    restart(0);
+
+    return 0;
+}
+
+/* queue read of block, its slot must be idle */
+void UringIO::submit(qint64 index)
+{
+    Block *block = &blocks[index % blockCount];
+
+    /* slot still reading block left behind window */
+    while (block->isInflight && reap(true) >= 0) {
+    }
+
+    struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+    if (!sqe) {
+        return;
+    }
+
+    io_uring_prep_readv(sqe, fd, &block->iov, 1, index * URING_BLOCK_SIZE);
+    io_uring_sqe_set_data(sqe, block);
+
+    block->index = index;
+    block->isInflight = true;
+    block->isReady = false;
+
+    if (inflight++ == 0) {
+        busyStart = av_gettime_relative();
+    }
+}
+
+/* keep window of blocks ahead of read position in flight */
+void UringIO::fill()
+{
+    bool submitted = false;
+
+    while (nextBlock < firstBlock + blockCount && nextBlock * URING_BLOCK_SIZE < fileSize) {
+        submit(nextBlock++);
+        submitted = true;
+    }
+
+    if (submitted) {
+        io_uring_submit(ring);
+    }
+}
+
+/* take one completion, -EAGAIN while nothing completed & not waiting */
+int UringIO::reap(bool wait)
+{
+    int ret;
+    struct io_uring_cqe *cqe;
+
+    do {
+        ret = wait ? io_uring_wait_cqe(ring, &cqe) : io_uring_peek_cqe(ring, &cqe);
+    } while (ret == -EINTR);
+
+    if (ret < 0) {
+        return ret;
+    }
+
+    Block *block = static_cast<Block *>(io_uring_cqe_get_data(cqe));
+    block->length = cqe->res;
+    block->isInflight = false;
+    block->isReady = true;
+
+    /* source time counts while any read is in flight */
+    if (--inflight == 0) {
+        stats.sourceTime += av_gettime_relative() - busyStart;
+    }
+
+    if (cqe->res > 0) {
+        stats.sourceBytes += cqe->res;
+    }
+
+    io_uring_cqe_seen(ring, cqe);
+
+    return 0;
+}
+
+/* jump out of window, wait for reads in flight then start window at block */
+void UringIO::restart(qint64 index)
+{
+    while (inflight > 0 && reap(true) >= 0) {
+    }
+
+    for (int i = 0; i < blockCount; i++) {
+        blocks[i].isReady = false;
+    }
+
+    firstBlock = index;
+    nextBlock  = index;
+
+    fill();
+}
+
+int UringIO::read(uint8_t *buf, int size)
+{
+    while (true) {
+        if (pos >= fileSize) {
+            return AVERROR_EOF;
+        }
+
+        qint64 index = pos / URING_BLOCK_SIZE;
+
+        if (index < firstBlock || index >= nextBlock) {
+            restart(index);
+        } else if (index > firstBlock) {
+            /* blocks behind read position are free for reading ahead */
+            firstBlock = index;
+            fill();
+        }
+
+        Block *block = &blocks[index % blockCount];
+
+        /* collect completions without blocking first, so slots are refilled early */
+        while (reap(false) >= 0) {
+        }
+
+        if (!block->isReady) {
+            if (isInterrupted()) {
+                return AVERROR_EXIT;
+            }
+
+            /* block could not be queued before */
+            if (!block->isInflight) {
+                submit(index);
+                io_uring_submit(ring);
+            }
+
+            qint64 start = av_gettime_relative();
+            reap(true);
+            stats.stallTime += av_gettime_relative() - start;
+            continue;
+        }
+
+        if (block->length < 0) {
+            qDebug() << "io_uring read failed, error code:" << block->length;
+            return block->length;
+        }
+
+        int offset = static_cast<int>(pos - index * URING_BLOCK_SIZE);
+
+        /* short read inside file, read block again */
+        if (offset >= block->length) {
+            submit(index);
+            io_uring_submit(ring);
+            continue;
+        }
+
+        int len = qMin(size, block->length - offset);
+        memcpy(buf, block->buf + offset, len);
+        pos += len;
+
+        return len;
+    }
+}
+
+int64_t UringIO::seek(int64_t offset, int whence)
+{
+    qint64 target;
+
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return fileSize;
+    case SEEK_SET:
+        target = offset;
+        break;
+    case SEEK_CUR:
+        target = pos + offset;
+        break;
+    case SEEK_END:
+        target = fileSize + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+
+    if (target < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    stats.seeks++;
+
+    /* window moved by next read, blocks still in window are kept */
+    qint64 index = target / URING_BLOCK_SIZE;
+    if (index >= firstBlock && index < nextBlock) {
+        stats.seeksInBuffer++;
+    }
+
+    pos = target;
+
+    return pos;
+}
@@ -0,0 +1,56 @@
+#ifndef URINGIO_H
+#define URINGIO_H
+
+#include <sys/uio.h>
+
+#include "mediaio.h"
+
+struct io_uring;
+
+/* Keep several aligned block reads of local file in flight by io_uring,
+ * demuxer reads are served from completed blocks. Linux only, built with
+ * CONFIG += uring.
+ */
+class UringIO : public MediaIO
+{
+public:
+    explicit UringIO();
+    ~UringIO();
+
+    int open(QString file, const AVIOInterruptCB *interrupt);
+    QString name();
+
+protected:
+    int read(uint8_t *buf, int size);
+    int64_t seek(int64_t offset, int whence);
+
+private:
+    struct Block
+    {
+        uint8_t *buf;
+        struct iovec iov;   // must stay valid while read in flight
+        qint64 index;       // block index in file
+        int length;         // bytes read, negative error code
+        bool isInflight;
+        bool isReady;
+    };
+
+    void submit(qint64 index);
+    void fill();
+    int reap(bool wait);
+    void restart(qint64 index);
+
+    int fd;
+    struct io_uring *ring;
+    qint64 fileSize;
+    qint64 pos;
+
+    Block *blocks;
+    int blockCount;
+    qint64 firstBlock;      // oldest block index of window
+    qint64 nextBlock;       // next block index to submit
+    int inflight;
+    qint64 busyStart;       // time reads in flight went from none to some
+};
+
+#endif // URINGIO_H
@@ -0,0 +1,495 @@
+#include <QDebug>
+
+extern "C"
+{
+#include "libavutil/cpu.h"
+#include "libavutil/pixfmt.h"
+}
+
+#include "yuvconvert.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define YUV_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define YUV_NEON
+#include <arm_neon.h>
+#endif
+
+/* gcc & clang build intrinsics of newer instruction sets only in functions targeting them */
+#if defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+/* Fraction bits of fixed point coefficients, products stay in 16 bits. */
+#define YUV_FRAC_BITS (6)
+/* Luma coefficient has one bit more, its product is unsigned & halved after. */
+#define YUV_LUMA_FRAC_BITS (YUV_FRAC_BITS + 1)
+
+enum {
+    FORMAT_YUV420P,
+    FORMAT_NV12         // chroma interleaved U V
+};
+
+enum {
+    MATRIX_BT601,
+    MATRIX_BT709
+};
+
+enum {
+    RANGE_LIMITED,      // Y 16..235, chroma 16..240
+    RANGE_FULL
+};
+
+constexpr int toFixed(double value, int bits = YUV_FRAC_BITS)
+{
+    return static_cast<int>(value * (1 << bits) + 0.5);
+}
+
+constexpr double lumaRed(int matrix)
+{
+    return (matrix == MATRIX_BT709) ? 0.2126 : 0.299;
+}
+
+constexpr double lumaBlue(int matrix)
+{
+    return (matrix == MATRIX_BT709) ? 0.0722 : 0.114;
+}
+
+/* rgb = y * max(Y - yOffset, 0) + {rv * V, -gu * U - gv * V, bu * U}, chroma centered at 128 */
+template <int Matrix, int Range>
+struct Coefficients
+{
+    enum {
+        yOffset = (Range == RANGE_FULL) ? 0 : 16,
+        y  = toFixed((Range == RANGE_FULL) ? 1.0 : 255.0 / 219.0, YUV_LUMA_FRAC_BITS),
+        rv = toFixed(2.0 * (1.0 - lumaRed(Matrix)) * ((Range == RANGE_FULL) ? 1.0 : 255.0 / 224.0)),
+        gu = toFixed(2.0 * lumaBlue(Matrix) * (1.0 - lumaBlue(Matrix)) / (1.0 - lumaRed(Matrix) - lumaBlue(Matrix))
+                     * ((Range == RANGE_FULL) ? 1.0 : 255.0 / 224.0)),
+        gv = toFixed(2.0 * lumaRed(Matrix) * (1.0 - lumaRed(Matrix)) / (1.0 - lumaRed(Matrix) - lumaBlue(Matrix))
+                     * ((Range == RANGE_FULL) ? 1.0 : 255.0 / 224.0)),
+        bu = toFixed(2.0 * (1.0 - lumaBlue(Matrix)) * ((Range == RANGE_FULL) ? 1.0 : 255.0 / 224.0)),
+        round = 1 << (YUV_FRAC_BITS - 1)
+    };
+};
+
+static inline uchar clampPixel(int value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+/* Pixels from x to end of row, same fixed point math as simd kernels so results are equal. */
+template <int Format, int Matrix, int Range, int Output>
+static void convertRowC(const uchar *y, const uchar *u, const uchar *v, uchar *dst, int x, int width)
+{
+    typedef Coefficients<Matrix, Range> C;
+
+    for (; x < width; x++) {
+        int cb, cr;
+        if (Format == FORMAT_NV12) {
+            cb = u[x / 2 * 2] - 128;
+            cr = u[x / 2 * 2 + 1] - 128;
+        } else {
+            cb = u[x / 2] - 128;
+            cr = v[x / 2] - 128;
+        }
+
+        int luma = ((qMax(y[x] - C::yOffset, 0) * C::y) >> 1) + C::round;
+        uchar r = clampPixel((luma + C::rv * cr) >> YUV_FRAC_BITS);
+        uchar g = clampPixel((luma - C::gu * cb - C::gv * cr) >> YUV_FRAC_BITS);
+        uchar b = clampPixel((luma + C::bu * cb) >> YUV_FRAC_BITS);
+
+        uchar *pixel = dst + x * 4;
+        pixel[0] = (Output == YuvConvert::OUTPUT_RGBA) ? r : b;
+        pixel[1] = g;
+        pixel[2] = (Output == YuvConvert::OUTPUT_RGBA) ? b : r;
+        pixel[3] = 255;
+    }
+}
+
+/* Simd part of a row, returns pixels done, the rest is left to convertRowC. */
+template <int Isa>
+struct RowSimd
+{
+    template <int Format, int Matrix, int Range, int Output>
+    static int convert(const uchar *, const uchar *, const uchar *, uchar *, int)
+    {
+        return 0;
+    }
+};
+
+#ifdef YUV_X86
+template <>
+struct RowSimd<YuvConvert::ISA_SSE2>
+{
+    /* 16 pixels, 16 bit lanes */
+    template <int Format, int Matrix, int Range, int Output>
+    TARGET_SSE2 static int convert(const uchar *y, const uchar *u, const uchar *v, uchar *dst, int width)
+    {
+        typedef Coefficients<Matrix, Range> C;
+
+        const __m128i zero    = _mm_setzero_si128();
+        const __m128i alpha   = _mm_set1_epi8(-1);
+        const __m128i yOffset = _mm_set1_epi8(C::yOffset);
+        const __m128i yCoef   = _mm_set1_epi16(C::y);
+        const __m128i round   = _mm_set1_epi16(C::round);
+        const __m128i cOffset = _mm_set1_epi16(128);
+        const __m128i rv = _mm_set1_epi16(C::rv);
+        const __m128i gu = _mm_set1_epi16(C::gu);
+        const __m128i gv = _mm_set1_epi16(C::gv);
+        const __m128i bu = _mm_set1_epi16(C::bu);
+        int x = 0;
+
+        for (; x + 16 <= width; x += 16) {
+            __m128i cb, cr;
+            if (Format == FORMAT_NV12) {
+                __m128i uv = _mm_loadu_si128(reinterpret_cast<const __m128i *>(u + x));
+                cb = _mm_and_si128(uv, _mm_set1_epi16(0xFF));
+                cr = _mm_srli_epi16(uv, 8);
+            } else {
+                cb = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(u + x / 2)), zero);
+                cr = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(v + x / 2)), zero);
+            }
+            cb = _mm_sub_epi16(cb, cOffset);
+            cr = _mm_sub_epi16(cr, cOffset);
+
+            /* chroma terms of 8 samples, each one shared by 2 pixels */
+            __m128i rt = _mm_mullo_epi16(cr, rv);
+            __m128i gt = _mm_add_epi16(_mm_mullo_epi16(cb, gu), _mm_mullo_epi16(cr, gv));
+            __m128i bt = _mm_mullo_epi16(cb, bu);
+
+            /* below black clamped, unsigned product fits 16 bits */
+            __m128i luma = _mm_subs_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x)), yOffset);
+            __m128i ylo = _mm_add_epi16(_mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(luma, zero), yCoef), 1), round);
+            __m128i yhi = _mm_add_epi16(_mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(luma, zero), yCoef), 1), round);
+
+            /* saturating adds clamp like convertRowC */
+            __m128i r = _mm_packus_epi16(_mm_srai_epi16(_mm_adds_epi16(ylo, _mm_unpacklo_epi16(rt, rt)), YUV_FRAC_BITS),
+                                         _mm_srai_epi16(_mm_adds_epi16(yhi, _mm_unpackhi_epi16(rt, rt)), YUV_FRAC_BITS));
+            __m128i g = _mm_packus_epi16(_mm_srai_epi16(_mm_subs_epi16(ylo, _mm_unpacklo_epi16(gt, gt)), YUV_FRAC_BITS),
+                                         _mm_srai_epi16(_mm_subs_epi16(yhi, _mm_unpackhi_epi16(gt, gt)), YUV_FRAC_BITS));
+            __m128i b = _mm_packus_epi16(_mm_srai_epi16(_mm_adds_epi16(ylo, _mm_unpacklo_epi16(bt, bt)), YUV_FRAC_BITS),
+                                         _mm_srai_epi16(_mm_adds_epi16(yhi, _mm_unpackhi_epi16(bt, bt)), YUV_FRAC_BITS));
+
+            __m128i first = (Output == YuvConvert::OUTPUT_RGBA) ? r : b;
+            __m128i third = (Output == YuvConvert::OUTPUT_RGBA) ? b : r;
+            __m128i lo  = _mm_unpacklo_epi8(first, g);
+            __m128i hi  = _mm_unpackhi_epi8(first, g);
+            __m128i alo = _mm_unpacklo_epi8(third, alpha);
+            __m128i ahi = _mm_unpackhi_epi8(third, alpha);
+
+            __m128i *out = reinterpret_cast<__m128i *>(dst + x * 4);
+            _mm_storeu_si128(out,     _mm_unpacklo_epi16(lo, alo));
+            _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo, alo));
+            _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi, ahi));
+            _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi, ahi));
+        }
+
+        return x;
+    }
+};
+
+template <>
+struct RowSimd<YuvConvert::ISA_AVX2>
+{
+    /* 32 pixels, unpacks work inside 128 bit lanes, so qwords are reordered around them */
+    template <int Format, int Matrix, int Range, int Output>
+    TARGET_AVX2 static int convert(const uchar *y, const uchar *u, const uchar *v, uchar *dst, int width)
+    {
+        typedef Coefficients<Matrix, Range> C;
+
+        const __m256i alpha   = _mm256_set1_epi8(-1);
+        const __m256i yOffset = _mm256_set1_epi8(C::yOffset);
+        const __m256i yCoef   = _mm256_set1_epi16(C::y);
+        const __m256i round   = _mm256_set1_epi16(C::round);
+        const __m256i cOffset = _mm256_set1_epi16(128);
+        const __m256i rv = _mm256_set1_epi16(C::rv);
+        const __m256i gu = _mm256_set1_epi16(C::gu);
+        const __m256i gv = _mm256_set1_epi16(C::gv);
+        const __m256i bu = _mm256_set1_epi16(C::bu);
+        int x = 0;
+
+        for (; x + 32 <= width; x += 32) {
+            __m256i cb, cr;
+            if (Format == FORMAT_NV12) {
+                __m256i uv = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(u + x));
+                cb = _mm256_and_si256(uv, _mm256_set1_epi16(0xFF));
+                cr = _mm256_srli_epi16(uv, 8);
+            } else {
+                cb = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(u + x / 2)));
+                cr = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(v + x / 2)));
+            }
+            cb = _mm256_sub_epi16(cb, cOffset);
+            cr = _mm256_sub_epi16(cr, cOffset);
+
+            /* qwords 0 2 1 3, so lane wise unpacks give chroma of pixels 0-15 & 16-31 */
+            __m256i rt = _mm256_permute4x64_epi64(_mm256_mullo_epi16(cr, rv), 0xD8);
+            __m256i gt = _mm256_permute4x64_epi64(_mm256_add_epi16(_mm256_mullo_epi16(cb, gu), _mm256_mullo_epi16(cr, gv)), 0xD8);
+            __m256i bt = _mm256_permute4x64_epi64(_mm256_mullo_epi16(cb, bu), 0xD8);
+
+            __m256i luma = _mm256_subs_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(y + x)), yOffset);
+            __m256i ylo = _mm256_add_epi16(_mm256_srli_epi16(_mm256_mullo_epi16(
+                    _mm256_cvtepu8_epi16(_mm256_castsi256_si128(luma)), yCoef), 1), round);
+            __m256i yhi = _mm256_add_epi16(_mm256_srli_epi16(_mm256_mullo_epi16(
+                    _mm256_cvtepu8_epi16(_mm256_extracti128_si256(luma, 1)), yCoef), 1), round);
+
+            /* packus interleaves lanes, reordered back to pixel order */
+            __m256i r = _mm256_permute4x64_epi64(_mm256_packus_epi16(
+                    _mm256_srai_epi16(_mm256_adds_epi16(ylo, _mm256_unpacklo_epi16(rt, rt)), YUV_FRAC_BITS),
+                    _mm256_srai_epi16(_mm256_adds_epi16(yhi, _mm256_unpackhi_epi16(rt, rt)), YUV_FRAC_BITS)), 0xD8);
+            __m256i g = _mm256_permute4x64_epi64(_mm256_packus_epi16(
+                    _mm256_srai_epi16(_mm256_subs_epi16(ylo, _mm256_unpacklo_epi16(gt, gt)), YUV_FRAC_BITS),
+                    _mm256_srai_epi16(_mm256_subs_epi16(yhi, _mm256_unpackhi_epi16(gt, gt)), YUV_FRAC_BITS)), 0xD8);
+            __m256i b = _mm256_permute4x64_epi64(_mm256_packus_epi16(
+                    _mm256_srai_epi16(_mm256_adds_epi16(ylo, _mm256_unpacklo_epi16(bt, bt)), YUV_FRAC_BITS),
+                    _mm256_srai_epi16(_mm256_adds_epi16(yhi, _mm256_unpackhi_epi16(bt, bt)), YUV_FRAC_BITS)), 0xD8);
+
+            __m256i first = (Output == YuvConvert::OUTPUT_RGBA) ? r : b;
+            __m256i third = (Output == YuvConvert::OUTPUT_RGBA) ? b : r;
+            __m256i lo  = _mm256_unpacklo_epi8(first, g);       // pixels 0-7 | 16-23
+            __m256i hi  = _mm256_unpackhi_epi8(first, g);       // pixels 8-15 | 24-31
+            __m256i alo = _mm256_unpacklo_epi8(third, alpha);
+            __m256i ahi = _mm256_unpackhi_epi8(third, alpha);
+
+            __m256i p0 = _mm256_unpacklo_epi16(lo, alo);        // pixels 0-3 | 16-19
+            __m256i p1 = _mm256_unpackhi_epi16(lo, alo);        // pixels 4-7 | 20-23
+            __m256i p2 = _mm256_unpacklo_epi16(hi, ahi);        // pixels 8-11 | 24-27
+            __m256i p3 = _mm256_unpackhi_epi16(hi, ahi);        // pixels 12-15 | 28-31
+
+            __m256i *out = reinterpret_cast<__m256i *>(dst + x * 4);
+            _mm256_storeu_si256(out,     _mm256_permute2x128_si256(p0, p1, 0x20));
+            _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+            _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+            _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+        }
+
+        return x;
+    }
+};
+#endif
+
+#ifdef YUV_NEON
+template <>
+struct RowSimd<YuvConvert::ISA_NEON>
+{
+    /* 16 pixels, interleaved store by vst4 */
+    template <int Format, int Matrix, int Range, int Output>
+    static int convert(const uchar *y, const uchar *u, const uchar *v, uchar *dst, int width)
+    {
+        typedef Coefficients<Matrix, Range> C;
+
+        const uint8x16_t yOffset = vdupq_n_u8(C::yOffset);
+        const uint16x8_t yCoef   = vdupq_n_u16(C::y);
+        const int16x8_t round   = vdupq_n_s16(C::round);
+        const int16x8_t cOffset = vdupq_n_s16(128);
+        const int16x8_t rv = vdupq_n_s16(C::rv);
+        const int16x8_t gu = vdupq_n_s16(C::gu);
+        const int16x8_t gv = vdupq_n_s16(C::gv);
+        const int16x8_t bu = vdupq_n_s16(C::bu);
+        int x = 0;
+
+        for (; x + 16 <= width; x += 16) {
+            int16x8_t cb, cr;
+            if (Format == FORMAT_NV12) {
+                uint8x8x2_t uv = vld2_u8(u + x);
+                cb = vreinterpretq_s16_u16(vmovl_u8(uv.val[0]));
+                cr = vreinterpretq_s16_u16(vmovl_u8(uv.val[1]));
+            } else {
+                cb = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(u + x / 2)));
+                cr = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(v + x / 2)));
+            }
+            cb = vsubq_s16(cb, cOffset);
+            cr = vsubq_s16(cr, cOffset);
+
+            int16x8x2_t rt = vzipq_s16(vmulq_s16(cr, rv), vmulq_s16(cr, rv));
+            int16x8_t gSum = vmlaq_s16(vmulq_s16(cb, gu), cr, gv);
+            int16x8x2_t gt = vzipq_s16(gSum, gSum);
+            int16x8x2_t bt = vzipq_s16(vmulq_s16(cb, bu), vmulq_s16(cb, bu));
+
+            uint8x16_t luma = vqsubq_u8(vld1q_u8(y + x), yOffset);
+            int16x8_t ylo = vaddq_s16(vreinterpretq_s16_u16(vshrq_n_u16(vmulq_u16(vmovl_u8(vget_low_u8(luma)), yCoef), 1)), round);
+            int16x8_t yhi = vaddq_s16(vreinterpretq_s16_u16(vshrq_n_u16(vmulq_u16(vmovl_u8(vget_high_u8(luma)), yCoef), 1)), round);
+
+            uint8x16_t r = vcombine_u8(vqmovun_s16(vshrq_n_s16(vqaddq_s16(ylo, rt.val[0]), YUV_FRAC_BITS)),
+                                       vqmovun_s16(vshrq_n_s16(vqaddq_s16(yhi, rt.val[1]), YUV_FRAC_BITS)));
+            uint8x16_t g = vcombine_u8(vqmovun_s16(vshrq_n_s16(vqsubq_s16(ylo, gt.val[0]), YUV_FRAC_BITS)),
+                                       vqmovun_s16(vshrq_n_s16(vqsubq_s16(yhi, gt.val[1]), YUV_FRAC_BITS)));
+            uint8x16_t b = vcombine_u8(vqmovun_s16(vshrq_n_s16(vqaddq_s16(ylo, bt.val[0]), YUV_FRAC_BITS)),
+                                       vqmovun_s16(vshrq_n_s16(vqaddq_s16(yhi, bt.val[1]), YUV_FRAC_BITS)));
+
+            uint8x16x4_t pixels;
+            pixels.val[0] = (Output == YuvConvert::OUTPUT_RGBA) ? r : b;
+            pixels.val[1] = g;
+            pixels.val[2] = (Output == YuvConvert::OUTPUT_RGBA) ? b : r;
+            pixels.val[3] = vdupq_n_u8(255);
+            vst4q_u8(dst + x * 4, pixels);
+        }
+
+        return x;
+    }
+};
+#endif
+
+template <int Isa, int Format, int Matrix, int Range, int Output>
+static void convertRows(const AVFrame *frame, uchar *dst, int dstStride, int rowStart, int rowEnd)
+{
+    for (int row = rowStart; row < rowEnd; row++) {
+        const uchar *y = frame->data[0] + row * frame->linesize[0];
+        const uchar *u = frame->data[1] + (row / 2) * frame->linesize[1];
+        const uchar *v = (Format == FORMAT_YUV420P) ? frame->data[2] + (row / 2) * frame->linesize[2] : NULL;
+        uchar *out = dst + row * dstStride;
+
+        int x = RowSimd<Isa>::template convert<Format, Matrix, Range, Output>(y, u, v, out, frame->width);
+        convertRowC<Format, Matrix, Range, Output>(y, u, v, out, x, frame->width);
+    }
+}
+
+/* one instantiation per input format, matrix, range & output format */
+template <int Isa, int Format, int Matrix, int Range>
+static YuvConvert::Kernel selectOutput(int output)
+{
+    if (output == YuvConvert::OUTPUT_RGBA) {
+        return convertRows<Isa, Format, Matrix, Range, YuvConvert::OUTPUT_RGBA>;
+    }
+    return convertRows<Isa, Format, Matrix, Range, YuvConvert::OUTPUT_RGB32>;
+}
+
+template <int Isa, int Format, int Matrix>
+static YuvConvert::Kernel selectRange(int range, int output)
+{
+    if (range == RANGE_FULL) {
+        return selectOutput<Isa, Format, Matrix, RANGE_FULL>(output);
+    }
+    return selectOutput<Isa, Format, Matrix, RANGE_LIMITED>(output);
+}
+
+template <int Isa>
+static YuvConvert::Kernel selectKernel(int format, int matrix, int range, int output)
+{
+    if (format == FORMAT_NV12) {
+        return (matrix == MATRIX_BT709) ? selectRange<Isa, FORMAT_NV12, MATRIX_BT709>(range, output)
+                                        : selectRange<Isa, FORMAT_NV12, MATRIX_BT601>(range, output);
+    }
+    return (matrix == MATRIX_BT709) ? selectRange<Isa, FORMAT_YUV420P, MATRIX_BT709>(range, output)
+                                    : selectRange<Isa, FORMAT_YUV420P, MATRIX_BT601>(range, output);
+}
+
+YuvConvert::Isa YuvConvert::bestIsa()
+{
+    int flags = av_get_cpu_flags();
+
+#ifdef YUV_X86
+    if (flags & AV_CPU_FLAG_AVX2) {
+        return ISA_AVX2;
+    }
+    if (flags & AV_CPU_FLAG_SSE2) {
+        return ISA_SSE2;
+    }
+#endif
+
+#ifdef YUV_NEON
+    if (flags & AV_CPU_FLAG_NEON) {
+        return ISA_NEON;
+    }
+#endif
+
+    Q_UNUSED(flags);
+    return ISA_C;
+}
+
+/* C first, then what this build & cpu run, best last */
+QList<YuvConvert::Isa> YuvConvert::availableIsas()
+{
+    QList<Isa> isas;
+    Isa best = bestIsa();
+
+    isas << ISA_C;
+    if (best == ISA_SSE2 || best == ISA_AVX2) {
+        isas << ISA_SSE2;
+    }
+    if (best != ISA_C && best != ISA_SSE2) {
+        isas << best;
+    }
+
+    return isas;
+}
+
+QString YuvConvert::isaName(YuvConvert::Isa isa)
+{
+    switch (isa) {
+    case ISA_C:
+        return "c";
+    case ISA_SSE2:
+        return "sse2";
+    case ISA_AVX2:
+        return "avx2";
+    case ISA_NEON:
+        return "neon";
+    case ISA_AUTO:
+    default:
+        return isaName(bestIsa());
+    }
+}
+
+/* NULL while frame is not a case of own kernels or isa does not run here */
+YuvConvert::Kernel YuvConvert::findKernel(const AVFrame *frame, YuvConvert::Output output, YuvConvert::Isa isa)
+{
+    int format, matrix, range;
+
+    if (frame->format == AV_PIX_FMT_YUV420P) {
+        format = FORMAT_YUV420P;
+    } else if (frame->format == AV_PIX_FMT_NV12) {
+        format = FORMAT_NV12;
+    } else {
+        return NULL;
+    }
+
+    /* unspecified taken as BT.601 like swscale does */
+    switch (frame->colorspace) {
+    case AVCOL_SPC_BT709:
+        matrix = MATRIX_BT709;
+        break;
+    case AVCOL_SPC_BT470BG:
+    case AVCOL_SPC_SMPTE170M:
+    case AVCOL_SPC_UNSPECIFIED:
+        matrix = MATRIX_BT601;
+        break;
+    default:
+        return NULL;
+    }
+
+    range = (frame->color_range == AVCOL_RANGE_JPEG) ? RANGE_FULL : RANGE_LIMITED;
+
+    /* RGB32 is B G R A in memory only on little endian */
+    if (output == OUTPUT_RGB32 && Q_BYTE_ORDER != Q_LITTLE_ENDIAN) {
+        return NULL;
+    }
+
+    if (isa == ISA_AUTO) {
+        isa = bestIsa();
+    } else if (isa != ISA_C && !availableIsas().contains(isa)) {
+        return NULL;
+    }
+
+    switch (isa) {
+#ifdef YUV_X86
+    case ISA_AVX2:
+        return selectKernel<ISA_AVX2>(format, matrix, range, output);
+    case ISA_SSE2:
+        return selectKernel<ISA_SSE2>(format, matrix, range, output);
+#endif
+#ifdef YUV_NEON
+    case ISA_NEON:
+        return selectKernel<ISA_NEON>(format, matrix, range, output);
+#endif
+    default:
+        return selectKernel<ISA_C>(format, matrix, range, output);
+    }
+}
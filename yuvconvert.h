@@ -0,0 +1,43 @@
+#ifndef YUVCONVERT_H
+#define YUVCONVERT_H
+
+#include <QString>
+#include <QList>
+
+extern "C"
+{
+#include "libavutil/frame.h"
+}
+
+/* Own YUV to RGB kernels for the common case, 8 bit YUV420P or NV12 at
+ * unchanged size, BT.601 or BT.709, limited or full range. Kernels are
+ * specialized by template per input format, matrix, range & output format,
+ * instruction set picked at run time by cpu flags. Everything else, scaling
+ * included, is left to swscale.
+ */
+class YuvConvert
+{
+public:
+    enum Output {
+        OUTPUT_RGB32,   // QImage::Format_RGB32, B G R A bytes on little endian
+        OUTPUT_RGBA     // QImage::Format_RGBA8888
+    };
+
+    enum Isa {
+        ISA_AUTO,       // best one the cpu runs
+        ISA_C,
+        ISA_SSE2,
+        ISA_AVX2,
+        ISA_NEON
+    };
+
+    /* converts rows [rowStart, rowEnd) of frame, rowStart even */
+    typedef void (*Kernel)(const AVFrame *frame, uchar *dst, int dstStride, int rowStart, int rowEnd);
+
+    static Kernel findKernel(const AVFrame *frame, YuvConvert::Output output, YuvConvert::Isa isa = ISA_AUTO);
+    static YuvConvert::Isa bestIsa();
+    static QString isaName(YuvConvert::Isa isa);
+    static QList<YuvConvert::Isa> availableIsas();
+};
+
+#endif // YUVCONVERT_H